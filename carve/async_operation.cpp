@@ -0,0 +1,268 @@
+#include "async_operation.h"
+#include "csg_operation.h"
+#include "mesh_builder.h"
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct CSGAsyncOperation::State : public OperationProgress
+{
+    State(const CSGMesh& a, const CSGMesh& b, CSGOp csgOp, CSGProgressCallback callback, void* callbackUserData)
+        : meshA(a), meshB(b), op(csgOp), progressCallback(callback), userData(callbackUserData), status(CSGAsyncStatus::Running), progress(0.0f),
+          reportedProgress(0.0f), cancelled(false)
+    {
+    }
+
+    virtual bool update(double fraction) override
+    {
+        if (cancelled.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+
+        float value = (float)fraction;
+        progress.store(value, std::memory_order_relaxed);
+
+        // the callback is only called for steps of at least a percent, so that checks inside loops stay cheap
+        if (progressCallback != nullptr && value - reportedProgress >= 0.01f)
+        {
+            std::lock_guard<std::mutex> lock(callbackMutex);
+            if (cancelled.load(std::memory_order_relaxed))
+            {
+                return false;
+            }
+
+            reportedProgress = value;
+            progressCallback(value, userData);
+        }
+
+        return true;
+    }
+
+    void cancel()
+    {
+        // taking the callback lock makes sure that no callback is running when this returns
+        std::lock_guard<std::mutex> lock(callbackMutex);
+        cancelled = true;
+    }
+
+    void finish(CSGAsyncStatus result)
+    {
+        if (result == CSGAsyncStatus::Succeeded)
+        {
+            update(1.0);
+        }
+
+        status.store(result);
+        finished.set_value();
+    }
+
+    // copies of the operands, so that the caller may destroy its meshes right after starting the operation
+    CSGMesh meshA;
+    CSGMesh meshB;
+    CSGOp op;
+
+    CSGProgressCallback progressCallback;
+    void* userData;
+    std::mutex callbackMutex;
+
+    std::atomic<CSGAsyncStatus> status;
+    std::atomic<float> progress;
+    float reportedProgress; // only used by the operation thread
+    std::atomic<bool> cancelled;
+
+    // written by the operation thread before finished is set, and only read after it
+    std::unique_ptr<CSGMesh> result;
+    std::string errorMessage;
+    bool resultTaken = false;
+
+    std::promise<void> finished;
+};
+
+namespace
+{
+    // The threads of the operations, so that they can be joined: finished threads when the next operation starts, and all
+    // of them on shutdown. Never destroyed, as destroying a thread that has not been joined terminates the process.
+    class OperationThreads
+    {
+    public:
+        static OperationThreads& instance()
+        {
+            static OperationThreads* threads = new OperationThreads();
+            return *threads;
+        }
+
+        void start(std::shared_ptr<CSGAsyncOperation::State> state, void (*run)(std::shared_ptr<CSGAsyncOperation::State>));
+        void shutdown();
+
+    private:
+        struct Entry
+        {
+            std::shared_ptr<CSGAsyncOperation::State> state;
+            std::thread thread;
+        };
+
+        std::mutex m_mutex;
+        std::vector<Entry> m_entries;
+    };
+
+    void OperationThreads::start(std::shared_ptr<CSGAsyncOperation::State> state, void (*run)(std::shared_ptr<CSGAsyncOperation::State>))
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < m_entries.size();)
+        {
+            if (m_entries[i].state->status.load() != CSGAsyncStatus::Running)
+            {
+                // the thread has nothing left to do but to return
+                m_entries[i].thread.join();
+                m_entries[i] = std::move(m_entries.back());
+                m_entries.pop_back();
+            }
+            else
+            {
+                ++i;
+            }
+        }
+
+        Entry entry;
+        entry.state = state;
+        entry.thread = std::thread(run, state);
+        m_entries.push_back(std::move(entry));
+    }
+
+    void OperationThreads::shutdown()
+    {
+        std::vector<Entry> entries;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            entries.swap(m_entries);
+        }
+
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            entries[i].state->cancel();
+        }
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            entries[i].thread.join();
+        }
+    }
+}
+
+CSGAsyncOperation::CSGAsyncOperation(const CSGMesh& meshA, const CSGMesh& meshB, CSGOp op, CSGProgressCallback progressCallback, void* userData)
+    : m_state(std::make_shared<State>(meshA, meshB, op, progressCallback, userData))
+{
+    m_finished = m_state->finished.get_future().share();
+    OperationThreads::instance().start(m_state, run);
+}
+
+CSGAsyncOperation::~CSGAsyncOperation()
+{
+    // the operation thread owns the other reference to the state and releases it when it notices the cancellation
+    cancel();
+}
+
+void CSGAsyncOperation::run(std::shared_ptr<State> state)
+{
+    char errorMessage[256] = {};
+    CSGMesh* mesh = nullptr;
+    try
+    {
+        if (!state->cancelled)
+        {
+            mesh = performCSGOnViews(makeMeshView(&state->meshA), nullptr, makeMeshView(&state->meshB), nullptr, state->op, errorMessage,
+                sizeof(errorMessage) - 1, state.get());
+        }
+    }
+    catch (std::exception& ex)
+    {
+        setErrorMessage(errorMessage, sizeof(errorMessage) - 1, ex.what());
+    }
+    catch (...)
+    {
+        setErrorMessage(errorMessage, sizeof(errorMessage) - 1, "Unknown error");
+    }
+
+    // the operands are not needed any more, and a cancelled operation should give its memory back quickly
+    state->meshA = CSGMesh();
+    state->meshB = CSGMesh();
+
+    if (mesh != nullptr)
+    {
+        state->result.reset(mesh);
+        state->finish(CSGAsyncStatus::Succeeded);
+    }
+    else if (state->cancelled)
+    {
+        state->errorMessage = "Operation cancelled";
+        state->finish(CSGAsyncStatus::Cancelled);
+    }
+    else
+    {
+        state->errorMessage = errorMessage;
+        state->finish(CSGAsyncStatus::Failed);
+    }
+}
+
+CSGAsyncStatus CSGAsyncOperation::getStatus() const
+{
+    return m_state->status.load();
+}
+
+CSGAsyncStatus CSGAsyncOperation::wait(int timeoutMilliseconds) const
+{
+    if (timeoutMilliseconds < 0)
+    {
+        m_finished.wait();
+    }
+    else
+    {
+        m_finished.wait_for(std::chrono::milliseconds(timeoutMilliseconds));
+    }
+
+    return getStatus();
+}
+
+float CSGAsyncOperation::getProgress() const
+{
+    return m_state->progress.load(std::memory_order_relaxed);
+}
+
+void CSGAsyncOperation::cancel()
+{
+    m_state->cancel();
+}
+
+void CSGAsyncOperation::shutdown()
+{
+    OperationThreads::instance().shutdown();
+}
+
+CSGMesh* CSGAsyncOperation::takeResult(char* errorMessage, int errorMessageLength)
+{
+    switch (getStatus())
+    {
+    case CSGAsyncStatus::Running:
+        setErrorMessage(errorMessage, errorMessageLength, "Operation is still running");
+        return nullptr;
+    case CSGAsyncStatus::Succeeded:
+        if (m_state->resultTaken)
+        {
+            setErrorMessage(errorMessage, errorMessageLength, "The result has already been taken");
+            return nullptr;
+        }
+
+        m_state->resultTaken = true;
+        return m_state->result.release();
+    case CSGAsyncStatus::Failed:
+    case CSGAsyncStatus::Cancelled:
+    default:
+        setErrorMessage(errorMessage, errorMessageLength, m_state->errorMessage.c_str());
+        return nullptr;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef CARVE_DLL_ASYNC_OPERATION_H
+#define CARVE_DLL_ASYNC_OPERATION_H
+
+#include "carve.h"
+
+#include <future>
+#include <memory>
+
+// Handle returned by leoPerformCSGAsync. The operation runs on its own thread on copies of the operands, and only the
+// state shared with that thread outlives the handle, so destroying a running operation never blocks. The threads are
+// joined once they are done, or by shutdown().
+class CSGAsyncOperation
+{
+public:
+    CSGAsyncOperation(const CSGMesh& meshA, const CSGMesh& meshB, CSGOp op, CSGProgressCallback progressCallback, void* userData);
+
+    // Cancels the operation if it is still running, without waiting for it.
+    ~CSGAsyncOperation();
+
+    CSGAsyncStatus getStatus() const;
+
+    // Waits until the operation ends or the timeout elapses. A negative timeout waits without a limit.
+    CSGAsyncStatus wait(int timeoutMilliseconds) const;
+
+    float getProgress() const;
+
+    // Asks the operation to stop at its next check. The progress callback is not called any more once this returns.
+    void cancel();
+
+    // Hands the result of a finished operation over to the caller. Returns nullptr and fills the error message otherwise.
+    CSGMesh* takeResult(char* errorMessage, int errorMessageLength);
+
+    // Cancels the operations that are still running, including those whose handles were destroyed, and waits for all
+    // their threads to end.
+    static void shutdown();
+
+    struct State;
+
+private:
+
+    static void run(std::shared_ptr<State> state);
+
+    std::shared_ptr<State> m_state;
+    std::shared_future<void> m_finished;
+};
+
+#endif
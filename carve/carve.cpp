@@ -1,14 +1,22 @@
 
 #include "carve.h"
-#include "custom_collector.h"
-
+#include "async_operation.h"
+#include "csg_operation.h"
+#include "csg_tree.h"
+#include "deferred_result.h"
+#include "mesh_builder.h"
+#include "prepared_mesh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
 #include <vector>
 
 #include <include/carve.hpp>
 #include <include/csg.hpp>
-#include <include/csg_triangulator.hpp>
-#include <include/input.hpp>
 #include <include/interpolator.hpp>
+#include <include/util.hpp>
 
 CSGMesh::CSGMesh()
 {
@@ -26,6 +34,12 @@ void CSGMesh::stealVertices(std::vector<float>& vertices)
 void CSGMesh::stealTriangles(std::vector<int>& triangles)
 {
     m_triangles.swap(triangles);
+    m_triangleSources.clear();
+}
+
+void CSGMesh::stealTriangleSources(std::vector<CSGTriangleSource>& sources)
+{
+    m_triangleSources.swap(sources);
 }
 
 void CSGMesh::setVertices(int vertexCount, const float* vertices)
@@ -38,6 +52,7 @@ void CSGMesh::setTriangles(int triangleCount, const int* triangles)
 {
     m_triangles.resize((size_t)triangleCount * 3);
     memcpy(m_triangles.data(), triangles, (size_t)triangleCount * 3 * sizeof(int));
+    m_triangleSources.clear();
 }
 
 int CSGMesh::getVertexCount() const
@@ -60,6 +75,11 @@ const int* CSGMesh::getTriangles() const
     return m_triangles.data();
 }
 
+const CSGTriangleSource* CSGMesh::getTriangleSources() const
+{
+    return m_triangleSources.empty() ? nullptr : m_triangleSources.data();
+}
+
 
 void CSGMesh::log(std::ostream& stream) const
 {
@@ -82,78 +102,6 @@ void CSGMesh::log(std::ostream& stream) const
     stream << std::endl;
 }
 
-class FaceCollector : public carve::csg::CSG::Hook
-{
-public:
-    FaceCollector() : carve::csg::CSG::Hook()
-    {
-        _vertexCount = 0;
-    }
-
-    std::vector<float>& getVertices()
-    {
-        return _uniqueVertices;
-    }
-
-    std::vector<int>& getTriangles()
-    {
-        return _triangles;
-    }
-
-protected:
-    virtual void resultFace(const carve::csg::CSG::meshset_t::face_t* newFace, const carve::csg::CSG::meshset_t::face_t* originalFace, bool flipped) override
-    {
-        using Edge = carve::mesh::Edge<3>;
-
-        const Edge* startEdge = newFace->edge;
-        int startVertexIndex = tryAddVertex(startEdge->vert);
-
-        const Edge* currentEdge = startEdge->next;
-        int currentVertexIndex = tryAddVertex(currentEdge->vert);
-
-        while (currentEdge->next != startEdge)
-        {
-            const Edge* nextEdge = currentEdge->next;
-            int nextVertexIndex = tryAddVertex(nextEdge->vert);
-
-            _triangles.push_back(startVertexIndex);
-            _triangles.push_back(currentVertexIndex);
-            _triangles.push_back(nextVertexIndex);
-
-            currentEdge = nextEdge;
-            currentVertexIndex = nextVertexIndex;
-        }
-    }
-
-    virtual void resultNumFaces(size_t numFaces) override
-    {
-        _triangles.reserve(numFaces * 3);
-        _uniqueVertices.reserve(numFaces * 3); // guess
-        _vertexIndexMap.reserve(numFaces); // guess
-    }
-
-private:
-    int tryAddVertex(carve::mesh::Vertex<3>* vertex)
-    {
-        auto vertexIndexIt = _vertexIndexMap.insert({ vertex, _vertexCount });
-        if (vertexIndexIt.second)
-        {
-            ++_vertexCount;
-            _uniqueVertices.push_back((float)vertex->v.x);
-            _uniqueVertices.push_back((float)vertex->v.y);
-            _uniqueVertices.push_back((float)vertex->v.z);
-        }
-
-        return vertexIndexIt.first->second;
-    }
-
-private:
-    int _vertexCount;
-    robin_hood::unordered_flat_map<carve::mesh::Vertex<3>*, int> _vertexIndexMap;
-    std::vector<float> _uniqueVertices;
-    std::vector<int> _triangles;
-};
-
 EXPORT CSGMesh* STDCALL leoCreateCSGMesh()
 {
     return new CSGMesh();
@@ -205,181 +153,465 @@ EXPORT const int* STDCALL leoCSGMeshGetTrianglePointer(const CSGMesh* mesh)
     return mesh->getTriangles();
 }
 
+EXPORT int STDCALL leoCSGMeshGetTriangleSources(const CSGMesh* mesh, CSGTriangleSource* dstBuffer)
+{
+    const CSGTriangleSource* sources = mesh->getTriangleSources();
+    if (sources == nullptr)
+    {
+        return 0;
+    }
+
+    memcpy(dstBuffer, sources, (size_t)mesh->getTriangleCount() * sizeof(CSGTriangleSource));
+    return 1;
+}
+
+EXPORT const CSGTriangleSource* STDCALL leoCSGMeshGetTriangleSourcePointer(const CSGMesh* mesh)
+{
+    return mesh->getTriangleSources();
+}
+
 
 EXPORT CSGMesh* STDCALL leoPerformCSG(const CSGMesh* meshA, const CSGMesh* meshB, CSGOp op, char* errorMessage, int errorMessageLength)
 {
-    auto emptyMesh = [op](const CSGMesh* mesh, bool isA) {
-        CSGMesh* newMesh = new CSGMesh();
+    return performCSGOnViews(makeMeshView(meshA), nullptr, makeMeshView(meshB), nullptr, op, errorMessage, errorMessageLength);
+}
+
+EXPORT CSGMesh* STDCALL leoPerformCSGTransformed(const CSGMesh* meshA, const float* transformA, const CSGMesh* meshB, const float* transformB, CSGOp op,
+    char* errorMessage, int errorMessageLength)
+{
+    return performCSGOnViews(makeMeshView(meshA), transformA, makeMeshView(meshB), transformB, op, errorMessage, errorMessageLength);
+}
 
-        switch (op)
+EXPORT CSGMesh* STDCALL leoPerformCSGWithSources(const CSGMesh* meshA, const CSGMesh* meshB, CSGOp op, char* errorMessage, int errorMessageLength)
+{
+    return performCSGOnViews(makeMeshView(meshA), nullptr, makeMeshView(meshB), nullptr, op, errorMessage, errorMessageLength, nullptr, true);
+}
+
+EXPORT CSGMesh* STDCALL leoPerformCSGEx(const CSGMesh* meshA, const CSGMesh* meshB, CSGOp op, CSGStats* stats, char* errorMessage, int errorMessageLength)
+{
+    OperationStats operationStats;
+    CSGMesh* mesh = performCSGOnViews(makeMeshView(meshA), nullptr, makeMeshView(meshB), nullptr, op, errorMessage, errorMessageLength, nullptr, false,
+        &operationStats);
+    if (stats != nullptr)
+    {
+        operationStats.fill(*stats);
+    }
+    return mesh;
+}
+
+EXPORT CSGMesh* STDCALL leoPerformCSGView(const CSGMeshView* meshA, const CSGMeshView* meshB, CSGOp op, char* errorMessage, int errorMessageLength)
+{
+    return performCSGOnViews(*meshA, nullptr, *meshB, nullptr, op, errorMessage, errorMessageLength);
+}
+
+namespace
+{
+    // Forwards the chunks of a result to a sink callback of the C interface.
+    class CallbackTriangleSink : public TriangleSink
+    {
+    public:
+        CallbackTriangleSink(CSGTriangleSink sink, void* userData) : m_sink(sink), m_userData(userData)
         {
-        case CSGOp::Union:
-        case CSGOp::SymmetricDifference:
-            // just return the non-empty mesh
-            newMesh->setVertices(mesh->getVertexCount(), mesh->getVertices());
-            newMesh->setTriangles(mesh->getTriangleCount(), mesh->getTriangles());
-            break;
-        case CSGOp::Intersection:
-        default:
-            // no overlap, return an empty mesh
-            break;
-        case CSGOp::AMinusB:
-            // return the non-empty mesh if we are subtracting an empty mesh from it
-            if (isA)
-            {
-                newMesh->setVertices(mesh->getVertexCount(), mesh->getVertices());
-                newMesh->setTriangles(mesh->getTriangleCount(), mesh->getTriangles());
-            }
-            break;
-        case CSGOp::BMinusA:
-            if (!isA)
-            {
-                newMesh->setVertices(mesh->getVertexCount(), mesh->getVertices());
-                newMesh->setTriangles(mesh->getTriangleCount(), mesh->getTriangles());
-            }
-            break;
         }
 
-        return newMesh;
+        virtual bool consume(const float* vertices, int vertexCount, const int* triangles, int triangleCount) override
+        {
+            return m_sink(vertices, vertexCount, triangles, triangleCount, m_userData) != 0;
+        }
+
+    private:
+        CSGTriangleSink m_sink;
+        void* m_userData;
     };
 
-    if (meshA->getTriangleCount() == 0)
+    // Copies the chunks of a result into caller buffers that are large enough for all of it.
+    class BufferTriangleSink : public TriangleSink
     {
-        return emptyMesh(meshB, false);
-    }
-    else if (meshB->getTriangleCount() == 0)
-    {
-        return emptyMesh(meshA, true);
-    }
+    public:
+        BufferTriangleSink(float* vertices, int* triangles) : m_vertices(vertices), m_triangles(triangles)
+        {
+        }
 
-    auto setErrorMessage = [=](const char* errorMsg) {
-        if (errorMessage != nullptr)
+        virtual bool consume(const float* vertices, int vertexCount, const int* triangles, int triangleCount) override
         {
-#if _WIN32
-            strncpy_s(errorMessage, strlen(errorMsg) + 1, errorMsg, errorMessageLength);
-#else
-            strncpy(errorMessage, errorMsg, errorMessageLength);
-#endif
+            m_vertices = std::copy(vertices, vertices + vertexCount * 3, m_vertices);
+            m_triangles = std::copy(triangles, triangles + triangleCount * 3, m_triangles);
+            return true;
         }
+
+    private:
+        float* m_vertices;
+        int* m_triangles;
     };
+}
 
+EXPORT int STDCALL leoPerformCSGToSink(const CSGMesh* meshA, const CSGMesh* meshB, CSGOp op, CSGTriangleSink sink, void* userData, int chunkTriangles,
+    char* errorMessage, int errorMessageLength)
+{
     try
     {
-        using Meshset = carve::mesh::MeshSet<3>;
-        using Vertex_t = Meshset::vertex_t;
-        using Face_t = Meshset::face_t;
+        CallbackTriangleSink triangleSink(sink, userData);
+        writeCSGOnViews(makeMeshView(meshA), makeMeshView(meshB), op, triangleSink, chunkTriangles > 0 ? (size_t)chunkTriangles : DEFAULT_CHUNK_TRIANGLES);
+        return 1;
+    }
+    catch (carve::exception& ex)
+    {
+        setErrorMessage(errorMessage, errorMessageLength, ex.str().c_str());
+        return 0;
+    }
+    catch (std::exception& ex)
+    {
+        setErrorMessage(errorMessage, errorMessageLength, ex.what());
+        return 0;
+    }
+    catch (...)
+    {
+        setErrorMessage(errorMessage, errorMessageLength, "Unknown error");
+        return 0;
+    }
+}
 
-        Meshset* models[2] = { nullptr, nullptr };
-        const CSGMesh* inputMeshes[2] = { meshA, meshB };
+EXPORT CSGDeferredResult* STDCALL leoPerformCSGDeferred(const CSGMesh* meshA, const CSGMesh* meshB, CSGOp op, char* errorMessage, int errorMessageLength)
+{
+    try
+    {
+        return CSGDeferredResult::compute(makeMeshView(meshA), makeMeshView(meshB), op).release();
+    }
+    catch (carve::exception& ex)
+    {
+        setErrorMessage(errorMessage, errorMessageLength, ex.str().c_str());
+        return nullptr;
+    }
+    catch (std::exception& ex)
+    {
+        setErrorMessage(errorMessage, errorMessageLength, ex.what());
+        return nullptr;
+    }
+    catch (...)
+    {
+        setErrorMessage(errorMessage, errorMessageLength, "Unknown error");
+        return nullptr;
+    }
+}
 
-        carve::csg::CSG csg;
+EXPORT int STDCALL leoDeferredResultGetVertexCount(const CSGDeferredResult* result)
+{
+    return result->getVertexCount();
+}
 
-        try
+EXPORT int STDCALL leoDeferredResultGetTriangleCount(const CSGDeferredResult* result)
+{
+    return result->getTriangleCount();
+}
+
+EXPORT int STDCALL leoDeferredResultWrite(CSGDeferredResult* result, float* vertices, int* triangles, char* errorMessage, int errorMessageLength)
+{
+    try
+    {
+        BufferTriangleSink triangleSink(vertices, triangles);
+        result->write(triangleSink, DEFAULT_CHUNK_TRIANGLES);
+        return 1;
+    }
+    catch (carve::exception& ex)
+    {
+        setErrorMessage(errorMessage, errorMessageLength, ex.str().c_str());
+        return 0;
+    }
+    catch (std::exception& ex)
+    {
+        setErrorMessage(errorMessage, errorMessageLength, ex.what());
+        return 0;
+    }
+    catch (...)
+    {
+        setErrorMessage(errorMessage, errorMessageLength, "Unknown error");
+        return 0;
+    }
+}
+
+EXPORT void STDCALL leoDestroyDeferredResult(const CSGDeferredResult* result)
+{
+    delete result;
+}
+
+EXPORT void STDCALL leoSetThreadCount(int threadCount)
+{
+    carve::util::ThreadPool::instance().setThreadCount(threadCount > 0 ? (unsigned)threadCount : 0);
+}
+
+EXPORT int STDCALL leoGetThreadCount()
+{
+    return (int)carve::util::ThreadPool::instance().getThreadCount();
+}
+
+// Rough relative cost of a boolean operation, used to start the most expensive jobs of a batch first.
+// Building the meshes and R-trees is linear in the triangle count, finding the intersections is roughly n log n.
+static double estimateCSGCost(const CSGMesh* meshA, const CSGMesh* meshB)
+{
+    double triangleCount = (double)meshA->getTriangleCount() + (double)meshB->getTriangleCount();
+    return triangleCount * std::log2(triangleCount + 2.0);
+}
+
+EXPORT int STDCALL leoPerformCSGBatch(const CSGJob* jobs, int jobCount, CSGMesh** results)
+{
+    if (jobCount <= 0)
+    {
+        return 0;
+    }
+
+    std::vector<double> costs((size_t)jobCount, 0.0);
+    std::vector<int> order((size_t)jobCount);
+    for (int i = 0; i < jobCount; ++i)
+    {
+        order[i] = i;
+        results[i] = nullptr;
+        if (jobs[i].meshA != nullptr && jobs[i].meshB != nullptr)
         {
-            // create meshes in parallel
-            carve::util::forEachParallel<size_t>(0, 2, 1,
-                [&inputMeshes, &models](size_t i)
-                {
-                    const CSGMesh* mesh = inputMeshes[i];
-
-                    carve::input::PolyhedronData data;
-                    data.reserveVertices(mesh->getVertexCount());
-                    data.reserveFaces(mesh->getTriangleCount(), 3);
-
-                    int numVertexValues = mesh->getVertexCount() * 3;
-                    const float* meshVerts = mesh->getVertices();
-                    for (int vi = 0; vi < numVertexValues; vi += 3)
-                    {
-                        float x = meshVerts[vi];
-                        float y = meshVerts[vi + 1];
-                        float z = meshVerts[vi + 2];
-                        data.addVertex(carve::geom::VECTOR(x, y, z));
-                    }
-
-                    int numIndices = mesh->getTriangleCount() * 3;
-                    const int* meshTris = mesh->getTriangles();
-                    for (int ti = 0; ti < numIndices; ti += 3)
-                    {
-                        int tri1 = meshTris[ti];
-                        int tri2 = meshTris[ti + 1];
-                        int tri3 = meshTris[ti + 2];
-
-                        data.addFace(tri1, tri2, tri3);
-                    }
-
-                    models[i] = data.createMesh(carve::input::Options());
-                }
-            );
+            costs[i] = estimateCSGCost(jobs[i].meshA, jobs[i].meshB);
         }
-        catch (...)
+    }
+
+    // largest jobs first, so that a long job started last does not leave the other workers idle at the end
+    std::stable_sort(order.begin(), order.end(),
+        [&costs](int a, int b)
         {
-            delete models[0];
-            delete models[1];
-            setErrorMessage("Cannot construct polyhedron");
-            return nullptr;
+            return costs[a] > costs[b];
+        }
+    );
+
+    std::atomic<int> failedJobs(0);
+
+    // the jobs are handed out in order, each one running its own parallel loops on the same pool
+    carve::util::forEachParallel<int>(0, jobCount, 1,
+        [&](int k)
+        {
+            const CSGJob& job = jobs[order[k]];
+            CSGMesh* result = nullptr;
+
+            if (job.meshA == nullptr || job.meshB == nullptr)
+            {
+                setErrorMessage(job.errorMessage, job.errorMessageLength, "Invalid job");
+            }
+            else
+            {
+                try
+                {
+                    result = leoPerformCSG(job.meshA, job.meshB, job.op, job.errorMessage, job.errorMessageLength);
+                }
+                catch (carve::exception& ex)
+                {
+                    setErrorMessage(job.errorMessage, job.errorMessageLength, ex.str().c_str());
+                }
+                catch (std::exception& ex)
+                {
+                    setErrorMessage(job.errorMessage, job.errorMessageLength, ex.what());
+                }
+                catch (...)
+                {
+                    // nothing may escape a job, or the whole batch fails
+                    setErrorMessage(job.errorMessage, job.errorMessageLength, "Unknown error");
+                }
+            }
+
+            if (result == nullptr)
+            {
+                ++failedJobs;
+            }
+            results[order[k]] = result;
         }
+    );
 
-        csg.hooks.registerHook(new carve::csg::CarveTriangulatorWithImprovement(), carve::csg::CSG::Hooks::PROCESS_OUTPUT_FACE_BIT);
+    return failedJobs;
+}
 
-        FaceCollector* faceCollector = new FaceCollector(); // deleted in csg's destructor
-        csg.hooks.registerHook(faceCollector, carve::csg::CSG::Hooks::RESULT_FACE_BIT);
+EXPORT CSGMesh* STDCALL leoPerformCSGTree(const CSGTreeNode* nodes, int nodeCount, int rootIndex, char* errorMessage, int errorMessageLength)
+{
+    try
+    {
+        return evaluateCSGTree(nodes, nodeCount, rootIndex);
+    }
+    catch (carve::exception& ex)
+    {
+        setErrorMessage(errorMessage, errorMessageLength, ex.str().c_str());
+    }
+    catch (...)
+    {
+        setErrorMessage(errorMessage, errorMessageLength, "Cannot construct polyhedron");
+    }
+
+    return nullptr;
+}
+
+EXPORT CSGPreparedMesh* STDCALL leoPrepareCSGMesh(const CSGMesh* mesh, char* errorMessage, int errorMessageLength)
+{
+    CSGPreparedMesh* preparedMesh = new CSGPreparedMesh(*mesh);
+    if (mesh->getTriangleCount() == 0)
+    {
+        // nothing to build, empty operands are handled without a carve mesh
+        return preparedMesh;
+    }
 
-        carve::csg::CSG::meshset_t* meshA = models[0];
-        carve::csg::CSG::meshset_t* meshB = models[1];
+    try
+    {
+        PreparedMeshCache::instance().acquire(preparedMesh);
+        return preparedMesh;
+    }
+    catch (carve::exception& ex)
+    {
+        setErrorMessage(errorMessage, errorMessageLength, ex.str().c_str());
+    }
+    catch (...)
+    {
+        setErrorMessage(errorMessage, errorMessageLength, "Cannot construct polyhedron");
+    }
+
+    PreparedMeshCache::instance().remove(preparedMesh);
+    delete preparedMesh;
+    return nullptr;
+}
+
+EXPORT void STDCALL leoReleasePreparedMesh(const CSGPreparedMesh* preparedMesh)
+{
+    PreparedMeshCache::instance().remove(preparedMesh);
+    delete preparedMesh;
+}
+
+EXPORT void STDCALL leoSetPreparedMeshCacheBudget(long long budgetBytes)
+{
+    PreparedMeshCache::instance().setBudget(budgetBytes > 0 ? (size_t)budgetBytes : 0);
+}
 
-        carve::csg::CSG::Collector* csgCollector = nullptr;
-        switch (op)
+EXPORT long long STDCALL leoGetPreparedMeshCacheUsage()
+{
+    return (long long)PreparedMeshCache::instance().getUsage();
+}
+
+static CSGMesh* performCSGOnPrepared(const CSGPreparedMesh* meshA, const float* transformA, const CSGPreparedMesh* meshB, const float* transformB,
+    CSGOp op, char* errorMessage, int errorMessageLength, bool recordSources = false)
+{
+    try
+    {
+        std::unique_ptr<carve::math::Matrix> matrixA = makeTransform(transformA);
+        std::unique_ptr<carve::math::Matrix> matrixB = makeTransform(transformB);
+
+        if (meshA->getSource().getTriangleCount() == 0)
         {
-        case CSGOp::Union:
-            csgCollector = new UnionCollectorWithoutResultMeshset(meshA, meshB);
-            break;
-        case CSGOp::Intersection:
-            csgCollector = new IntersectionCollectorWithoutResultMeshset(meshA, meshB);
-            break;
-        case CSGOp::AMinusB:
-            csgCollector = new AMinusBCollectorWithoutResultMeshset(meshA, meshB);
-            break;
-        case CSGOp::BMinusA:
-            csgCollector = new BMinusACollectorWithoutResultMeshset(meshA, meshB);
-            break;
-        case CSGOp::SymmetricDifference:
-            csgCollector = new SymmetricDifferenceCollectorWithoutResultMeshset(meshA, meshB);
-            break;
-        default:
-            // unknown op
-            return nullptr;
+            return emptyOperandResult(makeMeshView(&meshB->getSource()), matrixB.get(), false, op, recordSources);
+        }
+        else if (meshB->getSource().getTriangleCount() == 0)
+        {
+            return emptyOperandResult(makeMeshView(&meshA->getSource()), matrixA.get(), true, op, recordSources);
         }
 
-        csg.compute(meshA, meshB, *csgCollector);
+        using Meshset = carve::mesh::MeshSet<3>;
 
-        auto makeDeleter = []<typename T>(T* ptr)
+        std::shared_ptr<const PreparedMeshData> dataA, dataB;
+        try
         {
-            auto deleter = [ptr]()
-            {
-                delete ptr;
-            };
+            dataA = PreparedMeshCache::instance().acquire(meshA);
+            dataB = PreparedMeshCache::instance().acquire(meshB);
+        }
+        catch (...)
+        {
+            setErrorMessage(errorMessage, errorMessageLength, "Cannot construct polyhedron");
+            return nullptr;
+        }
 
-            return deleter;
-        };
+        // moved operands are transformed copies, the cached data itself is never modified
+        if (matrixA)
+        {
+            dataA = transformPreparedMesh(*dataA, *matrixA);
+        }
+        if (matrixB)
+        {
+            dataB = transformPreparedMesh(*dataB, *matrixB);
+        }
 
-        std::array<std::function<void()>, 3> toDelete = { makeDeleter(models[0]), makeDeleter(models[1]), makeDeleter(csgCollector) };
+        // compute only reads its operands, so the shared prepared data stays unmodified
+        Meshset* modelA = const_cast<Meshset*>(dataA->meshSet.get());
+        Meshset* modelB = const_cast<Meshset*>(dataB->meshSet.get());
 
-        // delete in parallel
-        carve::util::forEachParallel<size_t>(0, toDelete.size(), 1,
-            [toDelete](size_t i)
-            {
-                toDelete[i]();
-            }
-        );
+        std::unique_ptr<Meshset> modelBCopy;
+        if (modelA == modelB)
+        {
+            // both operands must be distinct meshes, so the same prepared mesh on both sides needs a copy
+            modelBCopy.reset(modelA->clone());
+            return performCSG(modelA, dataA->faceTree.get(), modelBCopy.get(), nullptr, op, nullptr, recordSources);
+        }
 
-        CSGMesh* mesh = new CSGMesh();
-        mesh->stealVertices(faceCollector->getVertices());
-        mesh->stealTriangles(faceCollector->getTriangles());
-        return mesh;
+        return performCSG(modelA, dataA->faceTree.get(), modelB, dataB->faceTree.get(), op, nullptr, recordSources);
     }
     catch (carve::exception& ex)
     {
-        setErrorMessage(ex.str().c_str());
+        setErrorMessage(errorMessage, errorMessageLength, ex.str().c_str());
+        return nullptr;
+    }
+    catch (std::exception& ex)
+    {
+        setErrorMessage(errorMessage, errorMessageLength, ex.what());
         return nullptr;
     }
+    catch (...)
+    {
+        setErrorMessage(errorMessage, errorMessageLength, "Unknown error");
+        return nullptr;
+    }
+}
+
+EXPORT CSGMesh* STDCALL leoPerformCSGPrepared(const CSGPreparedMesh* meshA, const CSGPreparedMesh* meshB, CSGOp op, char* errorMessage, int errorMessageLength)
+{
+    return performCSGOnPrepared(meshA, nullptr, meshB, nullptr, op, errorMessage, errorMessageLength);
+}
+
+EXPORT CSGMesh* STDCALL leoPerformCSGPreparedTransformed(const CSGPreparedMesh* meshA, const float* transformA, const CSGPreparedMesh* meshB,
+    const float* transformB, CSGOp op, char* errorMessage, int errorMessageLength)
+{
+    return performCSGOnPrepared(meshA, transformA, meshB, transformB, op, errorMessage, errorMessageLength);
+}
+
+EXPORT CSGMesh* STDCALL leoPerformCSGPreparedWithSources(const CSGPreparedMesh* meshA, const CSGPreparedMesh* meshB, CSGOp op, char* errorMessage,
+    int errorMessageLength)
+{
+    return performCSGOnPrepared(meshA, nullptr, meshB, nullptr, op, errorMessage, errorMessageLength, true);
+}
+
+EXPORT CSGAsyncOperation* STDCALL leoPerformCSGAsync(const CSGMesh* meshA, const CSGMesh* meshB, CSGOp op, CSGProgressCallback progressCallback,
+    void* userData)
+{
+    return new CSGAsyncOperation(*meshA, *meshB, op, progressCallback, userData);
+}
+
+EXPORT CSGAsyncStatus STDCALL leoPollCSGAsync(const CSGAsyncOperation* operation)
+{
+    return operation->getStatus();
+}
+
+EXPORT CSGAsyncStatus STDCALL leoWaitCSGAsync(const CSGAsyncOperation* operation, int timeoutMilliseconds)
+{
+    return operation->wait(timeoutMilliseconds);
+}
+
+EXPORT float STDCALL leoGetCSGAsyncProgress(const CSGAsyncOperation* operation)
+{
+    return operation->getProgress();
+}
+
+EXPORT void STDCALL leoCancelCSGAsync(CSGAsyncOperation* operation)
+{
+    operation->cancel();
+}
+
+EXPORT CSGMesh* STDCALL leoTakeCSGAsyncResult(CSGAsyncOperation* operation, char* errorMessage, int errorMessageLength)
+{
+    return operation->takeResult(errorMessage, errorMessageLength);
+}
+
+EXPORT void STDCALL leoDestroyCSGAsync(CSGAsyncOperation* operation)
+{
+    delete operation;
+}
+
+EXPORT void STDCALL leoShutdownCSGAsync()
+{
+    CSGAsyncOperation::shutdown();
 }
@@ -14,6 +14,65 @@ enum class CSGOp : int
     SymmetricDifference
 };
 
+enum class CSGDataType : int
+{
+    Float32,
+    Float64,
+    Int16, // read as unsigned when used for triangle indices
+    Int32
+};
+
+// A triangle mesh in caller memory, read in place for the duration of a call. Vertex i is three consecutive components of
+// vertexType starting at vertices + i * vertexStride bytes, so positions may be interleaved with other attributes.
+// Triangles are laid out the same way with indexType, which must be Int16 or Int32. A stride of 0 means tightly packed.
+struct CSGMeshView
+{
+    const void* vertices;
+    int vertexCount;
+    int vertexStride;
+    CSGDataType vertexType;
+    const void* triangles;
+    int triangleCount;
+    int triangleStride;
+    CSGDataType indexType;
+};
+
+// Where a triangle of a result comes from: the operand (0 for A, 1 for B) and the index of the triangle of that operand
+// it is a part of. flipped is 1 if the triangle faces the other way than its source, like the faces of B in A minus B.
+struct CSGTriangleSource
+{
+    int operand;
+    int triangle;
+    int flipped;
+};
+
+// Statistics of one leoPerformCSGEx call. Times are wall clock seconds, except triangulationSeconds: faces are triangulated
+// one at a time by several threads, and it is the time of all of them added up, so it may exceed the wall time it spans.
+// Output faces are triangulated while they are collected into the result, so that wall time is part of outputSeconds.
+// peakTransientBytes is the largest growth of the resident memory of the process during the call, sampled at progress
+// points; it is 0 where it cannot be measured. It is process-wide, so operations running at the same time (in a batch,
+// asynchronously or on other threads) add to each other's value.
+struct CSGStats
+{
+    double meshConstructionSeconds;
+    double rtreeBuildSeconds;
+    double candidateSeconds;
+    double intersectionSeconds;
+    double faceLoopSeconds;
+    double groupingSeconds;
+    double classificationSeconds;
+    double triangulationSeconds;
+    double outputSeconds;
+    double totalSeconds;
+
+    long long facePairs;
+    long long intersectionVertices;
+    long long faceLoops;
+    long long groups;
+    long long classificationRays;
+    long long peakTransientBytes;
+};
+
 class CSGMesh
 {
 public:
@@ -23,19 +82,60 @@ public:
     void stealVertices(std::vector<float>& vertices);
     void stealTriangles(std::vector<int>& triangles);
     void setVertices(int vertexCount, const float* vertices);
+    void stealTriangleSources(std::vector<CSGTriangleSource>& sources);
     void setTriangles(int triangleCount, const int* triangles);
     int getVertexCount() const;
     int getTriangleCount() const;
     const float* getVertices() const;
     const int* getTriangles() const;
+    // One entry per triangle, or nullptr if the sources were not recorded.
+    const CSGTriangleSource* getTriangleSources() const;
 
     void log(std::ostream& stream) const;
 
 private:
     std::vector<float> m_vertices;
     std::vector<int> m_triangles;
+    std::vector<CSGTriangleSource> m_triangleSources;
 };
 
+// One boolean operation of a leoPerformCSGBatch call. The error message buffer is optional.
+struct CSGJob
+{
+    const CSGMesh* meshA;
+    const CSGMesh* meshB;
+    CSGOp op;
+    char* errorMessage;
+    int errorMessageLength;
+};
+
+// A node of the expression tree evaluated by leoPerformCSGTree. A leaf has a mesh, an internal node has no mesh and
+// combines its left and right children with op. Children are indices into the node array.
+struct CSGTreeNode
+{
+    const CSGMesh* mesh;
+    CSGOp op;
+    int left;
+    int right;
+};
+
+// An operand whose carve mesh and face R-tree are built once and reused by every leoPerformCSGPrepared call.
+class CSGPreparedMesh;
+
+enum class CSGAsyncStatus : int
+{
+    Running,
+    Succeeded,
+    Failed,
+    Cancelled
+};
+
+// A boolean operation started by leoPerformCSGAsync, running in the background.
+class CSGAsyncOperation;
+
+// A computed result of leoPerformCSGDeferred, kept as triangles until it is written into the buffers of the caller.
+class CSGDeferredResult;
+
 #if _WIN32
 #define EXPORT __declspec(dllexport)
 #define STDCALL __stdcall
@@ -44,6 +144,13 @@ private:
 #define STDCALL
 #endif
 
+// Called from the thread of an asynchronous operation with the fraction of the work that is done, from 0 to 1.
+typedef void (STDCALL* CSGProgressCallback)(float progress, void* userData);
+
+// Receives a result in chunks. A chunk brings the vertices (three floats each) that are used for the first time, and triangles
+// that index into all the vertices received so far. The buffers are only valid during the call. Returning 0 stops the operation.
+typedef int (STDCALL* CSGTriangleSink)(const float* vertices, int vertexCount, const int* triangles, int triangleCount, void* userData);
+
 extern "C"
 {
     EXPORT CSGMesh* STDCALL leoCreateCSGMesh();
@@ -56,7 +163,64 @@ extern "C"
     EXPORT void STDCALL leoCSGMeshGetTriangles(const CSGMesh* mesh, int* dstBuffer);
     EXPORT const float* STDCALL leoCSGMeshGetVertexPointer(const CSGMesh* mesh);
     EXPORT const int* STDCALL leoCSGMeshGetTrianglePointer(const CSGMesh* mesh);
+    // Only results of the WithSources functions have triangle sources. Returns 0 (or nullptr) for other meshes.
+    EXPORT int STDCALL leoCSGMeshGetTriangleSources(const CSGMesh* mesh, CSGTriangleSource* dstBuffer);
+    EXPORT const CSGTriangleSource* STDCALL leoCSGMeshGetTriangleSourcePointer(const CSGMesh* mesh);
     EXPORT CSGMesh* STDCALL leoPerformCSG(const CSGMesh* meshA, const CSGMesh* meshB, CSGOp op, char* errorMessage, int errorMessageLength = 0);
+    // Transforms are 16 floats in column-major order with the translation in elements 12 to 14, as in carve::math::Matrix.
+    // A null transform leaves the operand where it is.
+    EXPORT CSGMesh* STDCALL leoPerformCSGTransformed(const CSGMesh* meshA, const float* transformA, const CSGMesh* meshB, const float* transformB, CSGOp op,
+        char* errorMessage, int errorMessageLength = 0);
+    // Also records the source of every result triangle, see CSGTriangleSource.
+    EXPORT CSGMesh* STDCALL leoPerformCSGWithSources(const CSGMesh* meshA, const CSGMesh* meshB, CSGOp op, char* errorMessage, int errorMessageLength = 0);
+    // Also fills the statistics of the call, even if it fails.
+    EXPORT CSGMesh* STDCALL leoPerformCSGEx(const CSGMesh* meshA, const CSGMesh* meshB, CSGOp op, CSGStats* stats, char* errorMessage,
+        int errorMessageLength = 0);
+    EXPORT CSGMesh* STDCALL leoPerformCSGView(const CSGMeshView* meshA, const CSGMeshView* meshB, CSGOp op, char* errorMessage, int errorMessageLength = 0);
+    // Streams the result to the sink in chunks of about chunkTriangles triangles, instead of creating a mesh. Returns 0 on failure.
+    EXPORT int STDCALL leoPerformCSGToSink(const CSGMesh* meshA, const CSGMesh* meshB, CSGOp op, CSGTriangleSink sink, void* userData, int chunkTriangles,
+        char* errorMessage, int errorMessageLength = 0);
+    // Computes and measures the result, so that the caller can allocate buffers of the right size and have it written into them.
+    EXPORT CSGDeferredResult* STDCALL leoPerformCSGDeferred(const CSGMesh* meshA, const CSGMesh* meshB, CSGOp op, char* errorMessage,
+        int errorMessageLength = 0);
+    EXPORT int STDCALL leoDeferredResultGetVertexCount(const CSGDeferredResult* result);
+    EXPORT int STDCALL leoDeferredResultGetTriangleCount(const CSGDeferredResult* result);
+    // Writes vertex count * 3 floats and triangle count * 3 indices. Returns 0 on failure.
+    EXPORT int STDCALL leoDeferredResultWrite(CSGDeferredResult* result, float* vertices, int* triangles, char* errorMessage, int errorMessageLength = 0);
+    EXPORT void STDCALL leoDestroyDeferredResult(const CSGDeferredResult* result);
+    // The number of threads that run the parallel parts of operations, the calling thread included. 0 selects the default, which is
+    // the CPU quota of the cgroup of the process if it has one, else the number of CPUs. Must not be called while operations run.
+    EXPORT void STDCALL leoSetThreadCount(int threadCount);
+    EXPORT int STDCALL leoGetThreadCount();
+    EXPORT int STDCALL leoPerformCSGBatch(const CSGJob* jobs, int jobCount, CSGMesh** results);
+    EXPORT CSGMesh* STDCALL leoPerformCSGTree(const CSGTreeNode* nodes, int nodeCount, int rootIndex, char* errorMessage, int errorMessageLength = 0);
+
+    EXPORT CSGPreparedMesh* STDCALL leoPrepareCSGMesh(const CSGMesh* mesh, char* errorMessage, int errorMessageLength = 0);
+    EXPORT void STDCALL leoReleasePreparedMesh(const CSGPreparedMesh* preparedMesh);
+    EXPORT void STDCALL leoSetPreparedMeshCacheBudget(long long budgetBytes);
+    EXPORT long long STDCALL leoGetPreparedMeshCacheUsage();
+    EXPORT CSGMesh* STDCALL leoPerformCSGPrepared(const CSGPreparedMesh* meshA, const CSGPreparedMesh* meshB, CSGOp op, char* errorMessage, int errorMessageLength = 0);
+    EXPORT CSGMesh* STDCALL leoPerformCSGPreparedTransformed(const CSGPreparedMesh* meshA, const float* transformA, const CSGPreparedMesh* meshB,
+        const float* transformB, CSGOp op, char* errorMessage, int errorMessageLength = 0);
+    EXPORT CSGMesh* STDCALL leoPerformCSGPreparedWithSources(const CSGPreparedMesh* meshA, const CSGPreparedMesh* meshB, CSGOp op, char* errorMessage,
+        int errorMessageLength = 0);
+
+    // The operands are copied, so they may be destroyed as soon as this returns. The progress callback is optional.
+    EXPORT CSGAsyncOperation* STDCALL leoPerformCSGAsync(const CSGMesh* meshA, const CSGMesh* meshB, CSGOp op, CSGProgressCallback progressCallback,
+        void* userData);
+    EXPORT CSGAsyncStatus STDCALL leoPollCSGAsync(const CSGAsyncOperation* operation);
+    // A negative timeout waits until the operation ends. Returns the status at the time the wait ended.
+    EXPORT CSGAsyncStatus STDCALL leoWaitCSGAsync(const CSGAsyncOperation* operation, int timeoutMilliseconds);
+    EXPORT float STDCALL leoGetCSGAsyncProgress(const CSGAsyncOperation* operation);
+    // Returns immediately. The operation stops at its next check and frees its intermediate data.
+    EXPORT void STDCALL leoCancelCSGAsync(CSGAsyncOperation* operation);
+    // The caller owns the returned mesh. Returns nullptr with an error message unless the operation succeeded.
+    EXPORT CSGMesh* STDCALL leoTakeCSGAsyncResult(CSGAsyncOperation* operation, char* errorMessage, int errorMessageLength = 0);
+    // Cancels the operation if it is still running. Does not wait for it to stop.
+    EXPORT void STDCALL leoDestroyCSGAsync(CSGAsyncOperation* operation);
+    // Cancels every asynchronous operation that is still running and waits for their threads to end. Call it before the
+    // library is unloaded. Operations may be started again afterwards.
+    EXPORT void STDCALL leoShutdownCSGAsync();
 }
 
 #endif
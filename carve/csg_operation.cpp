@@ -0,0 +1,847 @@
+#include "csg_operation.h"
+#include "custom_collector.h"
+#include "mesh_builder.h"
+
+#include <include/csg_triangulator.hpp>
+#include <include/util.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+class FaceCollector : public carve::csg::CSG::Hook
+{
+public:
+    // The result is handed over whenever about chunkTriangles triangles are buffered.
+    FaceCollector(TriangleSink& sink, size_t chunkTriangles)
+        : carve::csg::CSG::Hook(), _sink(sink), _chunkTriangles(std::max<size_t>(chunkTriangles, 1))
+    {
+        _vertexCount = 0;
+    }
+
+    // Hands the buffered vertices and triangles over to the sink.
+    void flush()
+    {
+        if (_triangles.empty() && _uniqueVertices.empty())
+        {
+            return;
+        }
+
+        if (!_sink.consume(_uniqueVertices.data(), (int)(_uniqueVertices.size() / 3), _triangles.data(), (int)(_triangles.size() / 3)))
+        {
+            throw carve::exception("The triangle sink stopped the operation");
+        }
+
+        _uniqueVertices.clear();
+        _triangles.clear();
+    }
+
+protected:
+    virtual void resultFace(const carve::csg::CSG::meshset_t::face_t* newFace, const carve::csg::CSG::meshset_t::face_t* /* originalFace */,
+        bool /* flipped */) override
+    {
+        using Edge = carve::mesh::Edge<3>;
+
+        const Edge* startEdge = newFace->edge;
+        int startVertexIndex = tryAddVertex(startEdge->vert);
+
+        const Edge* currentEdge = startEdge->next;
+        int currentVertexIndex = tryAddVertex(currentEdge->vert);
+
+        while (currentEdge->next != startEdge)
+        {
+            const Edge* nextEdge = currentEdge->next;
+            int nextVertexIndex = tryAddVertex(nextEdge->vert);
+
+            _triangles.push_back(startVertexIndex);
+            _triangles.push_back(currentVertexIndex);
+            _triangles.push_back(nextVertexIndex);
+
+            currentEdge = nextEdge;
+            currentVertexIndex = nextVertexIndex;
+        }
+
+        if (_triangles.size() >= _chunkTriangles * 3)
+        {
+            flush();
+        }
+    }
+
+    virtual void resultNumFaces(size_t numFaces) override
+    {
+        _vertexIndexMap.reserve(numFaces); // guess
+
+        // the buffers only hold one chunk, which may be exceeded by the triangles of the last face
+        numFaces = std::min(numFaces, _chunkTriangles);
+        _triangles.reserve(numFaces * 3);
+        _uniqueVertices.reserve(numFaces * 3); // guess
+    }
+
+private:
+    int tryAddVertex(carve::mesh::Vertex<3>* vertex)
+    {
+        auto vertexIndexIt = _vertexIndexMap.insert({ vertex, _vertexCount });
+        if (vertexIndexIt.second)
+        {
+            ++_vertexCount;
+            _uniqueVertices.push_back((float)vertex->v.x);
+            _uniqueVertices.push_back((float)vertex->v.y);
+            _uniqueVertices.push_back((float)vertex->v.z);
+        }
+
+        return vertexIndexIt.first->second;
+    }
+
+private:
+    TriangleSink& _sink;
+    size_t _chunkTriangles;
+    int _vertexCount;
+    robin_hood::unordered_flat_map<carve::mesh::Vertex<3>*, int> _vertexIndexMap;
+    std::vector<float> _uniqueVertices;
+    std::vector<int> _triangles;
+};
+
+// Converts the faces of a computed result into a mesh in parallel. The triangles and the numbering of the vertices are the
+// same as those that a FaceCollector hands to its sink.
+static CSGMesh* createResultMesh(const std::vector<BaseCollectorWithoutResultMeshset::face_data_t>& faces, const carve::csg::CSG::meshset_t* sourceMeshA)
+{
+    using Vertex = carve::mesh::Vertex<3>;
+    using Edge = carve::mesh::Edge<3>;
+
+    // The faces are split into chunks. Each chunk lists the vertices in the order in which its faces use them first, then
+    // the chunks are merged in order, which numbers the vertices that a chunk uses before all the chunks in front of it.
+    // Those get consecutive indices, so that every chunk can write its triangles and its new vertices on its own.
+    struct Chunk
+    {
+        robin_hood::unordered_flat_map<Vertex*, int> localIndices;
+        std::vector<Vertex*> vertices;
+        std::vector<int> indices;
+        size_t firstTriangle = 0;
+        size_t triangleCount = 0;
+        int firstNewVertex = 0;
+    };
+
+    const size_t chunkFaces = 4096;
+    const size_t chunkCount = (faces.size() + chunkFaces - 1) / chunkFaces;
+    std::vector<Chunk> chunks(chunkCount);
+
+    carve::util::forEachParallel<size_t>(0, chunkCount, 1, [&faces, &chunks](size_t c)
+    {
+        Chunk& chunk = chunks[c];
+        for (size_t i = c * chunkFaces, end = std::min(faces.size(), i + chunkFaces); i < end; ++i)
+        {
+            const Edge* startEdge = faces[i].face->edge;
+            const Edge* edge = startEdge;
+            do
+            {
+                if (chunk.localIndices.insert({ edge->vert, (int)chunk.vertices.size() }).second)
+                {
+                    chunk.vertices.push_back(edge->vert);
+                }
+                edge = edge->next;
+            } while (edge != startEdge);
+            chunk.triangleCount += faces[i].face->nVertices() - 2;
+        }
+    });
+
+    robin_hood::unordered_flat_map<Vertex*, int> vertexIndices;
+    size_t triangleCount = 0;
+    int vertexCount = 0;
+    for (Chunk& chunk : chunks)
+    {
+        chunk.firstTriangle = triangleCount;
+        chunk.firstNewVertex = vertexCount;
+        triangleCount += chunk.triangleCount;
+
+        chunk.indices.resize(chunk.vertices.size());
+        for (size_t i = 0; i < chunk.vertices.size(); ++i)
+        {
+            auto it = vertexIndices.insert({ chunk.vertices[i], vertexCount });
+            if (it.second)
+            {
+                ++vertexCount;
+            }
+            chunk.indices[i] = it.first->second;
+        }
+    }
+
+    std::vector<float> vertices((size_t)vertexCount * 3);
+    std::vector<int> triangles(triangleCount * 3);
+    std::vector<CSGTriangleSource> sources(sourceMeshA != nullptr ? triangleCount : 0);
+
+    carve::util::forEachParallel<size_t>(0, chunkCount, 1, [&](size_t c)
+    {
+        const Chunk& chunk = chunks[c];
+        for (size_t i = 0; i < chunk.vertices.size(); ++i)
+        {
+            int index = chunk.indices[i];
+            if (index >= chunk.firstNewVertex)
+            {
+                vertices[index * 3] = (float)chunk.vertices[i]->v.x;
+                vertices[index * 3 + 1] = (float)chunk.vertices[i]->v.y;
+                vertices[index * 3 + 2] = (float)chunk.vertices[i]->v.z;
+            }
+        }
+
+        int* triangle = triangles.data() + chunk.firstTriangle * 3;
+        CSGTriangleSource* source = sources.data() + (sourceMeshA != nullptr ? chunk.firstTriangle : 0);
+        for (size_t i = c * chunkFaces, end = std::min(faces.size(), i + chunkFaces); i < end; ++i)
+        {
+            const carve::csg::CSG::meshset_t::face_t* originalFace = faces[i].orig_face;
+            const Edge* startEdge = faces[i].face->edge;
+            int startVertexIndex = chunk.indices[chunk.localIndices.find(startEdge->vert)->second];
+
+            const Edge* currentEdge = startEdge->next;
+            int currentVertexIndex = chunk.indices[chunk.localIndices.find(currentEdge->vert)->second];
+
+            while (currentEdge->next != startEdge)
+            {
+                const Edge* nextEdge = currentEdge->next;
+                int nextVertexIndex = chunk.indices[chunk.localIndices.find(nextEdge->vert)->second];
+
+                *triangle++ = startVertexIndex;
+                *triangle++ = currentVertexIndex;
+                *triangle++ = nextVertexIndex;
+
+                if (sourceMeshA != nullptr)
+                {
+                    // the ids of the operand faces are the indices of the input triangles they were built from
+                    *source++ = { originalFace->mesh->meshset == sourceMeshA ? 0 : 1, (int)originalFace->id, faces[i].flipped ? 1 : 0 };
+                }
+
+                currentEdge = nextEdge;
+                currentVertexIndex = nextVertexIndex;
+            }
+        }
+    });
+
+    CSGMesh* mesh = new CSGMesh();
+    mesh->stealVertices(vertices);
+    mesh->stealTriangles(triangles);
+    mesh->stealTriangleSources(sources);
+    return mesh;
+}
+
+class ProgressHook : public carve::csg::CSG::Hook
+{
+public:
+    ProgressHook(OperationProgress* progress) : carve::csg::CSG::Hook(), _progress(progress)
+    {
+    }
+
+protected:
+    virtual bool progress(double fraction) override
+    {
+        return _progress->update(fraction);
+    }
+
+private:
+    OperationProgress* _progress;
+};
+
+// Samples the memory use of the operation when it reports progress. Reading the resident memory is a system call, and progress is
+// reported under a lock from every parallel batch, so a sample is only taken once the fraction has moved by 1% or some time has passed.
+class MemorySamplingHook : public carve::csg::CSG::Hook
+{
+public:
+    MemorySamplingHook(OperationStats* stats)
+        : carve::csg::CSG::Hook(), _stats(stats), _sampledFraction(0.0), _sampledTime(OperationStats::Clock::now())
+    {
+    }
+
+protected:
+    virtual bool progress(double fraction) override
+    {
+        // the hooks are called one at a time, so the last sample needs no lock of its own
+        OperationStats::Clock::time_point now = OperationStats::Clock::now();
+        if (fraction - _sampledFraction >= 0.01 || now - _sampledTime >= std::chrono::milliseconds(20))
+        {
+            _stats->sampleMemory();
+            _sampledFraction = fraction;
+            _sampledTime = now;
+        }
+        return true;
+    }
+
+private:
+    OperationStats* _stats;
+    double _sampledFraction;
+    OperationStats::Clock::time_point _sampledTime;
+};
+
+// Keeps a hook registered for the lifetime of the scope. The hook stays owned by the caller, instead of being deleted by the CSG object.
+class ScopedHook
+{
+public:
+    ScopedHook(carve::csg::CSG::Hooks& hooks, carve::csg::CSG::Hook* hook, unsigned hookBits) : _hooks(hooks), _hook(hook)
+    {
+        _hooks.registerHook(_hook, hookBits);
+    }
+
+    ~ScopedHook()
+    {
+        _hooks.unregisterHook(_hook);
+    }
+
+private:
+    carve::csg::CSG::Hooks& _hooks;
+    carve::csg::CSG::Hook* _hook;
+};
+
+static CSGMesh* copyOperand(const CSGMeshView& mesh, const carve::math::Matrix* transform, bool isA, bool recordSources)
+{
+    CSGMesh* result = createCSGMesh(mesh, transform);
+    if (recordSources)
+    {
+        std::vector<CSGTriangleSource> sources((size_t)result->getTriangleCount());
+        for (size_t i = 0; i < sources.size(); ++i)
+        {
+            sources[i] = { isA ? 0 : 1, (int)i, 0 };
+        }
+        result->stealTriangleSources(sources);
+    }
+    return result;
+}
+
+CSGMesh* emptyOperandResult(const CSGMeshView& mesh, const carve::math::Matrix* transform, bool isA, CSGOp op, bool recordSources)
+{
+    switch (op)
+    {
+    case CSGOp::Union:
+    case CSGOp::SymmetricDifference:
+        // just return the non-empty mesh
+        return copyOperand(mesh, transform, isA, recordSources);
+    case CSGOp::Intersection:
+    default:
+        // no overlap, return an empty mesh
+        break;
+    case CSGOp::AMinusB:
+        // return the non-empty mesh if we are subtracting an empty mesh from it
+        if (isA)
+        {
+            return copyOperand(mesh, transform, isA, recordSources);
+        }
+        break;
+    case CSGOp::BMinusA:
+        if (!isA)
+        {
+            return copyOperand(mesh, transform, isA, recordSources);
+        }
+        break;
+    }
+
+    return new CSGMesh();
+}
+
+// Appends the second operand to the first one.
+static CSGMesh* concatenateOperands(const CSGMeshView& meshA, const carve::math::Matrix* transformA, const CSGMeshView& meshB,
+    const carve::math::Matrix* transformB, bool recordSources)
+{
+    std::vector<float> vertices;
+    std::vector<int> triangles;
+    vertices.reserve((size_t)(meshA.vertexCount + meshB.vertexCount) * 3);
+    triangles.reserve((size_t)(meshA.triangleCount + meshB.triangleCount) * 3);
+    appendMeshView(meshA, transformA, vertices, triangles);
+    appendMeshView(meshB, transformB, vertices, triangles);
+
+    CSGMesh* result = new CSGMesh();
+    result->stealVertices(vertices);
+    result->stealTriangles(triangles);
+    if (recordSources)
+    {
+        std::vector<CSGTriangleSource> sources((size_t)(meshA.triangleCount + meshB.triangleCount));
+        for (int i = 0; i < meshA.triangleCount; ++i)
+        {
+            sources[(size_t)i] = { 0, i, 0 };
+        }
+        for (int i = 0; i < meshB.triangleCount; ++i)
+        {
+            sources[(size_t)(meshA.triangleCount + i)] = { 1, i, 0 };
+        }
+        result->stealTriangleSources(sources);
+    }
+    return result;
+}
+
+CSGMesh* disjointOperandsResult(const CSGMeshView& meshA, const carve::math::Matrix* transformA, const CSGMeshView& meshB,
+    const carve::math::Matrix* transformB, CSGOp op, bool recordSources)
+{
+    if (meshA.vertexCount <= 0 || meshB.vertexCount <= 0 ||
+        getMeshViewBounds(meshA, transformA).maxAxisSeparation(getMeshViewBounds(meshB, transformB)) <= carve::EPSILON)
+    {
+        return nullptr;
+    }
+
+    // the operands are copied as they are, so reject the indices that building the carve meshes would have rejected
+    checkMeshViewIndices(meshA);
+    checkMeshViewIndices(meshB);
+
+    switch (op)
+    {
+    case CSGOp::Union:
+    case CSGOp::SymmetricDifference:
+        return concatenateOperands(meshA, transformA, meshB, transformB, recordSources);
+    case CSGOp::Intersection:
+        return new CSGMesh();
+    case CSGOp::AMinusB:
+        return copyOperand(meshA, transformA, true, recordSources);
+    case CSGOp::BMinusA:
+        return copyOperand(meshB, transformB, false, recordSources);
+    default:
+        return nullptr;
+    }
+}
+
+using face_rtree_t = carve::csg::CSG::face_rtree_t;
+
+// Whether any faces of the two trees come within EPSILON of each other, descending into the trees in turn.
+static bool facesMayMeet(const face_rtree_t* a, const face_rtree_t* b, bool descendA = true)
+{
+    if (a->bbox.maxAxisSeparation(b->bbox) > carve::EPSILON)
+    {
+        return false;
+    }
+
+    if (a->child && (descendA || !b->child))
+    {
+        for (const face_rtree_t* node = a->child; node; node = node->sibling)
+        {
+            if (facesMayMeet(node, b, false))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+    else if (b->child)
+    {
+        for (const face_rtree_t* node = b->child; node; node = node->sibling)
+        {
+            if (facesMayMeet(a, node, true))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    for (const carve::mesh::Face<3>* faceA : a->data)
+    {
+        carve::geom::aabb<3> boundsA = faceA->getAABB();
+        for (const carve::mesh::Face<3>* faceB : b->data)
+        {
+            if (faceB->getAABB().maxAxisSeparation(boundsA) <= carve::EPSILON)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Classifies every mesh of meshSet against other by one of its vertices, as a mesh that does not meet the surface of other is
+// either completely inside or completely outside of it. Returns false if a mesh is open, or a vertex is not clearly in or out.
+static bool classifyMeshes(const carve::csg::CSG::meshset_t* meshSet, const carve::csg::CSG::meshset_t* other, const face_rtree_t* otherTree,
+    size_t* rayCounter, std::vector<char>& inside)
+{
+    inside.resize(meshSet->meshes.size());
+    for (size_t i = 0; i < meshSet->meshes.size(); ++i)
+    {
+        const carve::mesh::Mesh<3>* mesh = meshSet->meshes[i];
+        if (!mesh->isClosed() || mesh->faces.empty())
+        {
+            return false;
+        }
+
+        carve::PointClass pc = carve::mesh::classifyPoint(other, otherTree, mesh->faces[0]->edge->vert->v, false, NULL, NULL, rayCounter);
+        if (pc != carve::PointClass::POINT_IN && pc != carve::PointClass::POINT_OUT)
+        {
+            return false;
+        }
+        inside[i] = pc == carve::PointClass::POINT_IN;
+    }
+    return true;
+}
+
+// Whether a mesh of an operand that is completely inside or outside of the other operand is a part of the result of op.
+static bool keepMesh(CSGOp op, bool isA, bool inside, bool& flipped)
+{
+    flipped = false;
+    switch (op)
+    {
+    case CSGOp::Union:
+        return !inside;
+    case CSGOp::Intersection:
+        return inside;
+    case CSGOp::AMinusB:
+        // the parts of B inside A become the walls of cavities
+        flipped = !isA;
+        return isA != inside;
+    case CSGOp::BMinusA:
+        flipped = isA;
+        return isA == inside;
+    case CSGOp::SymmetricDifference:
+        flipped = inside;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Appends the faces of the kept meshes of an operand, triangulated as fans like the faces of computed results.
+static void appendKeptMeshes(const carve::csg::CSG::meshset_t* meshSet, const std::vector<char>& inside, CSGOp op, bool isA, bool recordSources,
+    std::vector<float>& vertices, std::vector<int>& triangles, std::vector<CSGTriangleSource>& sources)
+{
+    using Meshset = carve::csg::CSG::meshset_t;
+
+    std::vector<int> vertexIndices(meshSet->vertex_storage.size(), -1);
+    std::vector<int> loop;
+    for (size_t i = 0; i < meshSet->meshes.size(); ++i)
+    {
+        bool flipped;
+        if (!keepMesh(op, isA, inside[i] != 0, flipped))
+        {
+            continue;
+        }
+
+        for (const Meshset::face_t* face : meshSet->meshes[i]->faces)
+        {
+            loop.clear();
+            const Meshset::edge_t* edge = face->edge;
+            do
+            {
+                int& index = vertexIndices[edge->vert - meshSet->vertex_storage.data()];
+                if (index < 0)
+                {
+                    index = (int)(vertices.size() / 3);
+                    vertices.push_back((float)edge->vert->v.x);
+                    vertices.push_back((float)edge->vert->v.y);
+                    vertices.push_back((float)edge->vert->v.z);
+                }
+                loop.push_back(index);
+                edge = edge->next;
+            } while (edge != face->edge);
+
+            if (flipped)
+            {
+                std::reverse(loop.begin(), loop.end());
+            }
+
+            for (size_t j = 1; j + 1 < loop.size(); ++j)
+            {
+                triangles.push_back(loop[0]);
+                triangles.push_back(loop[j]);
+                triangles.push_back(loop[j + 1]);
+                if (recordSources)
+                {
+                    sources.push_back({ isA ? 0 : 1, (int)face->id, flipped ? 1 : 0 });
+                }
+            }
+        }
+    }
+}
+
+CSGMesh* separatedOperandsResult(carve::csg::CSG::meshset_t* meshA, const face_rtree_t* rtreeA, carve::csg::CSG::meshset_t* meshB,
+    const face_rtree_t* rtreeB, CSGOp op, bool recordSources, OperationStats* stats)
+{
+    if ((int)op < (int)CSGOp::Union || (int)op > (int)CSGOp::SymmetricDifference)
+    {
+        return nullptr;
+    }
+
+    OperationStats::Clock::time_point start = OperationStats::Clock::now();
+    size_t* rayCounter = stats != nullptr ? &stats->getCSGStats().classification_rays : nullptr;
+    std::vector<char> insideA, insideB;
+    bool separated = !facesMayMeet(rtreeA, rtreeB) && classifyMeshes(meshA, meshB, rtreeB, rayCounter, insideA) &&
+        classifyMeshes(meshB, meshA, rtreeA, rayCounter, insideB);
+    if (stats != nullptr)
+    {
+        stats->addCSGPhase(carve::csg::Stats::CANDIDATES, start);
+    }
+    if (!separated)
+    {
+        return nullptr;
+    }
+
+    start = OperationStats::Clock::now();
+    std::vector<float> vertices;
+    std::vector<int> triangles;
+    std::vector<CSGTriangleSource> sources;
+    appendKeptMeshes(meshA, insideA, op, true, recordSources, vertices, triangles, sources);
+    appendKeptMeshes(meshB, insideB, op, false, recordSources, vertices, triangles, sources);
+
+    CSGMesh* mesh = new CSGMesh();
+    mesh->stealVertices(vertices);
+    mesh->stealTriangles(triangles);
+    mesh->stealTriangleSources(sources);
+    if (stats != nullptr)
+    {
+        stats->addOutput(start);
+    }
+    return mesh;
+}
+
+void setErrorMessage(char* errorMessage, int errorMessageLength, const char* errorMsg)
+{
+    if (errorMessage != nullptr)
+    {
+#if _WIN32
+        strncpy_s(errorMessage, strlen(errorMsg) + 1, errorMsg, errorMessageLength);
+#else
+        strncpy(errorMessage, errorMsg, errorMessageLength);
+#endif
+    }
+}
+
+carve::csg::CSG::Collector* createCollector(CSGOp op, carve::csg::CSG::meshset_t* meshA, carve::csg::CSG::meshset_t* meshB)
+{
+    switch (op)
+    {
+    case CSGOp::Union:
+        return new UnionCollectorWithoutResultMeshset(meshA, meshB);
+    case CSGOp::Intersection:
+        return new IntersectionCollectorWithoutResultMeshset(meshA, meshB);
+    case CSGOp::AMinusB:
+        return new AMinusBCollectorWithoutResultMeshset(meshA, meshB);
+    case CSGOp::BMinusA:
+        return new BMinusACollectorWithoutResultMeshset(meshA, meshB);
+    case CSGOp::SymmetricDifference:
+        return new SymmetricDifferenceCollectorWithoutResultMeshset(meshA, meshB);
+    default:
+        // unknown op
+        return nullptr;
+    }
+}
+
+CSGResultFaces::CSGResultFaces(carve::csg::CSG::Collector* collector, const carve::csg::CSG::meshset_t* meshA) : m_collector(collector), m_meshA(meshA)
+{
+    m_csg.hooks.registerHook(new carve::csg::CarveTriangulatorWithImprovement(), carve::csg::CSG::Hooks::PROCESS_OUTPUT_FACE_BIT);
+}
+
+CSGResultFaces::~CSGResultFaces()
+{
+}
+
+std::unique_ptr<CSGResultFaces> CSGResultFaces::compute(carve::csg::CSG::meshset_t* meshA, const carve::csg::CSG::face_rtree_t* rtreeA,
+    carve::csg::CSG::meshset_t* meshB, const carve::csg::CSG::face_rtree_t* rtreeB, CSGOp op, OperationProgress* progress, OperationStats* stats)
+{
+    carve::csg::CSG::Collector* csgCollector = createCollector(op, meshA, meshB);
+    if (csgCollector == nullptr)
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<CSGResultFaces> result(new CSGResultFaces(csgCollector, meshA));
+
+    std::unique_ptr<ProgressHook> progressHook;
+    std::unique_ptr<ScopedHook> progressRegistration;
+    if (progress != nullptr)
+    {
+        progressHook.reset(new ProgressHook(progress));
+        progressRegistration.reset(new ScopedHook(result->m_csg.hooks, progressHook.get(), carve::csg::CSG::Hooks::PROGRESS_BIT));
+    }
+
+    std::unique_ptr<MemorySamplingHook> memoryHook;
+    std::unique_ptr<ScopedHook> memoryRegistration;
+    if (stats != nullptr)
+    {
+        result->m_csg.hooks.stats = &stats->getCSGStats();
+        memoryHook.reset(new MemorySamplingHook(stats));
+        memoryRegistration.reset(new ScopedHook(result->m_csg.hooks, memoryHook.get(), carve::csg::CSG::Hooks::PROGRESS_BIT));
+    }
+
+    // no result face hook is registered, so the faces stay in the collector until they are converted
+    result->m_csg.compute(meshA, rtreeA, meshB, rtreeB, *result->m_collector);
+    result->m_csg.hooks.stats = nullptr;
+    return result;
+}
+
+CSGMesh* CSGResultFaces::createMesh(bool recordSources)
+{
+    // the collectors of createCollector have all turned their loops into faces when the computation called done()
+    const BaseCollectorWithoutResultMeshset* collector = static_cast<const BaseCollectorWithoutResultMeshset*>(m_collector.get());
+    return createResultMesh(collector->getFaces(), recordSources ? m_meshA : nullptr);
+}
+
+bool writeCSG(carve::csg::CSG::meshset_t* meshA, carve::csg::CSG::meshset_t* meshB, CSGOp op, TriangleSink& sink, size_t chunkTriangles)
+{
+    std::unique_ptr<carve::csg::CSG::Collector> collector(createCollector(op, meshA, meshB));
+    if (!collector)
+    {
+        return false;
+    }
+
+    carve::csg::CSG csg;
+    csg.hooks.registerHook(new carve::csg::CarveTriangulatorWithImprovement(), carve::csg::CSG::Hooks::PROCESS_OUTPUT_FACE_BIT);
+
+    // with a result face hook registered, the collector hands its faces over while the operation collects them
+    FaceCollector faceCollector(sink, chunkTriangles);
+    ScopedHook registration(csg.hooks, &faceCollector, carve::csg::CSG::Hooks::RESULT_FACE_BIT);
+    csg.compute(meshA, nullptr, meshB, nullptr, *collector);
+    faceCollector.flush();
+    return true;
+}
+
+CSGMesh* performCSG(carve::csg::CSG::meshset_t* meshA, const carve::csg::CSG::face_rtree_t* rtreeA, carve::csg::CSG::meshset_t* meshB,
+    const carve::csg::CSG::face_rtree_t* rtreeB, CSGOp op, OperationProgress* progress, bool recordSources, OperationStats* stats)
+{
+    // the trees are built here rather than by carve, so that they first decide whether the operands meet at all
+    OperationStats::Clock::time_point start = OperationStats::Clock::now();
+    std::unique_ptr<carve::csg::CSG::face_rtree_t> ownedTrees[2];
+    if (rtreeA == nullptr)
+    {
+        ownedTrees[0].reset(carve::csg::CSG::face_rtree_t::construct_STR(meshA->faceBegin(), meshA->faceEnd(), 4, 4));
+        rtreeA = ownedTrees[0].get();
+    }
+    if (rtreeB == nullptr)
+    {
+        ownedTrees[1].reset(carve::csg::CSG::face_rtree_t::construct_STR(meshB->faceBegin(), meshB->faceEnd(), 4, 4));
+        rtreeB = ownedTrees[1].get();
+    }
+    if (stats != nullptr)
+    {
+        stats->addCSGPhase(carve::csg::Stats::RTREE_BUILD, start);
+    }
+
+    CSGMesh* separatedResult = separatedOperandsResult(meshA, rtreeA, meshB, rtreeB, op, recordSources, stats);
+    if (separatedResult != nullptr)
+    {
+        return separatedResult;
+    }
+
+    std::unique_ptr<CSGResultFaces> resultFaces = CSGResultFaces::compute(meshA, rtreeA, meshB, rtreeB, op, progress, stats);
+    if (!resultFaces)
+    {
+        return nullptr;
+    }
+
+    if (stats == nullptr)
+    {
+        return resultFaces->createMesh(recordSources);
+    }
+
+    start = OperationStats::Clock::now();
+    CSGMesh* mesh = resultFaces->createMesh(recordSources);
+    stats->addOutput(start);
+    stats->sampleMemory();
+    return mesh;
+}
+
+void writeMesh(const CSGMesh& mesh, TriangleSink& sink, size_t chunkTriangles)
+{
+    chunkTriangles = std::max<size_t>(chunkTriangles, 1);
+
+    // every vertex goes with the first chunk, the triangles are split
+    const float* vertices = mesh.getVertices();
+    int vertexCount = mesh.getVertexCount();
+    int triangleCount = mesh.getTriangleCount();
+    int start = 0;
+    while (start < triangleCount)
+    {
+        int count = (int)std::min<size_t>(chunkTriangles, triangleCount - start);
+        if (!sink.consume(vertices, vertexCount, mesh.getTriangles() + start * 3, count))
+        {
+            throw carve::exception("The triangle sink stopped the operation");
+        }
+
+        vertices = nullptr;
+        vertexCount = 0;
+        start += count;
+    }
+}
+
+std::unique_ptr<carve::math::Matrix> makeTransform(const float* transform)
+{
+    if (transform == nullptr)
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<carve::math::Matrix> matrix(new carve::math::Matrix());
+    for (int i = 0; i < 16; ++i)
+    {
+        matrix->v[i] = transform[i];
+    }
+    return matrix;
+}
+
+bool createOperandMeshSets(const CSGMeshView& meshA, const carve::math::Matrix* transformA, const CSGMeshView& meshB,
+    const carve::math::Matrix* transformB, std::unique_ptr<carve::mesh::MeshSet<3>> (&models)[2])
+{
+    const CSGMeshView* inputMeshes[2] = { &meshA, &meshB };
+    const carve::math::Matrix* transforms[2] = { transformA, transformB };
+    bool failed[2] = { false, false };
+
+    // create meshes in parallel, exceptions must not escape the parallel loop
+    carve::util::forEachParallel<size_t>(0, 2, 1,
+        [&inputMeshes, &transforms, &models, &failed](size_t i)
+        {
+            try
+            {
+                models[i].reset(createMeshSet(*inputMeshes[i], transforms[i]));
+            }
+            catch (...)
+            {
+                failed[i] = true;
+            }
+        }
+    );
+
+    if (failed[0] || failed[1])
+    {
+        models[0].reset();
+        models[1].reset();
+        return false;
+    }
+
+    return true;
+}
+
+CSGMesh* performCSGOnViews(const CSGMeshView& meshA, const float* transformA, const CSGMeshView& meshB, const float* transformB, CSGOp op,
+    char* errorMessage, int errorMessageLength, OperationProgress* progress, bool recordSources, OperationStats* stats)
+{
+    try
+    {
+        std::unique_ptr<carve::math::Matrix> matrices[2] = { makeTransform(transformA), makeTransform(transformB) };
+
+        if (meshA.triangleCount == 0)
+        {
+            return emptyOperandResult(meshB, matrices[1].get(), false, op, recordSources);
+        }
+        else if (meshB.triangleCount == 0)
+        {
+            return emptyOperandResult(meshA, matrices[0].get(), true, op, recordSources);
+        }
+
+        CSGMesh* disjointResult = disjointOperandsResult(meshA, matrices[0].get(), meshB, matrices[1].get(), op, recordSources);
+        if (disjointResult != nullptr)
+        {
+            return disjointResult;
+        }
+
+        OperationStats::Clock::time_point constructionStart = OperationStats::Clock::now();
+        std::unique_ptr<carve::mesh::MeshSet<3>> models[2];
+        if (!createOperandMeshSets(meshA, matrices[0].get(), meshB, matrices[1].get(), models))
+        {
+            setErrorMessage(errorMessage, errorMessageLength, "Cannot construct polyhedron");
+            return nullptr;
+        }
+        if (stats != nullptr)
+        {
+            stats->addMeshConstruction(constructionStart);
+            stats->sampleMemory();
+        }
+
+        if (progress != nullptr && !progress->update(0.0))
+        {
+            throw carve::csg::operation_cancelled();
+        }
+
+        return performCSG(models[0].get(), nullptr, models[1].get(), nullptr, op, progress, recordSources, stats);
+    }
+    catch (carve::exception& ex)
+    {
+        setErrorMessage(errorMessage, errorMessageLength, ex.str().c_str());
+        return nullptr;
+    }
+}
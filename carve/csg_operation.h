@@ -0,0 +1,111 @@
+#ifndef CARVE_DLL_CSG_OPERATION_H
+#define CARVE_DLL_CSG_OPERATION_H
+
+#include "carve.h"
+#include "operation_stats.h"
+
+#include <include/csg.hpp>
+#include <include/matrix.hpp>
+
+#include <memory>
+
+// Receives the progress of a running operation and decides whether it goes on.
+class OperationProgress
+{
+public:
+    virtual ~OperationProgress()
+    {
+    }
+
+    // Called from the thread running the operation with the fraction that is done, from 0 to 1. Returning false cancels the operation,
+    // which then fails with a carve::csg::operation_cancelled exception.
+    virtual bool update(double fraction) = 0;
+};
+
+// Receives the result of an operation in chunks. A chunk brings the vertices that are used for the first time, and triangles
+// that index into all the vertices of the chunks so far.
+class TriangleSink
+{
+public:
+    virtual ~TriangleSink()
+    {
+    }
+
+    // Returning false stops the operation, which then fails.
+    virtual bool consume(const float* vertices, int vertexCount, const int* triangles, int triangleCount) = 0;
+};
+
+// Chunk size for results that are written in chunks for the library's own use.
+const size_t DEFAULT_CHUNK_TRIANGLES = 65536;
+
+// A computed boolean operation that still holds the faces of its result, so that they can be converted into a mesh in parallel.
+// The result faces point into the operand meshes, which must outlive it.
+class CSGResultFaces
+{
+public:
+    ~CSGResultFaces();
+
+    // Returns nullptr for an unknown op, and throws carve::exception if the operation fails. The statistics only cover the computation.
+    static std::unique_ptr<CSGResultFaces> compute(carve::csg::CSG::meshset_t* meshA, const carve::csg::CSG::face_rtree_t* rtreeA,
+        carve::csg::CSG::meshset_t* meshB, const carve::csg::CSG::face_rtree_t* rtreeB, CSGOp op, OperationProgress* progress = nullptr,
+        OperationStats* stats = nullptr);
+
+    // With recordSources, the mesh also gets the source of every triangle.
+    CSGMesh* createMesh(bool recordSources = false);
+
+private:
+    CSGResultFaces(carve::csg::CSG::Collector* collector, const carve::csg::CSG::meshset_t* meshA);
+
+    std::unique_ptr<carve::csg::CSG::Collector> m_collector;
+    const carve::csg::CSG::meshset_t* m_meshA;
+    carve::csg::CSG m_csg;
+};
+
+void setErrorMessage(char* errorMessage, int errorMessageLength, const char* errorMsg);
+
+// Hands a finished mesh to the sink, with all the vertices in the first chunk. Throws carve::exception if the sink stops.
+void writeMesh(const CSGMesh& mesh, TriangleSink& sink, size_t chunkTriangles);
+
+// Reads a transform of 16 floats in the column-major layout of carve::math::Matrix::v. Returns nullptr for a null transform.
+std::unique_ptr<carve::math::Matrix> makeTransform(const float* transform);
+
+// The result of an operation where one of the operands has no triangles. The transform of the other operand may be null.
+CSGMesh* emptyOperandResult(const CSGMeshView& mesh, const carve::math::Matrix* transform, bool isA, CSGOp op, bool recordSources = false);
+
+// The result of an operation whose operands have bounding boxes that are apart, computed without constructing them.
+// Returns nullptr if the bounding boxes meet or op is unknown.
+CSGMesh* disjointOperandsResult(const CSGMeshView& meshA, const carve::math::Matrix* transformA, const CSGMeshView& meshB,
+    const carve::math::Matrix* transformB, CSGOp op, bool recordSources = false);
+
+// The result of an operation whose operands have no faces that come close to each other, so that every mesh of an operand
+// is either inside or outside of the other operand and is decided by classifying one of its vertices. Returns nullptr if
+// faces may meet, a mesh is open or op is unknown.
+CSGMesh* separatedOperandsResult(carve::csg::CSG::meshset_t* meshA, const carve::csg::CSG::face_rtree_t* rtreeA, carve::csg::CSG::meshset_t* meshB,
+    const carve::csg::CSG::face_rtree_t* rtreeB, CSGOp op, bool recordSources = false, OperationStats* stats = nullptr);
+
+// Creates the collector that selects the faces of the result of op. Returns nullptr for an unknown op.
+carve::csg::CSG::Collector* createCollector(CSGOp op, carve::csg::CSG::meshset_t* meshA, carve::csg::CSG::meshset_t* meshB);
+
+// Runs the boolean operation on two constructed meshes, or takes the shortcut of separatedOperandsResult if it applies. The face
+// R-trees are optional, they are built if not given.
+// Returns nullptr for an unknown op, and throws carve::exception if the operation fails.
+CSGMesh* performCSG(carve::csg::CSG::meshset_t* meshA, const carve::csg::CSG::face_rtree_t* rtreeA, carve::csg::CSG::meshset_t* meshB,
+    const carve::csg::CSG::face_rtree_t* rtreeB, CSGOp op, OperationProgress* progress = nullptr, bool recordSources = false,
+    OperationStats* stats = nullptr);
+
+// Runs the boolean operation on two constructed meshes and hands the result to the sink in chunks of about chunkTriangles
+// triangles while it is collected. Only one batch of result faces is alive at a time, they are freed once written.
+// Returns false for an unknown op, and throws carve::exception if the operation fails or the sink stops.
+bool writeCSG(carve::csg::CSG::meshset_t* meshA, carve::csg::CSG::meshset_t* meshB, CSGOp op, TriangleSink& sink, size_t chunkTriangles);
+
+// Builds both operands from the views in parallel, applying the transforms (if not null). Returns false if either one cannot be built.
+bool createOperandMeshSets(const CSGMeshView& meshA, const carve::math::Matrix* transformA, const CSGMeshView& meshB,
+    const carve::math::Matrix* transformB, std::unique_ptr<carve::mesh::MeshSet<3>> (&models)[2]);
+
+// Builds both operands from the views, applying the transforms (if not null), and runs the boolean operation on them. Operands
+// with bounding boxes that are apart are not built, see disjointOperandsResult.
+// Returns nullptr and fills the error message if the operation fails or is cancelled through progress.
+CSGMesh* performCSGOnViews(const CSGMeshView& meshA, const float* transformA, const CSGMeshView& meshB, const float* transformB, CSGOp op,
+    char* errorMessage, int errorMessageLength, OperationProgress* progress = nullptr, bool recordSources = false, OperationStats* stats = nullptr);
+
+#endif
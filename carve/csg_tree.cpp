@@ -0,0 +1,373 @@
+#include "csg_tree.h"
+#include "csg_operation.h"
+#include "mesh_builder.h"
+
+#include <include/csg_triangulator.hpp>
+#include <include/util.hpp>
+
+#include <exception>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    using Meshset = carve::mesh::MeshSet<3>;
+
+    // An intermediate result, nullptr stands for the empty solid. Results are never modified once computed, so the result of a
+    // shared subtree is used by all its parents
+    using MeshsetPtr = std::shared_ptr<Meshset>;
+
+    // A tree node where chains of the same associative op are flattened into a single list of operands. Operands are the
+    // indices of other expressions. A node used by more than one parent is never merged into a chain, so it is evaluated once
+    struct Expression
+    {
+        const CSGMesh* mesh = nullptr;
+        CSGOp op = CSGOp::Union;
+        std::vector<int> operands;
+        // 0 for a leaf, otherwise one more than the highest operand
+        int height = 0;
+        // merged into the operand list of its parent, so not evaluated on its own
+        bool merged = false;
+    };
+
+    bool isAssociative(CSGOp op)
+    {
+        return op == CSGOp::Union || op == CSGOp::Intersection;
+    }
+
+    carve::csg::CSG::CSG_OP toCarveOp(CSGOp op)
+    {
+        switch (op)
+        {
+        case CSGOp::Union:
+            return carve::csg::CSG::CSG_OP::UNION;
+        case CSGOp::Intersection:
+            return carve::csg::CSG::CSG_OP::INTERSECTION;
+        case CSGOp::AMinusB:
+            return carve::csg::CSG::CSG_OP::A_MINUS_B;
+        case CSGOp::BMinusA:
+            return carve::csg::CSG::CSG_OP::B_MINUS_A;
+        case CSGOp::SymmetricDifference:
+        default:
+            return carve::csg::CSG::CSG_OP::SYMMETRIC_DIFFERENCE;
+        }
+    }
+
+    enum class VisitState : char
+    {
+        Unvisited,
+        Visiting,
+        Visited
+    };
+
+    void checkNode(const CSGTreeNode* nodes, int nodeCount, int index)
+    {
+        if (index < 0 || index >= nodeCount)
+        {
+            throw carve::exception("Invalid CSG tree node index");
+        }
+
+        const CSGTreeNode& node = nodes[index];
+        if (node.mesh == nullptr && ((int)node.op < (int)CSGOp::Union || (int)node.op > (int)CSGOp::SymmetricDifference))
+        {
+            throw carve::exception("Unknown CSG operation");
+        }
+    }
+
+    // The nodes reachable from the root, children before their parents. Uses an explicit stack, so deep trees cannot
+    // overflow the call stack. uses receives the number of parents of each node.
+    std::vector<int> sortNodes(const CSGTreeNode* nodes, int nodeCount, int rootIndex, std::vector<int>& uses)
+    {
+        std::vector<VisitState> state((size_t)nodeCount, VisitState::Unvisited);
+        std::vector<int> order;
+        // a node being visited and the number of its children visited so far
+        std::vector<std::pair<int, int>> stack;
+
+        auto visit = [&](int index)
+        {
+            checkNode(nodes, nodeCount, index);
+            if (state[index] == VisitState::Visiting)
+            {
+                throw carve::exception("CSG tree contains a cycle");
+            }
+            if (state[index] == VisitState::Visited)
+            {
+                return;
+            }
+
+            if (nodes[index].mesh != nullptr)
+            {
+                state[index] = VisitState::Visited;
+                order.push_back(index);
+            }
+            else
+            {
+                state[index] = VisitState::Visiting;
+                stack.push_back({ index, 0 });
+            }
+        };
+
+        visit(rootIndex);
+        while (!stack.empty())
+        {
+            std::pair<int, int>& top = stack.back();
+            if (top.second < 2)
+            {
+                const CSGTreeNode& node = nodes[top.first];
+                int childIndex = top.second++ == 0 ? node.left : node.right;
+                visit(childIndex);
+                ++uses[childIndex];
+            }
+            else
+            {
+                state[top.first] = VisitState::Visited;
+                order.push_back(top.first);
+                stack.pop_back();
+            }
+        }
+
+        return order;
+    }
+
+    // Builds the expressions of the sorted nodes, indexed like the nodes
+    std::vector<Expression> buildExpressions(const CSGTreeNode* nodes, int nodeCount, const std::vector<int>& order, const std::vector<int>& uses)
+    {
+        std::vector<Expression> expressions((size_t)nodeCount);
+        for (int index : order)
+        {
+            const CSGTreeNode& node = nodes[index];
+            Expression& expression = expressions[index];
+            if (node.mesh != nullptr)
+            {
+                expression.mesh = node.mesh;
+                continue;
+            }
+
+            expression.op = node.op;
+            for (int childIndex : { node.left, node.right })
+            {
+                Expression& child = expressions[childIndex];
+                if (isAssociative(node.op) && child.mesh == nullptr && child.op == node.op && uses[childIndex] == 1)
+                {
+                    expression.operands.insert(expression.operands.end(), child.operands.begin(), child.operands.end());
+                    child.operands.clear();
+                    child.merged = true;
+                }
+                else
+                {
+                    expression.operands.push_back(childIndex);
+                }
+            }
+
+            for (int operand : expression.operands)
+            {
+                expression.height = std::max(expression.height, expressions[operand].height + 1);
+            }
+        }
+
+        return expressions;
+    }
+
+    // forEachParallel with the first exception of any task rethrown on the calling thread
+    template <typename Func> void runParallel(size_t count, Func func)
+    {
+        std::vector<std::exception_ptr> errors(count);
+        carve::util::forEachParallel<size_t>(0, count, 1,
+            [&errors, &func](size_t i)
+            {
+                try
+                {
+                    func(i);
+                }
+                catch (...)
+                {
+                    errors[i] = std::current_exception();
+                }
+            }
+        );
+
+        for (std::exception_ptr& error : errors)
+        {
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    // The result when at least one operand is empty, following emptyOperandResult
+    MeshsetPtr combineWithEmpty(CSGOp op, MeshsetPtr a, MeshsetPtr b)
+    {
+        switch (op)
+        {
+        case CSGOp::Union:
+        case CSGOp::SymmetricDifference:
+            return a ? std::move(a) : std::move(b);
+        case CSGOp::AMinusB:
+            return a;
+        case CSGOp::BMinusA:
+            return b;
+        case CSGOp::Intersection:
+        default:
+            return nullptr;
+        }
+    }
+
+    // carve cannot combine a mesh with itself, which happens when both operands are the same shared subtree
+    void separateOperands(const MeshsetPtr& a, MeshsetPtr& b)
+    {
+        if (a && a == b)
+        {
+            b.reset(a->clone());
+        }
+    }
+
+    MeshsetPtr combine(CSGOp op, MeshsetPtr a, MeshsetPtr b)
+    {
+        if (!a || !b)
+        {
+            return combineWithEmpty(op, std::move(a), std::move(b));
+        }
+
+        separateOperands(a, b);
+
+        carve::csg::CSG csg;
+        csg.hooks.registerHook(new carve::csg::CarveTriangulatorWithImprovement(), carve::csg::CSG::Hooks::PROCESS_OUTPUT_FACE_BIT);
+
+        MeshsetPtr result(csg.compute(a.get(), b.get(), toCarveOp(op)));
+        if (result && result->faceBegin() == result->faceEnd())
+        {
+            result.reset();
+        }
+
+        return result;
+    }
+
+    // Combines neighbouring pairs level by level until at most targetCount results remain, so a chain of n operands
+    // takes log2(n) rounds of independent operations instead of n - 1 dependent ones
+    void reduceBalanced(CSGOp op, std::vector<MeshsetPtr>& results, size_t targetCount)
+    {
+        while (results.size() > targetCount)
+        {
+            size_t pairCount = std::min(results.size() / 2, results.size() - targetCount);
+            std::vector<MeshsetPtr> combined(pairCount);
+            runParallel(pairCount,
+                [op, &results, &combined](size_t i)
+                {
+                    combined[i] = combine(op, std::move(results[2 * i]), std::move(results[2 * i + 1]));
+                }
+            );
+
+            for (size_t i = 2 * pairCount; i < results.size(); ++i)
+            {
+                combined.push_back(std::move(results[i]));
+            }
+            results.swap(combined);
+        }
+    }
+
+    std::vector<MeshsetPtr> gatherOperands(const Expression& expression, const std::vector<MeshsetPtr>& results)
+    {
+        std::vector<MeshsetPtr> operands;
+        operands.reserve(expression.operands.size());
+        for (int operand : expression.operands)
+        {
+            operands.push_back(results[operand]);
+        }
+
+        return operands;
+    }
+
+    MeshsetPtr evaluate(const Expression& expression, const std::vector<MeshsetPtr>& results)
+    {
+        if (expression.mesh != nullptr)
+        {
+            if (expression.mesh->getTriangleCount() == 0)
+            {
+                return nullptr;
+            }
+
+            return MeshsetPtr(createMeshSet(expression.mesh));
+        }
+
+        std::vector<MeshsetPtr> operands = gatherOperands(expression, results);
+        reduceBalanced(expression.op, operands, 1);
+        return std::move(operands[0]);
+    }
+}
+
+CSGMesh* evaluateCSGTree(const CSGTreeNode* nodes, int nodeCount, int rootIndex)
+{
+    nodeCount = std::max(nodeCount, 0);
+    std::vector<int> uses((size_t)nodeCount, 0);
+    std::vector<int> order = sortNodes(nodes, nodeCount, rootIndex, uses);
+    std::vector<Expression> expressions = buildExpressions(nodes, nodeCount, order, uses);
+    const Expression& root = expressions[rootIndex];
+
+    if (root.mesh != nullptr)
+    {
+        CSGMesh* mesh = new CSGMesh();
+        mesh->setVertices(root.mesh->getVertexCount(), root.mesh->getVertices());
+        mesh->setTriangles(root.mesh->getTriangleCount(), root.mesh->getTriangles());
+        return mesh;
+    }
+
+    // every expression only depends on lower ones, so each height is evaluated concurrently once the lower ones are done.
+    // The root is the only expression at its height
+    std::vector<std::vector<int>> levels((size_t)root.height);
+    std::vector<int> pendingUses((size_t)nodeCount, 0);
+    for (int index : order)
+    {
+        const Expression& expression = expressions[index];
+        if (expression.merged)
+        {
+            continue;
+        }
+
+        if (index != rootIndex)
+        {
+            levels[expression.height].push_back(index);
+        }
+        for (int operand : expression.operands)
+        {
+            ++pendingUses[operand];
+        }
+    }
+
+    std::vector<MeshsetPtr> results((size_t)nodeCount);
+    for (const std::vector<int>& level : levels)
+    {
+        runParallel(level.size(),
+            [&expressions, &results, &level](size_t i)
+            {
+                results[level[i]] = evaluate(expressions[level[i]], results);
+            }
+        );
+
+        // release the results that have been used by all their parents
+        for (int index : level)
+        {
+            for (int operand : expressions[index].operands)
+            {
+                if (--pendingUses[operand] == 0)
+                {
+                    results[operand].reset();
+                }
+            }
+        }
+    }
+
+    // the last operation writes the float output directly, without building a carve mesh for the result
+    std::vector<MeshsetPtr> operands = gatherOperands(root, results);
+    results.clear();
+    reduceBalanced(root.op, operands, 2);
+
+    if (!operands[0] || !operands[1])
+    {
+        MeshsetPtr result = combineWithEmpty(root.op, std::move(operands[0]), std::move(operands[1]));
+        return result ? createCSGMesh(result.get()) : new CSGMesh();
+    }
+
+    separateOperands(operands[0], operands[1]);
+    return performCSG(operands[0].get(), nullptr, operands[1].get(), nullptr, root.op);
+}
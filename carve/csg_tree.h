@@ -0,0 +1,12 @@
+#ifndef CARVE_DLL_CSG_TREE_H
+#define CARVE_DLL_CSG_TREE_H
+
+#include "carve.h"
+
+// Evaluates the expression tree rooted at nodes[rootIndex]. Intermediate results stay carve meshes in double precision,
+// union and intersection chains are rebalanced, and independent subtrees are evaluated concurrently. A subtree used by
+// several nodes is evaluated once, and the tree is walked without recursion, so its depth is not limited by the stack.
+// Throws carve::exception for an invalid tree or a failed operation.
+CSGMesh* evaluateCSGTree(const CSGTreeNode* nodes, int nodeCount, int rootIndex);
+
+#endif
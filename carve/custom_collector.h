@@ -3,6 +3,7 @@
 #define CARVE_DLL_CUSTOM_COLLECTOR_H
 
 #include <include/csg.hpp>
+#include <include/util.hpp>
 
 // This file is copied from csg_collector.cpp 
 // It contains all collectors from that file, but without constructing the final meshset
@@ -15,7 +16,7 @@ namespace
         BaseCollectorWithoutResultMeshset();
         BaseCollectorWithoutResultMeshset(const BaseCollectorWithoutResultMeshset&);
 
-    protected:
+    public:
         struct face_data_t
         {
             carve::mesh::MeshSet<3>::face_t* face;
@@ -27,6 +28,29 @@ namespace
             face_data_t() = default;
         };
 
+        // The faces of the result, in order. Complete once done() has been called, and empty if done() has streamed the faces
+        // to result face hooks instead.
+        const std::vector<face_data_t>& getFaces() const
+        {
+            return faces;
+        }
+
+    protected:
+
+        // A loop of a collected group, with the class of the group.
+        struct loop_data_t
+        {
+            const carve::csg::FaceLoop* loop;
+            carve::csg::FaceClass face_class;
+            bool poly_a;
+            loop_data_t(const carve::csg::FaceLoop* _loop, carve::csg::FaceClass _face_class, bool _poly_a)
+                : loop(_loop), face_class(_face_class), poly_a(_poly_a) {};
+        };
+
+        // The loops of the collected groups, which are turned into faces by the first call to done(). The loops stay in the memory
+        // of the operation until it returns, after done().
+        std::vector<loop_data_t> loopData;
+
         std::vector<carve::small_vector_on_stack<face_data_t, 3>> tmpFaces;
         std::vector<face_data_t> faces;
 
@@ -45,7 +69,7 @@ namespace
             }
         }
 
-        void processFace(const carve::mesh::MeshSet<3>::face_t* orig_face, const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& vertices,
+        void processFace(const carve::mesh::MeshSet<3>::face_t* orig_face, const carve::csg::FaceLoop::vertex_list_t& vertices,
                 carve::geom3d::Vector /* normal */, bool /* poly_a */, carve::csg::FaceClass face_class, carve::csg::CSG::Hooks& hooks, bool reversed, size_t index)
         {
             carve::small_vector_on_stack<carve::mesh::MeshSet<3>::face_t*, 16> new_faces;
@@ -61,10 +85,10 @@ namespace
             }
         }
 
-        virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& vertices,
+        virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const carve::csg::FaceLoop::vertex_list_t& vertices,
             carve::geom3d::Vector normal, bool poly_a, carve::csg::FaceClass face_class, carve::csg::CSG::Hooks& hooks, size_t index) = 0;
 
-        virtual void collect(carve::csg::FaceLoopGroup* grp, carve::csg::CSG::Hooks& hooks) override
+        virtual void collect(carve::csg::FaceLoopGroup* grp, carve::csg::CSG::Hooks& /* hooks */) override
         {
             std::list<carve::csg::ClassificationInfo>& cinfo = (grp->classification);
 
@@ -140,18 +164,29 @@ namespace
 
             bool is_poly_a = grp->src == src_a;
 
-            auto process = [this, is_poly_a, fc, &hooks](const auto& data)
+            for (carve::csg::FaceLoop* f = grp->face_loops.head; f; f = f->next)
             {
-                const carve::csg::FaceLoop* f = data.first;
-                size_t idx = data.second;
-                collect(f->orig_face, f->vertices, f->orig_face->plane.N, is_poly_a, fc, hooks, idx);
-            };
-
-            tmpFaces.resize(grp->face_loops.count);
-            faces.reserve(std::max(faces.capacity(), grp->face_loops.count * 2 + faces.size()));
+                loopData.push_back(loop_data_t(f, fc, is_poly_a));
+            }
+        }
 
-            carve::util::forEachParallel(grp->face_loops, process);
+        // Turns the loops of all the collected groups into faces in a single parallel pass, keeping their order.
+        void processLoops(carve::csg::CSG::Hooks& hooks)
+        {
+            tmpFaces.resize(loopData.size());
+            carve::util::forEachParallel<size_t>(0, loopData.size(), 16, [this, &hooks](size_t idx)
+            {
+                const loop_data_t& data = loopData[idx];
+                const carve::csg::FaceLoop* f = data.loop;
+                collect(f->orig_face, f->vertices, f->orig_face->plane.N, data.poly_a, data.face_class, hooks, idx);
+            });
 
+            size_t count = 0;
+            for (auto& it : tmpFaces)
+            {
+                count += it.size();
+            }
+            faces.reserve(faces.size() + count);
             for (auto& it : tmpFaces)
             {
                 for (auto& f : it)
@@ -161,10 +196,75 @@ namespace
             }
 
             tmpFaces.clear();
+            tmpFaces.shrink_to_fit();
+            loopData.clear();
+            loopData.shrink_to_fit();
+        }
+
+        // Turns the loops into faces a batch at a time and hands them to the result face hooks, deleting every face as soon as the hooks
+        // have seen it, so that only one batch of faces is alive at once. The number of faces given to the hooks is the number of loops.
+        void streamLoops(carve::csg::CSG::Hooks& hooks)
+        {
+            const size_t batchLoops = 4096;
+
+            hooks.resultNumFaces(loopData.size());
+            for (size_t begin = 0; begin < loopData.size(); begin += batchLoops)
+            {
+                size_t end = std::min(loopData.size(), begin + batchLoops);
+                tmpFaces.resize(end - begin);
+                carve::util::forEachParallel<size_t>(begin, end - begin, 16, [this, &hooks, begin](size_t idx)
+                {
+                    const loop_data_t& data = loopData[idx];
+                    const carve::csg::FaceLoop* f = data.loop;
+                    collect(f->orig_face, f->vertices, f->orig_face->plane.N, data.poly_a, data.face_class, hooks, idx - begin);
+                });
+
+                try
+                {
+                    for (auto& it : tmpFaces)
+                    {
+                        for (auto& f : it)
+                        {
+                            hooks.resultFace(f.face, f.orig_face, f.flipped);
+                            delete f.face;
+                            f.face = nullptr;
+                        }
+                    }
+                }
+                catch (...)
+                {
+                    // a hook has stopped the operation, release the faces it has not seen
+                    for (auto& it : tmpFaces)
+                    {
+                        for (auto& f : it)
+                        {
+                            delete f.face;
+                        }
+                    }
+                    throw;
+                }
+                // the next batch starts from empty entries, without reallocating
+                tmpFaces.clear();
+            }
+
+            tmpFaces.shrink_to_fit();
+            loopData.clear();
+            loopData.shrink_to_fit();
         }
 
         virtual carve::mesh::MeshSet<3>* done(carve::csg::CSG::Hooks& hooks) override
         {
+            if (faces.empty() && hooks.hasHook(carve::csg::CSG::Hooks::RESULT_FACE_HOOK))
+            {
+                streamLoops(hooks);
+                return NULL;
+            }
+
+            if (!loopData.empty())
+            {
+                processLoops(hooks);
+            }
+
             if (hooks.hasHook(carve::csg::CSG::Hooks::RESULT_FACE_HOOK))
             {
                 hooks.resultNumFaces(faces.size());
@@ -188,7 +288,7 @@ namespace
         virtual ~UnionCollectorWithoutResultMeshset()
         {
         }
-        virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& vertices,
+        virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const carve::csg::FaceLoop::vertex_list_t& vertices,
             carve::geom3d::Vector normal, bool poly_a, carve::csg::FaceClass face_class, carve::csg::CSG::Hooks& hooks, size_t index) override
         {
             if (face_class == carve::csg::FaceClass::FACE_OUT || (poly_a && face_class == carve::csg::FaceClass::FACE_ON_ORIENT_OUT))
@@ -208,7 +308,7 @@ namespace
         virtual ~IntersectionCollectorWithoutResultMeshset()
         {
         }
-        virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& vertices,
+        virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const carve::csg::FaceLoop::vertex_list_t& vertices,
             carve::geom3d::Vector normal, bool poly_a, carve::csg::FaceClass face_class, carve::csg::CSG::Hooks& hooks, size_t idx) override
         {
             if (face_class == carve::csg::FaceClass::FACE_IN || (poly_a && face_class == carve::csg::FaceClass::FACE_ON_ORIENT_OUT))
@@ -228,7 +328,7 @@ namespace
         virtual ~SymmetricDifferenceCollectorWithoutResultMeshset()
         {
         }
-        virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& vertices,
+        virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const carve::csg::FaceLoop::vertex_list_t& vertices,
             carve::geom3d::Vector normal, bool poly_a, carve::csg::FaceClass face_class, carve::csg::CSG::Hooks& hooks, size_t idx) override
         {
             if (face_class == carve::csg::FaceClass::FACE_OUT)
@@ -252,7 +352,7 @@ namespace
         virtual ~AMinusBCollectorWithoutResultMeshset()
         {
         }
-        virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& vertices,
+        virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const carve::csg::FaceLoop::vertex_list_t& vertices,
             carve::geom3d::Vector normal, bool poly_a, carve::csg::FaceClass face_class, carve::csg::CSG::Hooks& hooks, size_t idx) override
         {
             if ((face_class == carve::csg::FaceClass::FACE_OUT || face_class == carve::csg::FaceClass::FACE_ON_ORIENT_IN) && poly_a)
@@ -276,7 +376,7 @@ namespace
         virtual ~BMinusACollectorWithoutResultMeshset()
         {
         }
-        virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& vertices,
+        virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const carve::csg::FaceLoop::vertex_list_t& vertices,
             carve::geom3d::Vector normal, bool poly_a, carve::csg::FaceClass face_class, carve::csg::CSG::Hooks& hooks, size_t idx) override
         {
             if ((face_class == carve::csg::FaceClass::FACE_OUT || face_class == carve::csg::FaceClass::FACE_ON_ORIENT_IN) && !poly_a)
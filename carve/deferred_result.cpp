@@ -0,0 +1,78 @@
+#include "deferred_result.h"
+
+namespace
+{
+    // Appends the chunks of a result to a single mesh.
+    class MeshTriangleSink : public TriangleSink
+    {
+    public:
+        virtual bool consume(const float* vertices, int vertexCount, const int* triangles, int triangleCount) override
+        {
+            m_vertices.insert(m_vertices.end(), vertices, vertices + vertexCount * 3);
+            m_triangles.insert(m_triangles.end(), triangles, triangles + triangleCount * 3);
+            return true;
+        }
+
+        CSGMesh* createMesh()
+        {
+            CSGMesh* mesh = new CSGMesh();
+            mesh->stealVertices(m_vertices);
+            mesh->stealTriangles(m_triangles);
+            return mesh;
+        }
+
+    private:
+        std::vector<float> m_vertices;
+        std::vector<int> m_triangles;
+    };
+}
+
+void writeCSGOnViews(const CSGMeshView& meshA, const CSGMeshView& meshB, CSGOp op, TriangleSink& sink, size_t chunkTriangles)
+{
+    if (meshA.triangleCount == 0 || meshB.triangleCount == 0)
+    {
+        std::unique_ptr<CSGMesh> mesh(meshA.triangleCount == 0 ? emptyOperandResult(meshB, nullptr, false, op) : emptyOperandResult(meshA, nullptr, true, op));
+        writeMesh(*mesh, sink, chunkTriangles);
+        return;
+    }
+
+    std::unique_ptr<carve::mesh::MeshSet<3>> models[2];
+    if (!createOperandMeshSets(meshA, nullptr, meshB, nullptr, models))
+    {
+        throw carve::exception("Cannot construct polyhedron");
+    }
+
+    if (!writeCSG(models[0].get(), models[1].get(), op, sink, chunkTriangles))
+    {
+        throw carve::exception("Unknown operation");
+    }
+}
+
+CSGDeferredResult::CSGDeferredResult()
+{
+}
+
+std::unique_ptr<CSGDeferredResult> CSGDeferredResult::compute(const CSGMeshView& meshA, const CSGMeshView& meshB, CSGOp op)
+{
+    MeshTriangleSink sink;
+    writeCSGOnViews(meshA, meshB, op, sink, DEFAULT_CHUNK_TRIANGLES);
+
+    std::unique_ptr<CSGDeferredResult> result(new CSGDeferredResult());
+    result->m_mesh.reset(sink.createMesh());
+    return result;
+}
+
+int CSGDeferredResult::getVertexCount() const
+{
+    return m_mesh->getVertexCount();
+}
+
+int CSGDeferredResult::getTriangleCount() const
+{
+    return m_mesh->getTriangleCount();
+}
+
+void CSGDeferredResult::write(TriangleSink& sink, size_t chunkTriangles) const
+{
+    writeMesh(*m_mesh, sink, chunkTriangles);
+}
@@ -0,0 +1,34 @@
+#ifndef CARVE_DLL_DEFERRED_RESULT_H
+#define CARVE_DLL_DEFERRED_RESULT_H
+
+#include "carve.h"
+#include "csg_operation.h"
+
+#include <memory>
+
+// Runs the boolean operation on the views and hands the result to the sink in chunks of about chunkTriangles triangles while its
+// faces are collected, without creating a mesh. Throws carve::exception if the operation fails or the sink stops.
+void writeCSGOnViews(const CSGMeshView& meshA, const CSGMeshView& meshB, CSGOp op, TriangleSink& sink, size_t chunkTriangles);
+
+// Handle returned by leoPerformCSGDeferred. The result is converted into triangles once, in chunks while the operation collects its
+// faces, which also counts them. The operands and the result faces are released before compute() returns, only the triangles are
+// kept until they are written.
+class CSGDeferredResult
+{
+public:
+    // Throws carve::exception if the operation fails.
+    static std::unique_ptr<CSGDeferredResult> compute(const CSGMeshView& meshA, const CSGMeshView& meshB, CSGOp op);
+
+    int getVertexCount() const;
+    int getTriangleCount() const;
+
+    // Hands the result to the sink in chunks of about chunkTriangles triangles. Throws carve::exception if the sink stops.
+    void write(TriangleSink& sink, size_t chunkTriangles) const;
+
+private:
+    CSGDeferredResult();
+
+    std::unique_ptr<CSGMesh> m_mesh;
+};
+
+#endif
@@ -0,0 +1,171 @@
+#include "mesh_builder.h"
+
+#include <include/input.hpp>
+
+static carve::input::StridedTriangleData::Type toCarveType(CSGDataType type)
+{
+    switch (type)
+    {
+    case CSGDataType::Float32:
+        return carve::input::StridedTriangleData::Type::FLOAT32;
+    case CSGDataType::Float64:
+        return carve::input::StridedTriangleData::Type::FLOAT64;
+    case CSGDataType::Int16:
+        return carve::input::StridedTriangleData::Type::INT16;
+    case CSGDataType::Int32:
+        return carve::input::StridedTriangleData::Type::INT32;
+    default:
+        throw carve::exception("Unknown data type");
+    }
+}
+
+static carve::input::StridedTriangleData makeTriangleData(const CSGMeshView& view, const carve::math::Matrix* transform)
+{
+    if (view.vertexCount < 0 || view.triangleCount < 0 || view.vertexStride < 0 || view.triangleStride < 0)
+    {
+        throw carve::exception("Invalid mesh view");
+    }
+
+    carve::input::StridedTriangleData data;
+    data.vertices = view.vertices;
+    data.vertex_count = (size_t)view.vertexCount;
+    data.vertex_stride = (size_t)view.vertexStride;
+    data.vertex_type = toCarveType(view.vertexType);
+    data.triangles = view.triangles;
+    data.triangle_count = (size_t)view.triangleCount;
+    data.triangle_stride = (size_t)view.triangleStride;
+    data.index_type = toCarveType(view.indexType);
+    if (transform != nullptr)
+    {
+        data.transform(*transform);
+    }
+    return data;
+}
+
+CSGMeshView makeMeshView(const CSGMesh* mesh)
+{
+    CSGMeshView view;
+    view.vertices = mesh->getVertices();
+    view.vertexCount = mesh->getVertexCount();
+    view.vertexStride = 0;
+    view.vertexType = CSGDataType::Float32;
+    view.triangles = mesh->getTriangles();
+    view.triangleCount = mesh->getTriangleCount();
+    view.triangleStride = 0;
+    view.indexType = CSGDataType::Int32;
+    return view;
+}
+
+carve::mesh::MeshSet<3>* createMeshSet(const CSGMeshView& view, const carve::math::Matrix* transform)
+{
+    return makeTriangleData(view, transform).createMesh(carve::input::Options());
+}
+
+carve::mesh::MeshSet<3>* createMeshSet(const CSGMesh* mesh)
+{
+    return createMeshSet(makeMeshView(mesh));
+}
+
+carve::geom::aabb<3> getMeshViewBounds(const CSGMeshView& view, const carve::math::Matrix* transform)
+{
+    carve::input::StridedTriangleData data = makeTriangleData(view, transform);
+
+    carve::geom3d::Vector min = data.getVertex(0);
+    carve::geom3d::Vector max = min;
+    for (size_t i = 1; i < data.vertex_count; ++i)
+    {
+        carve::geom3d::Vector v = data.getVertex(i);
+        assign_op(min, min, v, carve::util::min_functor());
+        assign_op(max, max, v, carve::util::max_functor());
+    }
+
+    carve::geom::aabb<3> bounds;
+    bounds.fit(min, max);
+    return bounds;
+}
+
+void checkMeshViewIndices(const CSGMeshView& view)
+{
+    carve::input::StridedTriangleData data = makeTriangleData(view, nullptr);
+    for (size_t i = 0; i < data.triangle_count; ++i)
+    {
+        size_t v[3];
+        data.getTriangle(i, v);
+        // negative indices are read as huge values
+        if (v[0] >= data.vertex_count || v[1] >= data.vertex_count || v[2] >= data.vertex_count)
+        {
+            throw carve::exception("triangle vertex index out of range");
+        }
+    }
+}
+
+void appendMeshView(const CSGMeshView& view, const carve::math::Matrix* transform, std::vector<float>& vertices, std::vector<int>& triangles)
+{
+    carve::input::StridedTriangleData data = makeTriangleData(view, transform);
+    int indexOffset = (int)(vertices.size() / 3);
+
+    vertices.reserve(vertices.size() + data.vertex_count * 3);
+    for (size_t i = 0; i < data.vertex_count; ++i)
+    {
+        carve::geom3d::Vector v = data.getVertex(i);
+        vertices.push_back((float)v.x);
+        vertices.push_back((float)v.y);
+        vertices.push_back((float)v.z);
+    }
+
+    triangles.reserve(triangles.size() + data.triangle_count * 3);
+    for (size_t i = 0; i < data.triangle_count; ++i)
+    {
+        size_t v[3];
+        data.getTriangle(i, v);
+        triangles.push_back((int)v[0] + indexOffset);
+        triangles.push_back((int)v[1] + indexOffset);
+        triangles.push_back((int)v[2] + indexOffset);
+    }
+}
+
+CSGMesh* createCSGMesh(const CSGMeshView& view, const carve::math::Matrix* transform)
+{
+    std::vector<float> vertices;
+    std::vector<int> triangles;
+    appendMeshView(view, transform, vertices, triangles);
+
+    CSGMesh* mesh = new CSGMesh();
+    mesh->stealVertices(vertices);
+    mesh->stealTriangles(triangles);
+    return mesh;
+}
+
+CSGMesh* createCSGMesh(const carve::mesh::MeshSet<3>* meshSet)
+{
+    using Meshset = carve::mesh::MeshSet<3>;
+
+    const std::vector<Meshset::vertex_t>& vertexStorage = meshSet->vertex_storage;
+
+    std::vector<float> vertices;
+    vertices.reserve(vertexStorage.size() * 3);
+    for (const Meshset::vertex_t& vertex : vertexStorage)
+    {
+        vertices.push_back((float)vertex.v.x);
+        vertices.push_back((float)vertex.v.y);
+        vertices.push_back((float)vertex.v.z);
+    }
+
+    std::vector<int> triangles;
+    for (Meshset::const_face_iter it = meshSet->faceBegin(); it != meshSet->faceEnd(); ++it)
+    {
+        const Meshset::edge_t* startEdge = (*it)->edge;
+        int startVertexIndex = (int)(startEdge->vert - vertexStorage.data());
+        for (const Meshset::edge_t* edge = startEdge->next; edge->next != startEdge; edge = edge->next)
+        {
+            triangles.push_back(startVertexIndex);
+            triangles.push_back((int)(edge->vert - vertexStorage.data()));
+            triangles.push_back((int)(edge->next->vert - vertexStorage.data()));
+        }
+    }
+
+    CSGMesh* mesh = new CSGMesh();
+    mesh->stealVertices(vertices);
+    mesh->stealTriangles(triangles);
+    return mesh;
+}
@@ -0,0 +1,36 @@
+#ifndef CARVE_DLL_MESH_BUILDER_H
+#define CARVE_DLL_MESH_BUILDER_H
+
+#include "carve.h"
+
+#include <include/aabb.hpp>
+#include <include/matrix.hpp>
+#include <include/mesh.hpp>
+
+#include <vector>
+
+// A view of the vertex and triangle arrays of the mesh.
+CSGMeshView makeMeshView(const CSGMesh* mesh);
+
+// Builds the carve representation of a mesh, reading the caller buffers in place and applying the transform (if not null)
+// on the way. Throws if the mesh cannot be constructed.
+carve::mesh::MeshSet<3>* createMeshSet(const CSGMeshView& view, const carve::math::Matrix* transform = nullptr);
+carve::mesh::MeshSet<3>* createMeshSet(const CSGMesh* mesh);
+
+// The bounding box of all the vertices of the view, after the transform (if not null). The view must have vertices.
+carve::geom::aabb<3> getMeshViewBounds(const CSGMeshView& view, const carve::math::Matrix* transform = nullptr);
+
+// Throws if a triangle of the view refers to a vertex outside of it, the same way building the carve mesh does.
+void checkMeshViewIndices(const CSGMeshView& view);
+
+// Appends the vertices and triangles of a mesh view to float buffers, applying the transform if not null. The triangle
+// indices are offset by the number of vertices already in the buffers. The indices are not checked.
+void appendMeshView(const CSGMeshView& view, const carve::math::Matrix* transform, std::vector<float>& vertices, std::vector<int>& triangles);
+
+// Copies a mesh view into a new float mesh, applying the transform if not null.
+CSGMesh* createCSGMesh(const CSGMeshView& view, const carve::math::Matrix* transform = nullptr);
+
+// Converts a carve mesh back to a triangle mesh, triangulating faces with more than three vertices as fans.
+CSGMesh* createCSGMesh(const carve::mesh::MeshSet<3>* meshSet);
+
+#endif
@@ -0,0 +1,106 @@
+#include "operation_stats.h"
+
+#if _WIN32
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <cstdio>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Returns 0 where the resident memory cannot be read.
+    size_t residentBytes()
+    {
+#if _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        {
+            return counters.WorkingSetSize;
+        }
+        return 0;
+#elif defined(__linux__)
+        size_t size = 0, resident = 0;
+        FILE* statm = fopen("/proc/self/statm", "r");
+        if (statm == nullptr)
+        {
+            return 0;
+        }
+        if (fscanf(statm, "%zu %zu", &size, &resident) != 2)
+        {
+            resident = 0;
+        }
+        fclose(statm);
+        return resident * (size_t)sysconf(_SC_PAGESIZE);
+#else
+        return 0;
+#endif
+    }
+}
+
+OperationStats::OperationStats()
+    : m_start(Clock::now()), m_meshConstructionSeconds(0.0), m_outputSeconds(0.0), m_baseResidentBytes(residentBytes()),
+      m_peakResidentBytes(m_baseResidentBytes)
+{
+}
+
+carve::csg::Stats& OperationStats::getCSGStats()
+{
+    return m_csgStats;
+}
+
+double OperationStats::secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void OperationStats::addMeshConstruction(Clock::time_point start)
+{
+    m_meshConstructionSeconds += secondsSince(start);
+}
+
+void OperationStats::addOutput(Clock::time_point start)
+{
+    m_outputSeconds += secondsSince(start);
+}
+
+void OperationStats::addCSGPhase(carve::csg::Stats::Phase phase, Clock::time_point start)
+{
+    m_csgStats.seconds[phase] += secondsSince(start);
+}
+
+void OperationStats::sampleMemory()
+{
+    size_t resident = residentBytes();
+    size_t peak = m_peakResidentBytes.load();
+    while (resident > peak && !m_peakResidentBytes.compare_exchange_weak(peak, resident))
+    {
+    }
+}
+
+void OperationStats::fill(CSGStats& stats)
+{
+    sampleMemory();
+
+    using Stats = carve::csg::Stats;
+    const double* seconds = m_csgStats.seconds;
+    stats.meshConstructionSeconds = m_meshConstructionSeconds;
+    stats.rtreeBuildSeconds = seconds[Stats::RTREE_BUILD];
+    stats.candidateSeconds = seconds[Stats::CANDIDATES];
+    stats.intersectionSeconds = seconds[Stats::INTERSECTIONS];
+    stats.faceLoopSeconds = seconds[Stats::FACE_LOOPS];
+    stats.groupingSeconds = seconds[Stats::GROUPING];
+    stats.classificationSeconds = seconds[Stats::CLASSIFICATION];
+    stats.triangulationSeconds = seconds[Stats::TRIANGULATION];
+    // the faces are collected when the result is converted
+    stats.outputSeconds = seconds[Stats::COLLECTION] + m_outputSeconds;
+    stats.totalSeconds = secondsSince(m_start);
+
+    stats.facePairs = (long long)m_csgStats.face_pairs;
+    stats.intersectionVertices = (long long)m_csgStats.intersection_vertices;
+    stats.faceLoops = (long long)m_csgStats.face_loops;
+    stats.groups = (long long)m_csgStats.groups;
+    stats.classificationRays = (long long)m_csgStats.classification_rays;
+    stats.peakTransientBytes = (long long)(m_peakResidentBytes.load() - m_baseResidentBytes);
+}
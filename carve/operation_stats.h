@@ -0,0 +1,43 @@
+#ifndef CARVE_DLL_OPERATION_STATS_H
+#define CARVE_DLL_OPERATION_STATS_H
+
+#include "carve.h"
+
+#include <include/csg.hpp>
+
+#include <atomic>
+#include <chrono>
+
+// Gathers the statistics of one operation from its start to the call of fill. The phases inside carve are measured by
+// carve::csg::CSG into getCSGStats, the library adds the time of its own phases around them.
+class OperationStats
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    OperationStats();
+
+    carve::csg::Stats& getCSGStats();
+
+    // Add the time since start to the phase.
+    void addMeshConstruction(Clock::time_point start);
+    void addOutput(Clock::time_point start);
+    void addCSGPhase(carve::csg::Stats::Phase phase, Clock::time_point start);
+
+    // Records the resident memory of the process, if it is larger than before. May be called from several threads at once.
+    void sampleMemory();
+
+    void fill(CSGStats& stats);
+
+private:
+    static double secondsSince(Clock::time_point start);
+
+    Clock::time_point m_start;
+    carve::csg::Stats m_csgStats;
+    double m_meshConstructionSeconds;
+    double m_outputSeconds;
+    size_t m_baseResidentBytes;
+    std::atomic<size_t> m_peakResidentBytes;
+};
+
+#endif
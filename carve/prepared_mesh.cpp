@@ -0,0 +1,227 @@
+#include "prepared_mesh.h"
+#include "mesh_builder.h"
+
+namespace
+{
+    const size_t DEFAULT_CACHE_BUDGET = (size_t)1 << 30;
+
+    size_t estimateTreeSize(const carve::csg::CSG::face_rtree_t* node)
+    {
+        size_t size = 0;
+        for (; node != nullptr; node = node->sibling)
+        {
+            size += sizeof(*node) + node->data.capacity() * sizeof(carve::mesh::MeshSet<3>::face_t*);
+            size += estimateTreeSize(node->child);
+        }
+
+        return size;
+    }
+
+    size_t estimateSize(const PreparedMeshData& data)
+    {
+        using Meshset = carve::mesh::MeshSet<3>;
+
+        const Meshset* meshSet = data.meshSet.get();
+        size_t size = sizeof(Meshset) + meshSet->vertex_storage.capacity() * sizeof(Meshset::vertex_t);
+        for (const Meshset::mesh_t* mesh : meshSet->meshes)
+        {
+            size += sizeof(Meshset::mesh_t);
+            size += (mesh->faces.capacity() + mesh->open_edges.capacity() + mesh->closed_edges.capacity()) * sizeof(void*);
+            for (const Meshset::face_t* face : mesh->faces)
+            {
+                size += sizeof(Meshset::face_t) + face->n_edges * sizeof(Meshset::edge_t);
+            }
+        }
+
+        return size + estimateTreeSize(data.faceTree.get());
+    }
+}
+
+std::shared_ptr<const PreparedMeshData> transformPreparedMesh(const PreparedMeshData& data, const carve::math::Matrix& transform)
+{
+    using Meshset = carve::mesh::MeshSet<3>;
+
+    std::shared_ptr<PreparedMeshData> transformed = std::make_shared<PreparedMeshData>();
+    transformed->meshSet.reset(data.meshSet->clone());
+
+    Meshset* meshSet = transformed->meshSet.get();
+    meshSet->transform(
+        [&transform](const Meshset::vertex_t::vector_t& v)
+        {
+            return transform * v;
+        }
+    );
+    if (carve::math::linearDeterminant(transform) < 0.0)
+    {
+        // a mirrored mesh is inside out. Only the faces are turned around, Mesh::invert() would also mark the mesh as negative
+        for (Meshset::face_iter face = meshSet->faceBegin(); face != meshSet->faceEnd(); ++face)
+        {
+            (*face)->invert();
+        }
+    }
+
+    // clone() keeps the ids of the faces, which are dense, so the copies are found by id
+    size_t faceCount = 0;
+    for (const Meshset::mesh_t* mesh : meshSet->meshes)
+    {
+        faceCount += mesh->faces.size();
+    }
+
+    std::vector<Meshset::face_t*> facesById(faceCount, nullptr);
+    for (Meshset::face_iter face = meshSet->faceBegin(); face != meshSet->faceEnd(); ++face)
+    {
+        size_t id = (*face)->id;
+        if (id >= faceCount || facesById[id] != nullptr)
+        {
+            throw carve::exception("Prepared mesh face ids are not dense");
+        }
+        facesById[id] = *face;
+    }
+
+    transformed->faceTree.reset(data.faceTree->copy(
+        [&facesById](const Meshset::face_t* face)
+        {
+            if (face->id >= facesById.size() || facesById[face->id] == nullptr)
+            {
+                throw carve::exception("Prepared mesh face tree refers to an unknown face");
+            }
+            return facesById[face->id];
+        }
+    ));
+    transformed->faceTree->refit();
+    transformed->byteSize = data.byteSize;
+
+    return transformed;
+}
+
+CSGPreparedMesh::CSGPreparedMesh(const CSGMesh& source) : m_source(source)
+{
+}
+
+const CSGMesh& CSGPreparedMesh::getSource() const
+{
+    return m_source;
+}
+
+size_t CSGPreparedMesh::getSourceSize() const
+{
+    size_t size = (size_t)m_source.getVertexCount() * 3 * sizeof(float) + (size_t)m_source.getTriangleCount() * 3 * sizeof(int);
+    if (m_source.getTriangleSources() != nullptr)
+    {
+        size += (size_t)m_source.getTriangleCount() * sizeof(CSGTriangleSource);
+    }
+    return size;
+}
+
+PreparedMeshCache::PreparedMeshCache() : m_budget(DEFAULT_CACHE_BUDGET), m_usage(0)
+{
+}
+
+PreparedMeshCache& PreparedMeshCache::instance()
+{
+    static PreparedMeshCache cache;
+    return cache;
+}
+
+std::shared_ptr<const PreparedMeshData> PreparedMeshCache::build(const CSGMesh& source)
+{
+    std::shared_ptr<PreparedMeshData> data = std::make_shared<PreparedMeshData>();
+    data->meshSet.reset(createMeshSet(&source));
+    data->faceTree.reset(carve::csg::CSG::face_rtree_t::construct_STR(data->meshSet->faceBegin(), data->meshSet->faceEnd(), 4, 4));
+    data->byteSize = estimateSize(*data);
+    return data;
+}
+
+std::shared_ptr<const PreparedMeshData> PreparedMeshCache::acquire(const CSGPreparedMesh* mesh)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(mesh);
+        if (it != m_entries.end() && it->second.data)
+        {
+            touch(it->second);
+            return it->second.data;
+        }
+    }
+
+    // build without holding the lock, so that other meshes can be prepared at the same time
+    std::shared_ptr<const PreparedMeshData> data = build(mesh->getSource());
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto [it, inserted] = m_entries.try_emplace(mesh);
+    Entry& entry = it->second;
+    if (inserted)
+    {
+        // the source copy lives as long as the handle, whether or not its prepared data is cached
+        entry.sourceSize = mesh->getSourceSize();
+        m_usage += entry.sourceSize;
+    }
+
+    if (entry.data)
+    {
+        // another thread has built it in the meantime
+        touch(entry);
+        return entry.data;
+    }
+
+    entry.data = data;
+    entry.lruPosition = m_lru.insert(m_lru.begin(), mesh);
+    m_usage += data->byteSize;
+    evict(mesh);
+    return data;
+}
+
+void PreparedMeshCache::remove(const CSGPreparedMesh* mesh)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(mesh);
+    if (it == m_entries.end())
+    {
+        return;
+    }
+
+    m_usage -= it->second.sourceSize;
+    if (it->second.data)
+    {
+        m_usage -= it->second.data->byteSize;
+        m_lru.erase(it->second.lruPosition);
+    }
+
+    m_entries.erase(it);
+}
+
+void PreparedMeshCache::setBudget(size_t budgetBytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget = budgetBytes;
+    evict(nullptr);
+}
+
+size_t PreparedMeshCache::getBudget() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_budget;
+}
+
+size_t PreparedMeshCache::getUsage() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_usage;
+}
+
+void PreparedMeshCache::touch(Entry& entry)
+{
+    m_lru.splice(m_lru.begin(), m_lru, entry.lruPosition);
+}
+
+void PreparedMeshCache::evict(const CSGPreparedMesh* keep)
+{
+    // the entry that was just acquired is never evicted, even if it alone exceeds the budget
+    while (m_usage > m_budget && !m_lru.empty() && m_lru.back() != keep)
+    {
+        Entry& entry = m_entries[m_lru.back()];
+        m_usage -= entry.data->byteSize;
+        entry.data.reset();
+        m_lru.pop_back();
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef CARVE_DLL_PREPARED_MESH_H
+#define CARVE_DLL_PREPARED_MESH_H
+
+#include "carve.h"
+
+#include <include/csg.hpp>
+#include <include/matrix.hpp>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// The expensive, reusable part of a CSG operand: the mesh with its face planes, and the STR R-tree over its faces.
+// Once built it is never modified, so it can be shared by any number of concurrent CSG operations.
+struct PreparedMeshData
+{
+    std::unique_ptr<carve::mesh::MeshSet<3>> meshSet;
+    std::unique_ptr<carve::csg::CSG::face_rtree_t> faceTree;
+    size_t byteSize = 0;
+};
+
+// A copy of prepared data moved by a transform. The face R-tree keeps its structure and only has its boxes refitted,
+// which is linear in the number of faces instead of a full STR build.
+std::shared_ptr<const PreparedMeshData> transformPreparedMesh(const PreparedMeshData& data, const carve::math::Matrix& transform);
+
+// Handle returned by leoPrepareCSGMesh. It keeps a copy of the source mesh so that the prepared data can be rebuilt
+// after it has been evicted from the cache.
+class CSGPreparedMesh
+{
+public:
+    explicit CSGPreparedMesh(const CSGMesh& source);
+
+    const CSGMesh& getSource() const;
+    // The memory held by the copy of the source mesh.
+    size_t getSourceSize() const;
+
+private:
+    CSGMesh m_source;
+};
+
+// Owns the prepared data of all live CSGPreparedMesh handles, and keeps their total size within a memory budget by
+// dropping the least recently used entries. The source copies of the handles count towards the budget as well, but they
+// are only released with the handles. Operations that are still using an evicted entry keep it alive until
+// they finish.
+class PreparedMeshCache
+{
+public:
+    static PreparedMeshCache& instance();
+
+    // Returns the prepared data of the mesh, building it if it is not cached.
+    std::shared_ptr<const PreparedMeshData> acquire(const CSGPreparedMesh* mesh);
+    void remove(const CSGPreparedMesh* mesh);
+
+    void setBudget(size_t budgetBytes);
+    size_t getBudget() const;
+    size_t getUsage() const;
+
+private:
+    PreparedMeshCache();
+
+    struct Entry
+    {
+        std::shared_ptr<const PreparedMeshData> data;
+        std::list<const CSGPreparedMesh*>::iterator lruPosition;
+        size_t sourceSize = 0;
+    };
+
+    static std::shared_ptr<const PreparedMeshData> build(const CSGMesh& source);
+    void touch(Entry& entry);
+    void evict(const CSGPreparedMesh* keep);
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<const CSGPreparedMesh*, Entry> m_entries;
+    std::list<const CSGPreparedMesh*> m_lru; // most recently used first, only cached entries
+    size_t m_budget;
+    size_t m_usage;
+};
+
+#endif
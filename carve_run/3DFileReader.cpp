@@ -1,5 +1,6 @@
 
 #include "3DFileReader.h"
+#include <limits>
 #include <../libcarve/include/robin_hood.hpp>
 #include <fstream>
 #include <regex>
@@ -293,7 +294,7 @@ void Mesh::weldVertices()
 
 void StlWriter::writeToFile(const Mesh* mesh, std::string fileName)
 {
-    std::ofstream file(fileName, std::ios::binary, std::ios::trunc);
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
     if (file.fail())
     {
         return;
@@ -347,7 +348,7 @@ void StlWriter::writeToFile(const Mesh* mesh, std::string fileName)
 
 void ObjWriter::writeToFile(const Mesh* mesh, std::string fileName)
 {
-    std::ofstream file(fileName, std::ios::binary, std::ios::trunc);
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
     if (file.fail())
     {
         return;
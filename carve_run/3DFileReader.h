@@ -2,6 +2,7 @@
 #define THREED_FILE_READER_H
 
 #include "../carve/carve.h"
+#include <cmath>
 #include <string>
 #include <vector>
 
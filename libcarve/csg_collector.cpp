@@ -66,9 +66,14 @@ protected:
 
     virtual ~BaseCollector()
     {
+        // faces that were not handed over to a result, e.g. because the computation was cancelled.
+        for (std::list<face_data_t>::iterator i = faces.begin(); i != faces.end(); ++i)
+        {
+            delete (*i).face;
+        }
     }
 
-    void FWD(const carve::mesh::MeshSet<3>::face_t* orig_face, const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& vertices,
+    void FWD(const carve::mesh::MeshSet<3>::face_t* orig_face, const FaceLoop::vertex_list_t& vertices,
              carve::geom3d::Vector /* normal */, bool /* poly_a */, FaceClass face_class, CSG::Hooks& hooks)
     {
         carve::small_vector_on_stack<carve::mesh::MeshSet<3>::face_t*, 16> new_faces;
@@ -87,7 +92,7 @@ protected:
 #endif
     }
 
-    void REV(const carve::mesh::MeshSet<3>::face_t* orig_face, const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& vertices,
+    void REV(const carve::mesh::MeshSet<3>::face_t* orig_face, const FaceLoop::vertex_list_t& vertices,
              carve::geom3d::Vector /* normal */, bool /* poly_a */, FaceClass face_class, CSG::Hooks& hooks)
     {
         // normal = -normal;
@@ -107,7 +112,7 @@ protected:
 #endif
     }
 
-    virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& vertices,
+    virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const FaceLoop::vertex_list_t& vertices,
                          carve::geom3d::Vector normal, bool poly_a, FaceClass face_class, CSG::Hooks& hooks) = 0;
 
     virtual void collect(FaceLoopGroup* grp, CSG::Hooks& hooks)
@@ -184,7 +189,7 @@ protected:
             std::cerr << "group " << grp << " is unclassified!" << std::endl;
 
 #if defined(CARVE_DEBUG_WRITE_PLY_DATA)
-            static int uc_count = 0;
+            static std::atomic<int> uc_count(0);
 
             std::vector<carve::mesh::MeshSet<3>::face_t*> faces;
 
@@ -235,6 +240,9 @@ protected:
             }
         }
 
+        // the faces are owned by p now.
+        faces.clear();
+
         return p;
     }
 };
@@ -256,7 +264,7 @@ public:
             FWD(f->orig_face, f->vertices, f->orig_face->plane.N, f->orig_face->mesh->meshset == src_a, FaceClass::FACE_OUT, hooks);
         }
     }
-    virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& vertices,
+    virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const FaceLoop::vertex_list_t& vertices,
                          carve::geom3d::Vector normal, bool poly_a, FaceClass face_class, CSG::Hooks& hooks)
     {
         FWD(orig_face, vertices, normal, poly_a, face_class, hooks);
@@ -273,7 +281,7 @@ public:
     virtual ~UnionCollector()
     {
     }
-    virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& vertices,
+    virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const FaceLoop::vertex_list_t& vertices,
                          carve::geom3d::Vector normal, bool poly_a, FaceClass face_class, CSG::Hooks& hooks)
     {
         if (face_class == FaceClass::FACE_OUT || (poly_a && face_class == FaceClass::FACE_ON_ORIENT_OUT))
@@ -293,7 +301,7 @@ public:
     virtual ~IntersectionCollector()
     {
     }
-    virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& vertices,
+    virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const FaceLoop::vertex_list_t& vertices,
                          carve::geom3d::Vector normal, bool poly_a, FaceClass face_class, CSG::Hooks& hooks)
     {
         if (face_class == FaceClass::FACE_IN || (poly_a && face_class == FaceClass::FACE_ON_ORIENT_OUT))
@@ -313,7 +321,7 @@ public:
     virtual ~SymmetricDifferenceCollector()
     {
     }
-    virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& vertices,
+    virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const FaceLoop::vertex_list_t& vertices,
                          carve::geom3d::Vector normal, bool poly_a, FaceClass face_class, CSG::Hooks& hooks)
     {
         if (face_class == FaceClass::FACE_OUT)
@@ -337,7 +345,7 @@ public:
     virtual ~AMinusBCollector()
     {
     }
-    virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& vertices,
+    virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const FaceLoop::vertex_list_t& vertices,
                          carve::geom3d::Vector normal, bool poly_a, FaceClass face_class, CSG::Hooks& hooks)
     {
         if ((face_class == FaceClass::FACE_OUT || face_class == FaceClass::FACE_ON_ORIENT_IN) && poly_a)
@@ -361,7 +369,7 @@ public:
     virtual ~BMinusACollector()
     {
     }
-    virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& vertices,
+    virtual void collect(const carve::mesh::MeshSet<3>::face_t* orig_face, const FaceLoop::vertex_list_t& vertices,
                          carve::geom3d::Vector normal, bool poly_a, FaceClass face_class, CSG::Hooks& hooks)
     {
         if ((face_class == FaceClass::FACE_OUT || face_class == FaceClass::FACE_ON_ORIENT_IN) && !poly_a)
@@ -35,8 +35,11 @@ struct carve::csg::detail::Data
     //        * @param[out] emap A mapping from edge pointer to intersection points.
     //        * @param[out] fmap A mapping from face pointer to intersection points.
     //        * @param[out] fmap_rev A mapping from intersection points to face pointers.
-    // map from intersected vertex to intersection point.
-    VVMap vmap;
+    // dense ids of the vertices of the operation, set once the intersections are generated.
+    VertexIds vertex_ids;
+
+    // map from intersected vertex to intersection point, indexed by vertex id. NULL for vertices that are not intersected.
+    std::vector<carve::mesh::MeshSet<3>::vertex_t*> vmap;
 
     // map from intersected edge to intersection points.
     EIntMap emap;
@@ -0,0 +1,160 @@
+// Copyright 2006-2015 Tobias Sargeant (tobias.sargeant@gmail.com).
+//
+// This file is part of the Carve CSG Library (http://carve-csg.com/)
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+namespace carve
+{
+/**
+ * \class Arena
+ * \brief Storage for objects of one type in contiguous blocks that are
+ * released together.
+ *
+ * allocate() hands out uninitialized storage for one object, which the
+ * caller constructs with placement new. The storage is never returned one
+ * object at a time: the blocks are freed when the arena is destroyed,
+ * without running the destructors of the objects in them. Addresses stay
+ * valid for the life of the arena.
+ */
+template <typename T> class Arena
+{
+    struct block_t
+    {
+        T* data;
+        size_t capacity;
+    };
+
+    std::vector<block_t> blocks;
+    size_t used;
+    size_t count;
+    size_t block_size;
+
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+
+    void addBlock(size_t capacity)
+    {
+        block_t block;
+        block.data = std::allocator<T>().allocate(capacity);
+        block.capacity = capacity;
+        blocks.push_back(block);
+        used = 0;
+    }
+
+public:
+    Arena(size_t _block_size = 1024) : used(0), count(0), block_size(_block_size)
+    {
+    }
+
+    ~Arena()
+    {
+        for (size_t i = 0; i < blocks.size(); ++i)
+        {
+            std::allocator<T>().deallocate(blocks[i].data, blocks[i].capacity);
+        }
+    }
+
+    /** \brief Makes room for n more objects in one contiguous block. */
+    void reserve(size_t n)
+    {
+        if (blocks.empty() || blocks.back().capacity - used < n)
+        {
+            addBlock(std::max(n, block_size));
+        }
+    }
+
+    /** \brief Uninitialized storage for one object of type T. */
+    void* allocate()
+    {
+        if (blocks.empty() || used == blocks.back().capacity)
+        {
+            addBlock(block_size);
+        }
+        ++count;
+        return blocks.back().data + used++;
+    }
+
+    /** \brief The number of objects allocated so far. */
+    size_t size() const
+    {
+        return count;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    /** \brief The number of objects that fit in the blocks. */
+    size_t capacity() const
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < blocks.size(); ++i)
+        {
+            total += blocks[i].capacity;
+        }
+        return total;
+    }
+};
+
+/**
+ * \class MemoryArena
+ * \brief Memory for short-lived objects of any type, released all at
+ * once when the arena is destroyed.
+ *
+ * The memory comes from monotonic resources, which do not free anything
+ * before they are destroyed, so the objects in them need not be deleted.
+ * A resource must be used by one thread at a time, so parallel tasks each
+ * take their own with newResource(), which may be called from any thread.
+ */
+class MemoryArena
+{
+    std::mutex mutex;
+    std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>> resources;
+
+    MemoryArena(const MemoryArena&);
+    MemoryArena& operator=(const MemoryArena&);
+
+public:
+    MemoryArena()
+    {
+    }
+
+    /** \brief A new resource, whose first buffer has initial_size bytes. */
+    std::pmr::memory_resource* newResource(size_t initial_size = 4096)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        resources.push_back(std::unique_ptr<std::pmr::monotonic_buffer_resource>(new std::pmr::monotonic_buffer_resource(initial_size)));
+        return resources.back().get();
+    }
+};
+} // namespace carve
@@ -176,14 +176,10 @@ enum class IntersectionClass : int
 };
 
 
-extern double EPSILON;
-extern double EPSILON2;
-
-static inline void setEpsilon(double ep)
-{
-    EPSILON = ep;
-    EPSILON2 = ep * ep;
-}
+/** \brief Tolerance of the geometric tests. It is a constant rather than a setting, so that operations that run at the same
+ *         time cannot change it under each other. */
+constexpr double EPSILON = 1.4901161193847656e-08;
+constexpr double EPSILON2 = EPSILON * EPSILON;
 
 
 struct hash_pair
@@ -192,7 +188,7 @@ struct hash_pair
     {
         size_t r = std::hash<typename pair_t::first_type>{}(pair.first);
         size_t s = std::hash<typename pair_t::second_type>()(pair.second);
-        return r ^ ((s >> 16) | (s << 16));
+        return robin_hood::hash_int(r) ^ s;
     }
 };
 
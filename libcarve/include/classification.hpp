@@ -152,7 +152,5 @@ struct PC2
 typedef carve::unordered_flat_map<std::pair<const carve::mesh::MeshSet<3>::vertex_t*, const carve::mesh::MeshSet<3>::vertex_t*>, EC2, hash_pair>
     EdgeClassification;
 
-typedef carve::unordered_flat_map<const carve::mesh::Vertex<3>*, PC2> VertexClassification;
-
 } // namespace csg
 } // namespace carve
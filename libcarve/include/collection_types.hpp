@@ -61,6 +61,5 @@ typedef carve::unordered_flat_set<V2, hash_pair> V2Set;
 // lib/csg_collector.cpp lib/intersect.cpp
 // lib/intersect_common.hpp lib/intersect_face_division.cpp
 // lib/polyhedron.cpp
-typedef carve::unordered_flat_map<carve::mesh::MeshSet<3>::vertex_t*, carve::mesh::MeshSet<3>::vertex_t*> VVMap;
 } // namespace csg
 } // namespace carve
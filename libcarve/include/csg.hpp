@@ -27,6 +27,7 @@
 
 #include <algorithm>
 #include <list>
+#include <mutex>
 #include <vector>
 
 #include <include/carve.hpp>
@@ -35,12 +36,14 @@
 
 #include <include/mesh.hpp>
 
+#include <include/arena.hpp>
 #include <include/classification.hpp>
 #include <include/collection_types.hpp>
 #include <include/faceloop.hpp>
 #include <include/intersection.hpp>
 #include <include/iobj.hpp>
 #include <include/rtree.hpp>
+#include <include/thread_pool.hpp>
 
 namespace carve
 {
@@ -60,10 +63,89 @@ public:
     vertex_t* get(const vertex_t::vector_t& v = vertex_t::vector_t::ZERO());
     bool inPool(vertex_t* v) const;
 
+    /** \brief The number of vertices made since the last reset. */
+    size_t size() const;
+
+    /** \brief Appends the first vertex of each block, with its position in the pool, to blocks. */
+    void getBlocks(std::vector<std::pair<const vertex_t*, size_t>>& blocks) const;
+
     VertexPool();
     ~VertexPool();
 };
 
+/**
+ * \brief Dense ids for the vertices that take part in an operation.
+ *
+ * The vertices of a come first, then those of b, then the vertices of
+ * the vertex pool in the order they were made. The pool must not grow
+ * while the ids are in use, which holds once the intersections have
+ * been generated.
+ */
+class VertexIds
+{
+    typedef carve::mesh::MeshSet<3>::vertex_t vertex_t;
+
+    const vertex_t* a_base;
+    size_t a_count;
+    const vertex_t* b_base;
+    size_t b_count;
+    // the blocks of the pool sorted by address, with the id of their first vertex.
+    std::vector<std::pair<const vertex_t*, size_t>> pool_blocks;
+    size_t count;
+
+    size_t poolId(const vertex_t* v) const;
+
+public:
+    VertexIds();
+    VertexIds(const carve::mesh::MeshSet<3>* a, const carve::mesh::MeshSet<3>* b, const VertexPool& pool);
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    size_t id(const vertex_t* v) const
+    {
+        if (v >= a_base && v < a_base + a_count)
+        {
+            return (size_t)(v - a_base);
+        }
+        if (v >= b_base && v < b_base + b_count)
+        {
+            return a_count + (size_t)(v - b_base);
+        }
+        return poolId(v);
+    }
+};
+
+/**
+ * \brief The classes of the vertices of an operation with respect to a
+ * and b, indexed by their VertexIds. Vertices that are not classified
+ * are POINT_UNK with respect to both.
+ */
+class VertexClassification
+{
+    VertexIds ids;
+    std::vector<PC2> classes;
+
+public:
+    void init(const VertexIds& _ids)
+    {
+        ids = _ids;
+        classes.assign(ids.size(), PC2());
+    }
+
+    PC2& operator[](const carve::mesh::MeshSet<3>::vertex_t* v)
+    {
+        return classes[ids.id(v)];
+    }
+
+    const PC2& operator[](const carve::mesh::MeshSet<3>::vertex_t* v) const
+    {
+        return classes[ids.id(v)];
+    }
+};
+
 
 namespace detail
 {
@@ -71,6 +153,63 @@ struct Data;
 class LoopEdges;
 } // namespace detail
 
+/**
+ * \brief Thrown by a CSG computation that a progress hook cancelled.
+ */
+struct operation_cancelled : public carve::exception
+{
+    operation_cancelled() : carve::exception("operation cancelled")
+    {
+    }
+};
+
+/**
+ * \brief Time spent in the phases of CSG computations, and the sizes of
+ * their intermediate results.
+ *
+ * Filled by CSG::compute() when CSG::Hooks::stats points to it. Times
+ * are wall clock seconds, and add up over all computations that use the
+ * same object. Output faces are triangulated while they are collected
+ * by the collector, so the triangulation time is also part of the
+ * collection time. As faces are triangulated one at a time by several
+ * threads, the TRIANGULATION time is the sum of the time of each
+ * thread rather than wall clock time.
+ * Steps of a phase that run at the same time count once, and each step
+ * is also recorded as a span.
+ */
+struct Stats
+{
+    enum Phase
+    {
+        RTREE_BUILD,
+        CANDIDATES,
+        INTERSECTIONS,
+        FACE_LOOPS,
+        GROUPING,
+        CLASSIFICATION,
+        TRIANGULATION,
+        COLLECTION,
+        PHASE_MAX
+    };
+
+    double seconds[PHASE_MAX];
+
+    size_t face_pairs; // pairs of faces with overlapping bounding boxes
+    size_t intersection_vertices;
+    size_t face_loops;
+    size_t groups;
+    size_t classification_rays;
+
+    std::vector<carve::util::TaskGraph::Span> spans; // the steps of the computations, relative to the start of their computation
+
+    Stats()
+    {
+        reset();
+    }
+
+    void reset();
+};
+
 /**
  * \class CSG
  * \brief The class responsible for the computation of CSG operations.
@@ -81,6 +220,7 @@ class CSG
 private:
 public:
     typedef carve::mesh::MeshSet<3> meshset_t;
+    typedef carve::geom::RTreeNode<3, carve::mesh::Face<3>*> face_rtree_t;
 
     struct Hook
     {
@@ -106,6 +246,14 @@ public:
                                   const meshset_t::vertex_t* /* v2 */)
         {
         }
+        // Called between phases and periodically inside long loops with
+        // the estimated fraction of the computation that is done.
+        // Returning false cancels the computation, which then throws
+        // carve::csg::operation_cancelled.
+        virtual bool progress(double /* fraction */)
+        {
+            return true;
+        }
 
         virtual ~Hook()
         {
@@ -126,16 +274,27 @@ public:
             PROCESS_OUTPUT_FACE_HOOK = 1,
             INTERSECTION_VERTEX_HOOK = 2,
             EDGE_DIVISION_HOOK = 3,
-            HOOK_MAX = 4,
+            PROGRESS_HOOK = 4,
+            HOOK_MAX = 5,
 
             RESULT_FACE_BIT = 0x0001,
             PROCESS_OUTPUT_FACE_BIT = 0x0002,
             INTERSECTION_VERTEX_BIT = 0x0004,
-            EDGE_DIVISION_BIT = 0x0008
+            EDGE_DIVISION_BIT = 0x0008,
+            PROGRESS_BIT = 0x0010
         };
 
         std::vector<std::list<Hook*>> hooks;
 
+        // Receives the statistics of the computation if not NULL. Not owned.
+        Stats* stats;
+
+        // The counter of classification rays of the statistics, NULL if there are none.
+        size_t* rayCounter() const
+        {
+            return stats != NULL ? &stats->classification_rays : NULL;
+        }
+
         bool hasHook(unsigned hook_num);
 
         void intersectionVertex(const meshset_t::vertex_t* vertex, const IObjPairSet& intersections);
@@ -148,6 +307,13 @@ public:
 
         void edgeDivision(const meshset_t::edge_t* orig_edge, size_t orig_edge_idx, const meshset_t::vertex_t* v1, const meshset_t::vertex_t* v2);
 
+        // Throws operation_cancelled if any progress hook returns false. May be called from several
+        // threads; the hooks are called one at a time and never see the fraction go down.
+        void progress(double fraction);
+
+        // Lets the fraction start again from 0, for the next computation.
+        void resetProgress();
+
         void registerHook(Hook* hook, unsigned hook_bits);
         void unregisterHook(Hook* hook);
 
@@ -155,6 +321,27 @@ public:
 
         Hooks();
         ~Hooks();
+
+    private:
+        std::mutex progress_mutex;
+        double progress_reached;
+    };
+
+    /**
+     * \brief A fragment of a divided edge, found while generating face
+     * loops and delivered to the edge division hooks afterwards.
+     */
+    struct EdgeDivision
+    {
+        const meshset_t::edge_t* orig_edge;
+        size_t orig_edge_idx;
+        const meshset_t::vertex_t* v1;
+        const meshset_t::vertex_t* v2;
+
+        EdgeDivision(const meshset_t::edge_t* _orig_edge, size_t _orig_edge_idx, const meshset_t::vertex_t* _v1, const meshset_t::vertex_t* _v2)
+            : orig_edge(_orig_edge), orig_edge_idx(_orig_edge_idx), v1(_v1), v2(_v2)
+        {
+        }
     };
 
     /**
@@ -181,8 +368,45 @@ public:
     };
 
 private:
-    typedef carve::geom::RTreeNode<3, carve::mesh::Face<3>*> face_rtree_t;
-    typedef carve::unordered_map<carve::mesh::Face<3>*, std::vector<carve::mesh::Face<3>*>> face_pairs_t;
+    /**
+     * \brief The faces that may intersect each face, as compressed rows.
+     *
+     * The faces that may intersect faces[i] are partners[offsets[i]] up
+     * to partners[offsets[i + 1]]. The rows of the faces of a come
+     * first, then those of b, both ordered by face id.
+     */
+    struct FacePairs
+    {
+        std::vector<carve::mesh::Face<3>*> faces;
+        std::vector<size_t> offsets;
+        std::vector<carve::mesh::Face<3>*> partners;
+
+        size_t size() const
+        {
+            return faces.size();
+        }
+    };
+
+    /**
+     * \brief An intersection that a pass of generateIntersections() has
+     * found, and that is recorded once all the faces of the pass are
+     * done. The pair of object types tells the kind of intersection.
+     */
+    struct IntersectionCandidate
+    {
+        IObj a;
+        IObj b;
+        meshset_t::vertex_t* vertex;           // the intersection point, NULL if it is a new vertex at point
+        meshset_t::vertex_t::vector_t point;
+
+        IntersectionCandidate(const IObj& _a, const IObj& _b, meshset_t::vertex_t* _vertex) : a(_a), b(_b), vertex(_vertex), point()
+        {
+        }
+        IntersectionCandidate(const IObj& _a, const IObj& _b, const meshset_t::vertex_t::vector_t& _point) : a(_a), b(_b), vertex(NULL), point(_point)
+        {
+        }
+    };
+    typedef std::vector<IntersectionCandidate> candidates_t;
 
     /// The computed intersection data.
     Intersections intersections;
@@ -201,23 +425,72 @@ private:
 
     void groupIntersections();
 
-    void _generateVertexVertexIntersections(meshset_t::vertex_t* va, meshset_t::edge_t* eb);
-    void generateVertexVertexIntersections(meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b);
+    // The passes of generateIntersections(). They only read the intersections of the earlier passes, so that the faces of a
+    // pass can be handled in parallel, and add what they find to out.
+    typedef meshset_t::face_t* const* face_range_t;
 
-    void _generateVertexEdgeIntersections(meshset_t::vertex_t* va, meshset_t::edge_t* eb);
-    void generateVertexEdgeIntersections(meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b);
+    void _generateVertexVertexIntersections(meshset_t::vertex_t* va, meshset_t::edge_t* eb, candidates_t& out) const;
+    void generateVertexVertexIntersections(meshset_t::face_t* a, face_range_t b_begin, face_range_t b_end, candidates_t& out) const;
 
-    void _generateEdgeEdgeIntersections(meshset_t::edge_t* ea, meshset_t::edge_t* eb);
-    void generateEdgeEdgeIntersections(meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b);
+    void _generateVertexEdgeIntersections(meshset_t::vertex_t* va, meshset_t::edge_t* eb, candidates_t& out) const;
+    void generateVertexEdgeIntersections(meshset_t::face_t* a, face_range_t b_begin, face_range_t b_end, candidates_t& out) const;
 
-    void _generateVertexFaceIntersections(meshset_t::face_t* fa, meshset_t::edge_t* eb);
-    void generateVertexFaceIntersections(meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b);
+    void _generateEdgeEdgeIntersections(meshset_t::edge_t* ea, meshset_t::edge_t* eb, candidates_t& out) const;
+    void generateEdgeEdgeIntersections(meshset_t::face_t* a, face_range_t b_begin, face_range_t b_end, candidates_t& out) const;
 
-    void _generateEdgeFaceIntersections(meshset_t::face_t* fa, meshset_t::edge_t* eb);
-    void generateEdgeFaceIntersections(meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b);
+    void _generateVertexFaceIntersections(meshset_t::face_t* fa, meshset_t::edge_t* eb, candidates_t& out) const;
+    void generateVertexFaceIntersections(meshset_t::face_t* a, face_range_t b_begin, face_range_t b_end, candidates_t& out) const;
+
+    void _generateEdgeFaceIntersections(meshset_t::face_t* fa, meshset_t::edge_t* eb, candidates_t& out) const;
+    void generateEdgeFaceIntersections(meshset_t::face_t* a, face_range_t b_begin, face_range_t b_end, candidates_t& out) const;
+
+    /**
+     * \brief Records a candidate of a pass, unless an intersection
+     * recorded earlier in the same pass already covers it. Candidates
+     * are recorded in the order in which the faces were visited.
+     */
+    void recordIntersection(const IntersectionCandidate& candidate);
+
+    /**
+     * \brief A pair of R-tree nodes of a and b whose faces are paired up
+     * by one task of collectIntersectionCandidates.
+     */
+    struct CandidateTask
+    {
+        const face_rtree_t* a_node;
+        const face_rtree_t* b_node;
+        bool descend_a;
+
+        CandidateTask(const face_rtree_t* _a_node, const face_rtree_t* _b_node, bool _descend_a)
+            : a_node(_a_node), b_node(_b_node), descend_a(_descend_a)
+        {
+        }
+    };
+
+    /**
+     * \brief Replaces the tasks by the pairs of child nodes that the
+     * traversal would visit, level by level, until there are at least
+     * min_tasks of them or only pairs of leaves are left. The tasks stay
+     * in the order of the serial traversal.
+     */
+    static void splitCandidateTasks(std::vector<CandidateTask>& tasks, size_t min_tasks);
+
+    static void generateIntersectionCandidates(const face_rtree_t* a_node, const face_rtree_t* b_node,
+                                               std::vector<std::pair<meshset_t::face_t*, meshset_t::face_t*>>& face_pairs, bool descend_a = true);
+
+    /**
+     * \brief Finds the pairs of faces of a and b that may intersect, by
+     * traversing the two R-trees in parallel tasks. The pairs are in the
+     * order of a serial traversal.
+     */
+    static void collectIntersectionCandidates(const face_rtree_t* a_rtree, const face_rtree_t* b_rtree,
+                                              std::vector<std::pair<meshset_t::face_t*, meshset_t::face_t*>>& face_pairs);
+
+    /**
+     * \brief Sorts the pairs of faces of a and b that may intersect into rows.
+     */
+    static void makeFacePairs(meshset_t* a, const std::vector<std::pair<meshset_t::face_t*, meshset_t::face_t*>>& pairs, FacePairs& face_pairs);
 
-    void generateIntersectionCandidates(meshset_t* a, const face_rtree_t* a_node, meshset_t* b, const face_rtree_t* b_node, face_pairs_t& face_pairs,
-                                        bool descend_a = true);
     /**
      * \brief Compute all points of intersection between poly \a a and poly \a b
      *
@@ -255,7 +528,13 @@ private:
     friend void classifyEasyFaces(FaceLoopList& face_loops, VertexClassification& vclass, meshset_t* other_poly, int other_poly_num, CSG& csg,
                                   CSG::Collector& collector);
 
-    size_t generateFaceLoops(meshset_t* poly, const detail::Data& data, FaceLoopList& face_loops_out);
+    /**
+     * \brief Generate the face loops of the faces of \a poly, which are allocated in \a loop_memory.
+     *
+     * @return The number of edges of the generated loops.
+     */
+    size_t generateFaceLoops(meshset_t* poly, const detail::Data& data, carve::MemoryArena& loop_memory, FaceLoopList& face_loops_out,
+                             std::vector<EdgeDivision>& edge_divisions, double progress_begin, double progress_end);
 
 
     // intersect_group.cpp
@@ -350,6 +629,12 @@ private:
 
     // intersect.cpp
 
+    /**
+     * \brief Marks the vertices of both polyhedra as on their own
+     * polyhedron, and the intersection vertices as on both.
+     */
+    void initVertexClassification(meshset_t* a, meshset_t* b, const detail::Data& data, VertexClassification& vclass);
+
     /**
      * \brief The main calculation method for CSG.
      *
@@ -357,13 +642,14 @@ private:
      * @param[in] b Polyhedron b
      * @param[out] vclass
      * @param[out] eclass
+     * @param[in] loop_memory The memory of the face loops, which must outlive them.
      * @param[out] a_face_loops
      * @param[out] b_face_loops
      * @param[out] a_edge_count
      * @param[out] b_edge_count
      */
     void calc(meshset_t* a, const face_rtree_t* a_rtree, meshset_t* b, const face_rtree_t* b_rtree, VertexClassification& vclass, EdgeClassification& eclass,
-              FaceLoopList& a_face_loops, FaceLoopList& b_face_loops, size_t& a_edge_count, size_t& b_edge_count);
+              carve::MemoryArena& loop_memory, FaceLoopList& a_face_loops, FaceLoopList& b_face_loops, size_t& a_edge_count, size_t& b_edge_count);
 
 public:
     /**
@@ -409,6 +695,26 @@ public:
     meshset_t* compute(meshset_t* a, meshset_t* b, CSG::Collector& collector, V2Set* shared_edges = NULL,
                        CLASSIFY_TYPE classify_type = CLASSIFY_TYPE::CLASSIFY_NORMAL);
 
+    /**
+     * \brief Compute a CSG operation between two polyhedra, \a a and \a b,
+     * reusing face R-trees that were built in advance.
+     *
+     * The meshes and R-trees are only read, so a prepared mesh and its
+     * R-tree may be shared between several concurrent computations.
+     *
+     * @param a Polyhedron a
+     * @param a_rtree An R-tree over the faces of \a a, or NULL to build one.
+     * @param b Polyhedron b
+     * @param b_rtree An R-tree over the faces of \a b, or NULL to build one.
+     * @param collector The collector (determines the CSG operation performed)
+     * @param shared_edges A pointer to a set that will be populated with shared edges (if not NULL).
+     * @param classify_type The type of classifier to use.
+     *
+     * @return
+     */
+    meshset_t* compute(meshset_t* a, const face_rtree_t* a_rtree, meshset_t* b, const face_rtree_t* b_rtree, CSG::Collector& collector,
+                       V2Set* shared_edges = NULL, CLASSIFY_TYPE classify_type = CLASSIFY_TYPE::CLASSIFY_NORMAL);
+
     /**
      * \brief Compute a CSG operation between two closed polyhedra, \a a and \a b.
      *
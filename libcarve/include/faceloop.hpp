@@ -29,6 +29,9 @@
 #include <include/classification.hpp>
 #include <include/collection_types.hpp>
 
+#include <memory_resource>
+#include <vector>
+
 namespace carve
 {
 namespace csg
@@ -36,15 +39,20 @@ namespace csg
 
 struct FaceLoopGroup;
 
+// Face loops and their vertices live in the memory of the operation
+// that generates them (see CSG::generateFaceLoops), and are released
+// with it, never one by one.
 struct FaceLoop
 {
+    typedef std::pmr::vector<carve::mesh::MeshSet<3>::vertex_t*> vertex_list_t;
+
     FaceLoop *next, *prev;
     const carve::mesh::MeshSet<3>::face_t* orig_face;
-    std::vector<carve::mesh::MeshSet<3>::vertex_t*> vertices;
+    vertex_list_t vertices;
     FaceLoopGroup* group;
 
-    FaceLoop(const carve::mesh::MeshSet<3>::face_t* f, const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& v)
-        : next(NULL), prev(NULL), orig_face(f), vertices(v), group(NULL)
+    FaceLoop(const carve::mesh::MeshSet<3>::face_t* f, const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& v, std::pmr::memory_resource* memory)
+        : next(NULL), prev(NULL), orig_face(f), vertices(v.begin(), v.end(), memory), group(NULL)
     {
     }
 };
@@ -132,6 +140,22 @@ struct FaceLoopList
         count++;
     }
 
+    // Moves the loops of list to the end of this list.
+    void splice(FaceLoopList& list)
+    {
+        if (!list.head)
+            return;
+        list.head->prev = tail;
+        if (tail)
+            tail->next = list.head;
+        else
+            head = list.head;
+        tail = list.tail;
+        count += list.count;
+        list.head = list.tail = NULL;
+        list.count = 0;
+    }
+
     unsigned size() const
     {
         return count;
@@ -171,16 +195,6 @@ struct FaceLoopList
         return r;
     }
 
-    ~FaceLoopList()
-    {
-        FaceLoop *a = head, *b;
-        while (a)
-        {
-            b = a;
-            a = a->next;
-            delete b;
-        }
-    }
 };
 
 struct FaceLoopGroup
@@ -25,10 +25,13 @@
 
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <map>
 #include <string>
 
 #include <include/carve.hpp>
+#include <include/matrix.hpp>
 #include <include/mesh.hpp>
 #include <include/pointset.hpp>
 #include <include/poly.hpp>
@@ -227,6 +230,173 @@ struct PolyhedronData : public VertexData
 };
 
 
+/**
+ * \brief Indexed triangles that are read in place from caller
+ * buffers. Each vertex is three consecutive components of
+ * vertex_type, and consecutive vertices start vertex_stride bytes
+ * apart, so positions may be interleaved with other attributes. The
+ * same applies to the three indices of each triangle. A stride of 0
+ * means tightly packed. The buffers are only borrowed, and must stay
+ * valid until createMesh() returns. A transform is applied while the
+ * vertices are read, and triangles are flipped if it mirrors.
+ */
+struct StridedTriangleData : public Data
+{
+    enum class Type
+    {
+        FLOAT32,
+        FLOAT64,
+        INT16, /**< Read as unsigned when used for indices. */
+        INT32
+    };
+
+    const void* vertices;
+    size_t vertex_count;
+    size_t vertex_stride;
+    Type vertex_type;
+
+    const void* triangles;
+    size_t triangle_count;
+    size_t triangle_stride;
+    Type index_type;
+
+    carve::math::Matrix transform_matrix;
+    bool transformed;
+    // whether transform_matrix turns the triangles inside out, set with it.
+    bool mirrored;
+
+    StridedTriangleData()
+        : Data(), vertices(NULL), vertex_count(0), vertex_stride(0), vertex_type(Type::FLOAT32), triangles(NULL), triangle_count(0),
+          triangle_stride(0), index_type(Type::INT32), transform_matrix(carve::math::Matrix::IDENT()), transformed(false), mirrored(false)
+    {
+    }
+
+    virtual ~StridedTriangleData()
+    {
+    }
+
+    virtual void transform(const carve::math::Matrix& transform)
+    {
+        transform_matrix = transform * transform_matrix;
+        transformed = true;
+        mirrored = carve::math::linearDeterminant(transform_matrix) < 0.0;
+    }
+
+    static size_t typeSize(Type type)
+    {
+        switch (type)
+        {
+        case Type::FLOAT32:
+            return sizeof(float);
+        case Type::FLOAT64:
+            return sizeof(double);
+        case Type::INT16:
+            return sizeof(int16_t);
+        case Type::INT32:
+            return sizeof(int32_t);
+        }
+        return 0;
+    }
+
+    carve::geom3d::Vector getVertex(size_t index) const
+    {
+        const size_t component_size = typeSize(vertex_type);
+        const size_t stride = vertex_stride ? vertex_stride : 3 * component_size;
+        const unsigned char* ptr = static_cast<const unsigned char*>(vertices) + index * stride;
+        carve::geom3d::Vector v = carve::geom::VECTOR(readComponent(ptr, vertex_type), readComponent(ptr + component_size, vertex_type),
+                                                      readComponent(ptr + 2 * component_size, vertex_type));
+        if (transformed)
+        {
+            v *= transform_matrix;
+        }
+        return v;
+    }
+
+    void getTriangle(size_t index, size_t v[3]) const
+    {
+        const size_t index_size = typeSize(index_type);
+        const size_t stride = triangle_stride ? triangle_stride : 3 * index_size;
+        const unsigned char* ptr = static_cast<const unsigned char*>(triangles) + index * stride;
+        for (size_t i = 0; i < 3; ++i)
+        {
+            v[i] = readIndex(ptr + i * index_size, index_type);
+        }
+        if (mirrored)
+        {
+            std::swap(v[1], v[2]);
+        }
+    }
+
+    carve::mesh::MeshSet<3>* createMesh(const Options& options) const
+    {
+        if (index_type != Type::INT16 && index_type != Type::INT32)
+        {
+            throw carve::exception("triangle indices must be 16 or 32 bit integers");
+        }
+
+        Options::const_iterator i;
+        carve::mesh::MeshOptions opts;
+        i = options.find("avoid_cavities");
+        if (i != options.end())
+        {
+            opts.avoid_cavities(_bool((*i).second));
+        }
+        return new carve::mesh::MeshSet<3>(
+            vertex_count, [this](size_t index) { return getVertex(index); }, triangle_count,
+            [this](size_t index, size_t v[3]) { getTriangle(index, v); }, opts);
+    }
+
+private:
+    // The buffers may not be aligned for their element type, so elements are read with memcpy.
+    static double readComponent(const unsigned char* ptr, Type type)
+    {
+        switch (type)
+        {
+        case Type::FLOAT32:
+        {
+            float value;
+            memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+        case Type::FLOAT64:
+        {
+            double value;
+            memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+        case Type::INT16:
+        {
+            int16_t value;
+            memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+        case Type::INT32:
+        {
+            int32_t value;
+            memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+        }
+        return 0.0;
+    }
+
+    static size_t readIndex(const unsigned char* ptr, Type type)
+    {
+        if (type == Type::INT16)
+        {
+            uint16_t value;
+            memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+
+        int32_t value;
+        memcpy(&value, ptr, sizeof(value));
+        // negative indices become huge and are rejected as out of range
+        return value < 0 ? ~(size_t)0 : (size_t)value;
+    }
+};
+
+
 struct PolylineSetData : public VertexData
 {
     typedef std::pair<bool, std::vector<int>> polyline_data_t;
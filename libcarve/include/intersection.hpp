@@ -29,6 +29,10 @@
 #include <include/collection_types.hpp>
 #include <include/iobj.hpp>
 
+#include <cstdint>
+#include <limits>
+#include <vector>
+
 namespace carve
 {
 namespace csg
@@ -38,19 +42,113 @@ namespace csg
  * \class Intersections
  * \brief Storage for computed intersections between vertices, edges and faces.
  *
+ * Each intersection is kept as two records, one for each direction,
+ * in a flat array in the order they were recorded. The records of an
+ * object form a chain through the array, and an open addressing table
+ * maps each object to the head of its chain, so that the queries only
+ * touch a few contiguous slots and records. The queries are const and
+ * may run concurrently, as long as nothing is recorded meanwhile.
  */
-struct Intersections : public carve::unordered_map<IObj, IObjVMapSmall, IObj_hash>
+struct Intersections
 {
     typedef carve::mesh::MeshSet<3>::vertex_t vertex_t;
     typedef carve::mesh::MeshSet<3>::edge_t edge_t;
     typedef carve::mesh::MeshSet<3>::face_t face_t;
 
-    typedef carve::unordered_map<IObj, IObjVMapSmall, IObj_hash> super;
+    typedef uint32_t index_t;
+    static constexpr index_t NONE = std::numeric_limits<index_t>::max();
+
+    /**
+     * \brief One direction of an intersection: \a obj meets \a other at \a vertex.
+     */
+    struct Record
+    {
+        IObj obj;
+        IObj other;
+        vertex_t* vertex;
+        // the next record of obj, or NONE.
+        index_t next;
+    };
+
+private:
+    struct Slot
+    {
+        // OBTYPE_NONE for an empty slot.
+        IObj obj;
+        index_t head;
+    };
+
+    std::vector<Record> records;
+    std::vector<Slot> slots;
+    size_t n_objs;
+    unsigned shift;
+
+    size_t slotIndex(const IObj& obj) const
+    {
+        // Fibonacci hashing, as the low bits of the pointers are mostly zero.
+        return (size_t)(((uint64_t)obj.val * UINT64_C(0x9E3779B97F4A7C15)) >> shift);
+    }
+
+    // The slot of obj, or the empty slot where it would go.
+    size_t findSlot(const IObj& obj) const
+    {
+        const size_t mask = slots.size() - 1;
+        size_t i = slotIndex(obj);
+        while (slots[i].obj.obtype != IObj::ObjectType::OBTYPE_NONE && slots[i].obj != obj)
+        {
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    void rehash(size_t n_slots);
+    void set(const IObj& a, const IObj& b, vertex_t* p);
+
+public:
+    Intersections();
 
     ~Intersections()
     {
     }
 
+    /**
+     * \brief The first record of \a obj, or NONE if it has no intersections.
+     */
+    index_t first(const IObj& obj) const
+    {
+        if (slots.empty())
+            return NONE;
+        return slots[findSlot(obj)].head;
+    }
+
+    const Record& operator[](index_t i) const
+    {
+        return records[i];
+    }
+
+    /**
+     * \brief All the records, in the order they were recorded.
+     */
+    const std::vector<Record>& all() const
+    {
+        return records;
+    }
+
+    size_t size() const
+    {
+        return records.size();
+    }
+
+    bool empty() const
+    {
+        return records.empty();
+    }
+
+    /**
+     * \brief Reserve space for \a n recorded intersections.
+     */
+    void reserve(size_t n);
+
     /**
      * \brief Record the position of intersection between a pair of intersection objects.
      *
@@ -62,8 +160,8 @@ struct Intersections : public carve::unordered_map<IObj, IObjVMapSmall, IObj_has
     {
         if (a > b)
             std::swap(a, b);
-        (*this)[a][b] = p;
-        (*this)[b][a] = p;
+        set(a, b, p);
+        set(b, a, p);
     }
 
     /**
@@ -95,12 +193,14 @@ struct Intersections : public carve::unordered_map<IObj, IObjVMapSmall, IObj_has
      *
      * @return true, if \a a and \a b intersect.
      */
-    bool intersectsExactly(const IObj& a, const IObj& b)
+    bool intersectsExactly(const IObj& a, const IObj& b) const
     {
-        Intersections::const_iterator i = find(a);
-        if (i == end())
-            return false;
-        return i->second.find(b) != i->second.end();
+        for (index_t i = first(a); i != NONE; i = records[i].next)
+        {
+            if (records[i].other == b)
+                return true;
+        }
+        return false;
     }
 
     /**
@@ -111,14 +211,9 @@ struct Intersections : public carve::unordered_map<IObj, IObjVMapSmall, IObj_has
      *
      * @return true, if \a a and \a v intersect.
      */
-    bool intersects(const IObj& a, vertex_t* v)
+    bool intersects(const IObj& a, vertex_t* v) const
     {
-        Intersections::const_iterator i = find(a);
-        if (i == end())
-            return false;
-        if (i->second.find(v) != i->second.end())
-            return true;
-        return false;
+        return intersectsExactly(a, IObj(v));
     }
 
     /**
@@ -130,14 +225,11 @@ struct Intersections : public carve::unordered_map<IObj, IObjVMapSmall, IObj_has
      * @return true, if \a a and \a e intersect (either on the edge,
      *         or at either endpoint).
      */
-    bool intersects(const IObj& a, edge_t* e)
+    bool intersects(const IObj& a, edge_t* e) const
     {
-        Intersections::const_iterator i = find(a);
-        if (i == end())
-            return false;
-        for (super::mapped_type::const_iterator j = i->second.begin(); j != i->second.end(); ++j)
+        for (index_t i = first(a); i != NONE; i = records[i].next)
         {
-            const IObj& obj = j->first;
+            const IObj& obj = records[i].other;
             switch (obj.obtype)
             {
             case IObj::ObjectType::OBTYPE_VERTEX:
@@ -164,22 +256,36 @@ struct Intersections : public carve::unordered_map<IObj, IObjVMapSmall, IObj_has
      * @return true, if \a a and \a f intersect (either on the face,
      *         or at any associated edge or vertex).
      */
-    bool intersects(const IObj& a, face_t* f)
+    bool intersects(const IObj& a, face_t* f) const
     {
-        Intersections::const_iterator i = find(a);
-        if (i == end())
-            return false;
-        if (i->second.find(f) != i->second.end())
-            return true;
-        edge_t* e = f->edge;
-        do
+        for (index_t i = first(a); i != NONE; i = records[i].next)
         {
-            if (i->second.find(e) != i->second.end())
-                return true;
-            if (i->second.find(e->vert) != i->second.end())
-                return true;
-            e = e->next;
-        } while (e != f->edge);
+            const IObj& obj = records[i].other;
+            switch (obj.obtype)
+            {
+            case IObj::ObjectType::OBTYPE_FACE:
+                if (obj.face == f)
+                    return true;
+                break;
+            case IObj::ObjectType::OBTYPE_EDGE:
+                if (obj.edge->face == f)
+                    return true;
+                break;
+            case IObj::ObjectType::OBTYPE_VERTEX:
+            {
+                edge_t* e = f->edge;
+                do
+                {
+                    if (obj.vertex == e->vert)
+                        return true;
+                    e = e->next;
+                } while (e != f->edge);
+                break;
+            }
+            default:
+                break;
+            }
+        }
         return false;
     }
 
@@ -191,7 +297,7 @@ struct Intersections : public carve::unordered_map<IObj, IObjVMapSmall, IObj_has
      *
      * @return true, if \a e and \a f intersect.
      */
-    bool intersects(edge_t* e1, edge_t* e2)
+    bool intersects(edge_t* e1, edge_t* e2) const
     {
         if (intersects(e1->v1(), e2) || intersects(e1->v2(), e2) || intersects(IObj(e1), e2))
             return true;
@@ -206,7 +312,7 @@ struct Intersections : public carve::unordered_map<IObj, IObjVMapSmall, IObj_has
      *
      * @return true, if \a e and \a f intersect.
      */
-    bool intersects(edge_t* e, face_t* f)
+    bool intersects(edge_t* e, face_t* f) const
     {
         if (intersects(e->v1(), f) || intersects(e->v2(), f) || intersects(IObj(e), f))
             return true;
@@ -293,10 +399,7 @@ struct Intersections : public carve::unordered_map<IObj, IObjVMapSmall, IObj_has
         std::copy(ifaces.begin(), ifaces.end(), set_inserter(result));
     }
 
-    void clear()
-    {
-        super::clear();
-    }
+    void clear();
 };
 
 } // namespace csg
@@ -267,6 +267,11 @@ static inline bool operator!=(const Matrix& A, const Matrix& B)
 {
     return !(A == B);
 }
+// Determinant of the linear (upper left 3x3) part, negative for transforms that mirror.
+static inline double linearDeterminant(const Matrix& A)
+{
+    return A._11 * (A._22 * A._33 - A._32 * A._23) - A._21 * (A._12 * A._33 - A._32 * A._13) + A._31 * (A._12 * A._23 - A._22 * A._13);
+}
 static inline carve::geom::vector<3> operator*(const Matrix& A, const carve::geom::vector<3>& b)
 {
     return carve::geom::VECTOR(A._11 * b.x + A._21 * b.y + A._31 * b.z + A._41, A._12 * b.x + A._22 * b.y + A._32 * b.z + A._42,
@@ -28,6 +28,7 @@
 #include <include/carve.hpp>
 
 #include <include/aabb.hpp>
+#include <include/arena.hpp>
 #include <include/djset.hpp>
 #include <include/geom.hpp>
 #include <include/geom3d.hpp>
@@ -35,6 +36,7 @@
 #include <include/tag.hpp>
 
 #include <iostream>
+#include <new>
 
 namespace carve
 {
@@ -100,19 +102,21 @@ public:
 };
 
 
+// The first address is mixed before it is combined with the second one. Combining the raw addresses of vertices that
+// are stored next to each other produces many equal hashes, which makes the flat maps give up with an overflow error.
 struct hash_vertex_pair
 {
     template <unsigned ndim> size_t operator()(const std::pair<Vertex<ndim>*, Vertex<ndim>*>& pair) const
     {
         size_t r = (size_t)pair.first;
         size_t s = (size_t)pair.second;
-        return r ^ ((s >> 16) | (s << 16));
+        return robin_hood::hash_int(r) ^ s;
     }
     template <unsigned ndim> size_t operator()(const std::pair<const Vertex<ndim>*, const Vertex<ndim>*>& pair) const
     {
         size_t r = (size_t)pair.first;
         size_t s = (size_t)pair.second;
-        return r ^ ((s >> 16) | (s << 16));
+        return robin_hood::hash_int(r) ^ s;
     }
 };
 
@@ -148,6 +152,10 @@ public:
     typedef Vertex<ndim> vertex_t;
     typedef Face<ndim> face_t;
 
+    // The storage of the edge belongs to an Arena, delete only runs
+    // the destructor.
+    bool in_arena;
+
     vertex_t* vert;
     face_t* face;
     Edge *prev, *next, *rev;
@@ -277,6 +285,16 @@ public:
     Edge(vertex_t* _vert, face_t* _face);
 
     ~Edge();
+
+    void operator delete(Edge* e, std::destroying_delete_t)
+    {
+        bool arena = e->in_arena;
+        e->~Edge();
+        if (!arena)
+        {
+            ::operator delete(e);
+        }
+    }
 };
 
 
@@ -288,6 +306,8 @@ public:
     typedef Vertex<ndim> vertex_t;
     typedef Edge<ndim> edge_t;
     typedef Mesh<ndim> mesh_t;
+    typedef carve::Arena<Face<ndim>> face_arena_t;
+    typedef carve::Arena<Edge<ndim>> edge_arena_t;
 
     typedef typename Vertex<ndim>::vector_t vector_t;
     typedef carve::geom::aabb<ndim> aabb_t;
@@ -358,6 +378,10 @@ public:
         }
     };
 
+    // The storage of the face belongs to an Arena, delete only runs
+    // the destructor. The edges of such a face come from an arena, too.
+    bool in_arena;
+
     edge_t* edge;
     size_t n_edges;
     mesh_t* mesh;
@@ -371,15 +395,19 @@ private:
     Face& operator=(const Face& other);
 
 protected:
-    Face() : edge(NULL), n_edges(0), mesh(NULL), id(0), plane(), project(NULL), unproject(NULL)
+    Face() : in_arena(false), edge(NULL), n_edges(0), mesh(NULL), id(0), plane(), project(NULL), unproject(NULL)
     {
     }
 
     Face(const Face& other)
-        : edge(NULL), n_edges(other.n_edges), mesh(NULL), id(other.id), plane(other.plane), project(other.project), unproject(other.unproject)
+        : in_arena(false), edge(NULL), n_edges(other.n_edges), mesh(NULL), id(other.id), plane(other.plane), project(other.project),
+          unproject(other.unproject)
     {
     }
 
+    // a new edge of this face, taken from edges unless it is NULL.
+    edge_t* newEdge(vertex_t* v, edge_arena_t* edges);
+
     project_t getProjector(bool positive_facing, int axis) const;
     unproject_t getUnprojector(bool positive_facing, int axis) const;
 
@@ -416,20 +444,21 @@ public:
 
     void clearEdges();
 
-    // build an edge loop in forward orientation from an iterator pair
-    template <typename iter_t> void loopFwd(iter_t vbegin, iter_t vend);
+    // build an edge loop in forward orientation from an iterator pair.
+    // The edges are taken from edges if it is not NULL.
+    template <typename iter_t> void loopFwd(iter_t vbegin, iter_t vend, edge_arena_t* edges = NULL);
 
     // build an edge loop in reverse orientation from an iterator pair
-    template <typename iter_t> void loopRev(iter_t vbegin, iter_t vend);
+    template <typename iter_t> void loopRev(iter_t vbegin, iter_t vend, edge_arena_t* edges = NULL);
 
     // initialize a face from an ordered list of vertices.
-    template <typename iter_t> void init(iter_t begin, iter_t end);
+    template <typename iter_t> void init(iter_t begin, iter_t end, edge_arena_t* edges = NULL);
 
     // initialization of a triangular face.
-    void init(vertex_t* a, vertex_t* b, vertex_t* c);
+    void init(vertex_t* a, vertex_t* b, vertex_t* c, edge_arena_t* edges = NULL);
 
     // initialization of a quad face.
-    void init(vertex_t* a, vertex_t* b, vertex_t* c, vertex_t* d);
+    void init(vertex_t* a, vertex_t* b, vertex_t* c, vertex_t* d, edge_arena_t* edges = NULL);
 
     void getVertices(std::vector<vertex_t*>& verts) const;
     void getProjectedVertices(carve::small_vector_on_stack<carve::geom::vector<2>, 16>& verts) const;
@@ -468,7 +497,7 @@ public:
 
     static Face* closeLoop(edge_t* open_edge);
 
-    Face(edge_t* e) : edge(e), n_edges(0), mesh(NULL)
+    Face(edge_t* e) : in_arena(false), edge(e), n_edges(0), mesh(NULL)
     {
         do
         {
@@ -479,27 +508,43 @@ public:
         recalc();
     }
 
-    Face(vertex_t* a, vertex_t* b, vertex_t* c) : edge(NULL), n_edges(0), mesh(NULL)
+    Face(vertex_t* a, vertex_t* b, vertex_t* c) : in_arena(false), edge(NULL), n_edges(0), mesh(NULL)
     {
         init(a, b, c);
         recalc();
     }
 
-    Face(vertex_t* a, vertex_t* b, vertex_t* c, vertex_t* d) : edge(NULL), n_edges(0), mesh(NULL)
+    Face(vertex_t* a, vertex_t* b, vertex_t* c, vertex_t* d) : in_arena(false), edge(NULL), n_edges(0), mesh(NULL)
     {
         init(a, b, c, d);
         recalc();
     }
 
-    template <typename iter_t> Face(iter_t begin, iter_t end) : edge(NULL), n_edges(0), mesh(NULL)
+    template <typename iter_t> Face(iter_t begin, iter_t end) : in_arena(false), edge(NULL), n_edges(0), mesh(NULL)
     {
         init(begin, end);
         recalc();
     }
 
+    // The same as the constructors above, with the edges taken from
+    // edges.
+    Face(edge_arena_t* edges, vertex_t* a, vertex_t* b, vertex_t* c) : in_arena(false), edge(NULL), n_edges(0), mesh(NULL)
+    {
+        init(a, b, c, edges);
+        recalc();
+    }
+
+    template <typename iter_t> Face(edge_arena_t* edges, iter_t begin, iter_t end) : in_arena(false), edge(NULL), n_edges(0), mesh(NULL)
+    {
+        init(begin, end, edges);
+        recalc();
+    }
+
     template <typename iter_t> Face* create(iter_t beg, iter_t end, bool reversed) const;
 
-    Face* clone(const vertex_t* old_base, vertex_t* new_base, carve::unordered_map<const edge_t*, edge_t*>& edge_map) const;
+    // The copy is taken from faces and edges if they are not NULL.
+    Face* clone(const vertex_t* old_base, vertex_t* new_base, carve::unordered_map<const edge_t*, edge_t*>& edge_map, face_arena_t* faces = NULL,
+                edge_arena_t* edges = NULL) const;
 
     void remove()
     {
@@ -557,6 +602,16 @@ public:
     {
         clearEdges();
     }
+
+    void operator delete(Face* f, std::destroying_delete_t)
+    {
+        bool arena = f->in_arena;
+        f->~Face();
+        if (!arena)
+        {
+            ::operator delete(f);
+        }
+    }
 };
 
 
@@ -814,12 +869,20 @@ public:
             is_negative = !is_negative;
     }
 
-    Mesh* clone(const vertex_t* old_base, vertex_t* new_base) const;
+    // The faces and edges of the copy are taken from the arenas if
+    // they are not NULL.
+    Mesh* clone(const vertex_t* old_base, vertex_t* new_base, typename face_t::face_arena_t* face_arena = NULL,
+                typename face_t::edge_arena_t* edge_arena = NULL) const;
 };
 
 // A MeshSet manages vertex storage, and a collection of meshes.
 // It should be easy to turn a vertex pointer into its index in
 // its MeshSet vertex_storage.
+//
+// The faces and edges that a MeshSet creates itself (when it is
+// built from vertices and face indices, or cloned) are kept in
+// arenas that it owns, and are released all at once with it. Faces
+// added to the meshes of such a MeshSet must come from its arenas.
 template <unsigned ndim> class MeshSet
 {
     MeshSet();
@@ -834,10 +897,20 @@ public:
     typedef Face<ndim> face_t;
     typedef Mesh<ndim> mesh_t;
     typedef carve::geom::aabb<ndim> aabb_t;
+    typedef typename face_t::face_arena_t face_arena_t;
+    typedef typename face_t::edge_arena_t edge_arena_t;
 
     std::vector<vertex_t> vertex_storage;
     std::vector<mesh_t*> meshes;
 
+    face_arena_t face_arena;
+    edge_arena_t edge_arena;
+
+private:
+    template <typename... args_t> face_t* _create_face(args_t... args);
+
+public:
+
 public:
     template <typename face_type> struct FaceIter : public std::iterator<std::random_access_iterator_tag, face_type>
     {
@@ -984,6 +1057,15 @@ public:
     MeshSet(const std::vector<typename vertex_t::vector_t>& points, size_t n_faces, const std::vector<int>& face_indices,
             const MeshOptions& opts = MeshOptions());
 
+    // Construct a mesh set of triangles directly from indexed data,
+    // without intermediate copies. vertex_source(i) returns the
+    // position of vertex i, and triangle_source(i, v) stores the three
+    // vertex indices of triangle i in v. Throws if an index is out of
+    // range.
+    template <typename vertex_source_t, typename triangle_source_t>
+    MeshSet(size_t n_vertices, vertex_source_t vertex_source, size_t n_triangles, triangle_source_t triangle_source,
+            const MeshOptions& opts = MeshOptions());
+
     // Construct a mesh set from a set of disconnected faces. Takes
     // posession of the face pointers.
     MeshSet(std::vector<face_t*>& faces, const MeshOptions& opts = MeshOptions());
@@ -1029,7 +1111,7 @@ public:
 
 carve::PointClass classifyPoint(const carve::mesh::MeshSet<3>* meshset, const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* face_rtree,
                                 const carve::geom::vector<3>& v, bool even_odd = false, const carve::mesh::Mesh<3>* mesh = NULL,
-                                const carve::mesh::Face<3>** hit_face = NULL);
+                                const carve::mesh::Face<3>** hit_face = NULL, size_t* ray_count = NULL);
 
 
 } // namespace mesh
@@ -31,6 +31,7 @@
 #include <algorithm>
 #include <deque>
 #include <iostream>
+#include <memory>
 
 namespace carve
 {
@@ -317,7 +318,8 @@ template <unsigned ndim> Edge<ndim>* Edge<ndim>::perimPrev() const
     return e;
 }
 
-template <unsigned ndim> Edge<ndim>::Edge(vertex_t* _vert, face_t* _face) : vert(_vert), face(_face), prev(NULL), next(NULL), rev(NULL)
+template <unsigned ndim>
+Edge<ndim>::Edge(vertex_t* _vert, face_t* _face) : in_arena(false), vert(_vert), face(_face), prev(NULL), next(NULL), rev(NULL)
 {
     prev = next = this;
 }
@@ -374,7 +376,19 @@ template <unsigned ndim> void Face<ndim>::clearEdges()
     n_edges = 0;
 }
 
-template <unsigned ndim> template <typename iter_t> void Face<ndim>::loopFwd(iter_t begin, iter_t end)
+template <unsigned ndim> typename Face<ndim>::edge_t* Face<ndim>::newEdge(vertex_t* v, edge_arena_t* edges)
+{
+    if (edges == NULL)
+    {
+        return new edge_t(v, this);
+    }
+
+    edge_t* e = new (edges->allocate()) edge_t(v, this);
+    e->in_arena = true;
+    return e;
+}
+
+template <unsigned ndim> template <typename iter_t> void Face<ndim>::loopFwd(iter_t begin, iter_t end, edge_arena_t* edges)
 {
     clearEdges();
     if (begin == end)
@@ -382,20 +396,20 @@ template <unsigned ndim> template <typename iter_t> void Face<ndim>::loopFwd(ite
         return;
     }
 
-    edge = new edge_t(*begin, this);
+    edge = newEdge(*begin, edges);
     ++n_edges;
     ++begin;
 
     while (begin != end)
     {
-        edge_t* e = new edge_t(*begin, this);
+        edge_t* e = newEdge(*begin, edges);
         e->insertAfter(edge->prev);
         ++n_edges;
         ++begin;
     }
 }
 
-template <unsigned ndim> template <typename iter_t> void Face<ndim>::loopRev(iter_t begin, iter_t end)
+template <unsigned ndim> template <typename iter_t> void Face<ndim>::loopRev(iter_t begin, iter_t end, edge_arena_t* edges)
 {
     clearEdges();
     if (begin == end)
@@ -403,43 +417,43 @@ template <unsigned ndim> template <typename iter_t> void Face<ndim>::loopRev(ite
         return;
     }
 
-    edge = new edge_t(*begin, this);
+    edge = newEdge(*begin, edges);
     ++n_edges;
     ++begin;
 
     while (begin != end)
     {
-        edge_t* e = new edge_t(*begin, this);
+        edge_t* e = newEdge(*begin, edges);
         e->insertBefore(edge->next);
         ++n_edges;
         ++begin;
     }
 }
 
-template <unsigned ndim> template <typename iter_t> void Face<ndim>::init(iter_t begin, iter_t end)
+template <unsigned ndim> template <typename iter_t> void Face<ndim>::init(iter_t begin, iter_t end, edge_arena_t* edges)
 {
-    loopFwd(begin, end);
+    loopFwd(begin, end, edges);
 }
 
-template <unsigned ndim> void Face<ndim>::init(vertex_t* a, vertex_t* b, vertex_t* c)
+template <unsigned ndim> void Face<ndim>::init(vertex_t* a, vertex_t* b, vertex_t* c, edge_arena_t* edges)
 {
     clearEdges();
-    edge_t* ea = new edge_t(a, this);
-    edge_t* eb = new edge_t(b, this);
-    edge_t* ec = new edge_t(c, this);
+    edge_t* ea = newEdge(a, edges);
+    edge_t* eb = newEdge(b, edges);
+    edge_t* ec = newEdge(c, edges);
     eb->insertAfter(ea);
     ec->insertAfter(eb);
     edge = ea;
     n_edges = 3;
 }
 
-template <unsigned ndim> void Face<ndim>::init(vertex_t* a, vertex_t* b, vertex_t* c, vertex_t* d)
+template <unsigned ndim> void Face<ndim>::init(vertex_t* a, vertex_t* b, vertex_t* c, vertex_t* d, edge_arena_t* edges)
 {
     clearEdges();
-    edge_t* ea = new edge_t(a, this);
-    edge_t* eb = new edge_t(b, this);
-    edge_t* ec = new edge_t(c, this);
-    edge_t* ed = new edge_t(d, this);
+    edge_t* ea = newEdge(a, edges);
+    edge_t* eb = newEdge(b, edges);
+    edge_t* ec = newEdge(c, edges);
+    edge_t* ed = newEdge(d, edges);
     eb->insertAfter(ea);
     ec->insertAfter(eb);
     ed->insertAfter(ec);
@@ -522,16 +536,26 @@ template <unsigned ndim> template <typename iter_t> Face<ndim>* Face<ndim>::crea
 }
 
 template <unsigned ndim>
-Face<ndim>* Face<ndim>::clone(const vertex_t* old_base, vertex_t* new_base, carve::unordered_map<const edge_t*, edge_t*>& edge_map) const
+Face<ndim>* Face<ndim>::clone(const vertex_t* old_base, vertex_t* new_base, carve::unordered_map<const edge_t*, edge_t*>& edge_map, face_arena_t* faces,
+                              edge_arena_t* edges) const
 {
-    Face* r = new Face(*this);
+    Face* r;
+    if (faces != NULL)
+    {
+        r = new (faces->allocate()) Face(*this);
+        r->in_arena = true;
+    }
+    else
+    {
+        r = new Face(*this);
+    }
 
     edge_t* e = edge;
     edge_t* r_p = NULL;
     edge_t* r_e;
     do
     {
-        r_e = new edge_t(e->vert - old_base + new_base, r);
+        r_e = r->newEdge(e->vert - old_base + new_base, edges);
         edge_map[e] = r_e;
         if (r_p)
         {
@@ -778,7 +802,9 @@ template <unsigned ndim> void Mesh<ndim>::calcOrientation()
 #endif
 }
 
-template <unsigned ndim> Mesh<ndim>* Mesh<ndim>::clone(const vertex_t* old_base, vertex_t* new_base) const
+template <unsigned ndim>
+Mesh<ndim>* Mesh<ndim>::clone(const vertex_t* old_base, vertex_t* new_base, typename face_t::face_arena_t* face_arena,
+                              typename face_t::edge_arena_t* edge_arena) const
 {
     std::vector<face_t*> r_faces;
     std::vector<edge_t*> r_open_edges;
@@ -791,7 +817,7 @@ template <unsigned ndim> Mesh<ndim>* Mesh<ndim>::clone(const vertex_t* old_base,
 
     for (size_t i = 0; i < faces.size(); ++i)
     {
-        r_faces.push_back(faces[i]->clone(old_base, new_base, edge_map));
+        r_faces.push_back(faces[i]->clone(old_base, new_base, edge_map, face_arena, edge_arena));
     }
     for (size_t i = 0; i < closed_edges.size(); ++i)
     {
@@ -872,6 +898,13 @@ template <unsigned ndim> template <typename iter_t> void MeshSet<ndim>::_init_fr
     }
 }
 
+template <unsigned ndim> template <typename... args_t> typename MeshSet<ndim>::face_t* MeshSet<ndim>::_create_face(args_t... args)
+{
+    face_t* face = new (face_arena.allocate()) face_t(&edge_arena, args...);
+    face->in_arena = true;
+    return face;
+}
+
 template <unsigned ndim>
 MeshSet<ndim>::MeshSet(const std::vector<typename MeshSet<ndim>::vertex_t::vector_t>& points, size_t n_faces, const std::vector<int>& face_indices,
                        const MeshOptions& opts)
@@ -887,6 +920,9 @@ MeshSet<ndim>::MeshSet(const std::vector<typename MeshSet<ndim>::vertex_t::vecto
     std::vector<vertex_t*> v;
     v.reserve(10);
 
+    face_arena.reserve(n_faces);
+    edge_arena.reserve(face_indices.size() - n_faces);
+
     size_t p = 0;
     for (size_t i = 0; i < n_faces; ++i)
     {
@@ -898,7 +934,7 @@ MeshSet<ndim>::MeshSet(const std::vector<typename MeshSet<ndim>::vertex_t::vecto
         {
             v.push_back(&vertex_storage[face_indices[p++]]);
         }
-        faces.push_back(new face_t(v.begin(), v.end()));
+        faces.push_back(_create_face(v.begin(), v.end()));
     }
     CARVE_ASSERT(p == face_indices.size());
     mesh_t::create(faces.begin(), faces.end(), faces.size(), meshes, opts);
@@ -909,6 +945,40 @@ MeshSet<ndim>::MeshSet(const std::vector<typename MeshSet<ndim>::vertex_t::vecto
     }
 }
 
+template <unsigned ndim>
+template <typename vertex_source_t, typename triangle_source_t>
+MeshSet<ndim>::MeshSet(size_t n_vertices, vertex_source_t vertex_source, size_t n_triangles, triangle_source_t triangle_source, const MeshOptions& opts)
+{
+    vertex_storage.reserve(n_vertices);
+    for (size_t i = 0; i < n_vertices; ++i)
+    {
+        vertex_storage.push_back(vertex_t(vertex_source(i)));
+    }
+
+    // the faces made so far are released with the arenas if an index is out of range
+    std::vector<face_t*> faces;
+    faces.reserve(n_triangles);
+    face_arena.reserve(n_triangles);
+    edge_arena.reserve(n_triangles * 3);
+    size_t v[3];
+    for (size_t i = 0; i < n_triangles; ++i)
+    {
+        triangle_source(i, v);
+        if (v[0] >= n_vertices || v[1] >= n_vertices || v[2] >= n_vertices)
+        {
+            throw carve::exception("triangle vertex index out of range");
+        }
+        faces.push_back(_create_face(&vertex_storage[v[0]], &vertex_storage[v[1]], &vertex_storage[v[2]]));
+    }
+
+    mesh_t::create(faces.begin(), faces.end(), faces.size(), meshes, opts);
+
+    for (size_t i = 0; i < meshes.size(); ++i)
+    {
+        meshes[i]->meshset = this;
+    }
+}
+
 template <unsigned ndim> MeshSet<ndim>::MeshSet(std::vector<face_t*>& faces, const MeshOptions& opts)
 {
     _init_from_faces(faces.begin(), faces.end(), faces.size(), opts);
@@ -980,18 +1050,63 @@ template <unsigned ndim> MeshSet<ndim>* MeshSet<ndim>::clone() const
 {
     std::vector<vertex_t> r_vertex_storage = vertex_storage;
     std::vector<mesh_t*> r_meshes;
+    std::unique_ptr<MeshSet> r(new MeshSet(r_vertex_storage, r_meshes));
+
+    size_t n_faces = 0, n_edges = 0;
+    for (const_face_iter i = faceBegin(); i != faceEnd(); ++i)
+    {
+        ++n_faces;
+        n_edges += (*i)->n_edges;
+    }
+    r->face_arena.reserve(n_faces);
+    r->edge_arena.reserve(n_edges);
+
+    r->meshes.reserve(meshes.size());
     for (size_t i = 0; i < meshes.size(); ++i)
     {
-        r_meshes.push_back(meshes[i]->clone(&vertex_storage[0], &r_vertex_storage[0]));
+        r->meshes.push_back(meshes[i]->clone(&vertex_storage[0], &r->vertex_storage[0], &r->face_arena, &r->edge_arena));
+        r->meshes.back()->meshset = r.get();
     }
 
-    return new MeshSet(r_vertex_storage, r_meshes);
+    return r.release();
 }
 
 template <unsigned ndim> MeshSet<ndim>::~MeshSet()
 {
     for (size_t i = 0; i < meshes.size(); ++i)
     {
+        if (!face_arena.empty())
+        {
+            // the faces and edges of the arenas are released with them. Those that
+            // were allocated on their own and added later (by Face::closeLoop(),
+            // for instance) are deleted here.
+            std::vector<face_t*>& faces = meshes[i]->faces;
+            for (size_t j = 0; j < faces.size(); ++j)
+            {
+                face_t* face = faces[j];
+                if (!face->in_arena)
+                {
+                    delete face;
+                    continue;
+                }
+
+                edge_t* e = face->edge;
+                if (e == NULL)
+                {
+                    continue;
+                }
+                do
+                {
+                    edge_t* next = e->next;
+                    if (!e->in_arena)
+                    {
+                        delete e;
+                    }
+                    e = next;
+                } while (e != face->edge);
+            }
+            faces.clear();
+        }
         delete meshes[i];
     }
 }
@@ -903,7 +903,7 @@ template <unsigned ndim, typename proj_t> struct TriangulationData
 
     void dumpPoly(const edge_t* edge, const edge_t* edge2 = NULL, const char* pfx = "poly_")
     {
-        static int step = 0;
+        static std::atomic<int> step(0);
         std::ostringstream filename;
         filename << pfx << step++ << ".svg";
         std::cerr << "dumping to " << filename.str() << std::endl;
@@ -959,14 +959,12 @@ template <unsigned ndim, typename proj_t> template <typename out_iter_t> bool Tr
         remain++;
     } while (v != begin);
 
+    size_t iterations = 0;
     while (remain > 3 && vq.size())
     {
+        if (++iterations % 50 == 0)
         {
-            static int __c = 0;
-            if (++__c % 50 == 0)
-            {
-                break;
-            }
+            break;
         }
         v = vq.pop();
         if (!v->isClipable())
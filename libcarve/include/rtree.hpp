@@ -34,6 +34,7 @@
 
 #include <cmath>
 #include <limits>
+#include <memory>
 
 namespace carve
 {
@@ -137,6 +138,56 @@ template <unsigned ndim, typename data_t, typename aabb_calc_t = carve::geom::ge
         }
     }
 
+    // Recompute all bounding boxes bottom-up from the current extents
+    // of the data, keeping the tree structure. This is much cheaper
+    // than a rebuild after the data has been moved, at the cost of
+    // looser boxes if the movement was not rigid.
+    void refit()
+    {
+        if (child)
+        {
+            node_t* node = child;
+            node->refit();
+            bbox = node->bbox;
+            for (node = node->sibling; node; node = node->sibling)
+            {
+                node->refit();
+                bbox.unionAABB(node->bbox);
+            }
+        }
+        else if (!data.empty())
+        {
+            aabb_calc_t calc;
+            bbox = calc(data[0]);
+            for (size_t i = 1; i < data.size(); ++i)
+            {
+                bbox.unionAABB(calc(data[i]));
+            }
+        }
+    }
+
+    // Copy the tree, mapping every data element through map_func. The
+    // bounding boxes are copied as they are.
+    template <typename map_func_t> node_t* copy(map_func_t map_func) const
+    {
+        // map_func may throw, which releases the part copied so far
+        std::unique_ptr<node_t> node(new node_t());
+        node->bbox = bbox;
+        node->data.reserve(data.size());
+        for (size_t i = 0; i < data.size(); ++i)
+        {
+            node->data.push_back(map_func(data[i]));
+        }
+
+        node_t** tail = &node->child;
+        for (const node_t* c = child; c; c = c->sibling)
+        {
+            *tail = c->copy(map_func);
+            tail = &(*tail)->sibling;
+        }
+        return node.release();
+    }
+
     // update the bounding box extents of nodes that intersect obj (generally an aabb).
     // The aabb class must provide a method intersects(obj_t).
     template <typename obj_t> void updateExtents(const obj_t& obj)
@@ -195,6 +246,10 @@ template <unsigned ndim, typename data_t, typename aabb_calc_t = carve::geom::ge
         }
     }
 
+    RTreeNode() : bbox(), child(NULL), sibling(NULL), data()
+    {
+    }
+
     template <typename iter_t> RTreeNode(iter_t begin, iter_t end) : bbox(), child(NULL), sibling(NULL), data()
     {
         _fill(begin, end, typename std::iterator_traits<iter_t>::value_type());
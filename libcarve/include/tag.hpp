@@ -27,19 +27,28 @@
 
 #include <include/carve.hpp>
 
+#include <atomic>
+
 namespace carve
 {
 
+/** \brief Base of objects that can be marked during a traversal.
+ *
+ * A traversal starts with tag_begin(), which makes every object untagged. The tag values of a traversal are taken from a
+ * process-wide counter and kept per thread, so traversals that run on different threads, for example in operations that run at
+ * the same time, do not see each other's tags.
+ */
 class tagable
 {
 private:
-    static int s_count;
+    static std::atomic<int> s_next;
+    static thread_local int s_count;
 
 protected:
     mutable int __tag;
 
 public:
-    tagable(const tagable&) : __tag(s_count - 1)
+    tagable(const tagable&) : __tag(-1)
     {
     }
     tagable& operator=(const tagable&)
@@ -47,7 +56,7 @@ public:
         return *this;
     }
 
-    tagable() : __tag(s_count - 1)
+    tagable() : __tag(-1)
     {
     }
 
@@ -57,7 +66,7 @@ public:
     }
     void untag() const
     {
-        __tag = s_count - 1;
+        __tag = -1;
     }
     bool is_tagged() const
     {
@@ -73,7 +82,17 @@ public:
 
     static void tag_begin()
     {
-        s_count++;
+        s_count = ++s_next;
+    }
+
+    /** \brief The traversal of the calling thread, for a thread that runs unrelated work in the middle of a traversal. */
+    static int tag_current()
+    {
+        return s_count;
+    }
+    static void tag_resume(int traversal)
+    {
+        s_count = traversal;
     }
 };
 } // namespace carve
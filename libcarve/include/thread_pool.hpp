@@ -0,0 +1,218 @@
+// Copyright 2006-2015 Tobias Sargeant (tobias.sargeant@gmail.com).
+//
+// This file is part of the Carve CSG Library (http://carve-csg.com/)
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace carve
+{
+namespace util
+{
+class TaskGroup;
+
+/**
+ * \class ThreadPool
+ * \brief The worker threads that run the parallel loops of carve.
+ *
+ * Every worker has its own queue of tasks. It runs the newest task of
+ * its own queue first, and steals the oldest tasks of the other queues
+ * when its own is empty. Threads that wait for a TaskGroup run the
+ * queued tasks of that group in the meantime, so tasks may start tasks
+ * of their own and wait for them. They never run the tasks of other
+ * groups, which could block the waiting task for as long as those run.
+ */
+class ThreadPool
+{
+public:
+    typedef std::function<void()> task_t;
+
+    static ThreadPool& instance();
+
+    ~ThreadPool();
+
+    /**
+     * \brief The number of threads that run tasks, counting the thread
+     * that waits for them, which also runs tasks. 1 if tasks are run
+     * by the waiting thread alone.
+     */
+    unsigned getThreadCount();
+
+    /**
+     * \brief Replaces the workers by count - 1 new ones, 0 selects the
+     * default count. Must not be called while tasks are queued or
+     * running.
+     */
+    void setThreadCount(unsigned count);
+
+    /**
+     * \brief The CPU quota of the cgroup of the process if it has one,
+     * else the number of CPUs the process may run on.
+     */
+    static unsigned defaultThreadCount();
+
+    /** \brief Queues a task of the group, which may be NULL. Tasks must not throw. */
+    void submit(task_t task, const TaskGroup* group = NULL);
+
+    /**
+     * \brief Runs one queued task of the group, or of any group if it
+     * is NULL. Returns false if there was none.
+     */
+    bool runQueuedTask(const TaskGroup* group = NULL);
+
+private:
+    struct QueuedTask
+    {
+        task_t task;
+        const TaskGroup* group;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<QueuedTask> tasks;
+    };
+
+    ThreadPool();
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    void start(unsigned count);
+    void stop();
+    bool takeTask(task_t& task, const TaskGroup* group);
+    void workerLoop(size_t index);
+
+    std::mutex config_mutex;
+    std::atomic<unsigned> thread_count; // 0 until the workers are started
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::atomic<size_t> queued_tasks;
+    std::atomic<size_t> next_queue;
+    bool stopping;
+};
+
+/**
+ * \class TaskGroup
+ * \brief Tasks that are run by the thread pool and waited for together.
+ */
+class TaskGroup
+{
+public:
+    TaskGroup(ThreadPool& _pool = ThreadPool::instance());
+
+    /** \brief Waits for the tasks, dropping their exceptions. */
+    ~TaskGroup();
+
+    /** \brief Runs the task on the pool, or right away if the pool has no workers. */
+    void run(std::function<void()> task);
+
+    /**
+     * \brief Runs queued tasks of the group until all of them are done,
+     * then rethrows the first exception that a task threw.
+     */
+    void wait();
+
+private:
+    TaskGroup(const TaskGroup&);
+    TaskGroup& operator=(const TaskGroup&);
+
+    void finished(std::exception_ptr error);
+
+    ThreadPool& pool;
+    std::atomic<size_t> pending;
+    std::mutex mutex;
+    std::condition_variable done;
+    std::exception_ptr error;
+};
+
+/**
+ * \class TaskGraph
+ * \brief Tasks with dependencies between them, run on the thread pool
+ * so that tasks that do not depend on each other overlap.
+ *
+ * A task is added after the tasks it depends on, and starts once they
+ * are all done. Every task is timed as a span.
+ */
+class TaskGraph
+{
+public:
+    typedef size_t node_t;
+
+    /** \brief When a task started, in seconds since run() was called, and how long it ran. */
+    struct Span
+    {
+        const char* name;
+        double begin;
+        double seconds;
+    };
+
+    TaskGraph(ThreadPool& _pool = ThreadPool::instance());
+
+    node_t add(const char* name, std::function<void()> task, const std::vector<node_t>& dependencies = std::vector<node_t>());
+
+    /**
+     * \brief Runs all the tasks and waits for them. If a task throws,
+     * the tasks that depend on it do not run, and the first exception is
+     * rethrown once the tasks that did start are done.
+     */
+    void run();
+
+    /** \brief The spans of the tasks that ran, in the order of add(). Tasks that did not run have a negative begin. */
+    const std::vector<Span>& getSpans() const
+    {
+        return spans;
+    }
+
+private:
+    struct Node
+    {
+        std::function<void()> task;
+        std::vector<node_t> dependents;
+        size_t dependencies;
+    };
+
+    TaskGraph(const TaskGraph&);
+    TaskGraph& operator=(const TaskGraph&);
+
+    void execute(node_t node, TaskGroup& group, std::atomic<size_t>* remaining, std::chrono::steady_clock::time_point start);
+
+    ThreadPool& pool;
+    std::vector<Node> nodes;
+    std::vector<Span> spans;
+};
+} // namespace util
+} // namespace carve
@@ -25,7 +25,16 @@
 
 #pragma once
 
-#include <execution>
+#include <include/thread_pool.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <vector>
 
 namespace carve
 {
@@ -98,60 +107,86 @@ public:
     }
 };
 
-template <typename T>
-class RangeIterator
+template <typename TIndex, typename Func>
+inline void forEachParallel(TIndex firstIndex, TIndex numElements, TIndex batchSize, Func func)
 {
-public:
-    using iterator_category = std::forward_iterator_tag;
-    using value_type = T;
-    using pointer = T*;
-    using difference_type = T;
-    using reference = T&;
-
-    RangeIterator() : _index(T(0))
-    {
-    }
-
-    RangeIterator(T index) : _index(index)
+#if defined(CARVE_MULTITHREADING)
+    TIndex numBatches = numElements / batchSize;
+    if (numElements % batchSize != 0)
     {
+        ++numBatches;
     }
 
-    RangeIterator& operator++()
+    ThreadPool& pool = ThreadPool::instance();
+    unsigned threadCount = pool.getThreadCount();
+    if (numBatches > 1 && threadCount > 1)
     {
-        ++_index;
-        return *this;
-    }
+        // the batches are handed out in order to whichever thread asks next, the calling thread included
+        std::atomic<TIndex> nextBatch(0);
+        auto runBatches = [&nextBatch, numBatches, batchSize, firstIndex, numElements, &func]()
+        {
+            for (TIndex batchIndex = nextBatch.fetch_add(1); batchIndex < numBatches; batchIndex = nextBatch.fetch_add(1))
+            {
+                TIndex iStart = firstIndex + batchIndex * batchSize;
+                TIndex iEnd = iStart + batchSize;
+                if (iEnd > firstIndex + numElements)
+                {
+                    iEnd = firstIndex + numElements;
+                }
+                for (TIndex i = iStart; i < iEnd; ++i)
+                {
+                    func(i);
+                }
+            }
+        };
 
-    RangeIterator& operator+=(T i)
-    {
-        _index += i;
-        return *this;
+        TaskGroup group(pool);
+        size_t helpers = (size_t)std::min<TIndex>(numBatches, (TIndex)threadCount) - 1;
+        for (size_t i = 0; i < helpers; ++i)
+        {
+            group.run(runBatches);
+        }
+        runBatches();
+        group.wait();
+        return;
     }
+#endif
 
-    T operator-(const RangeIterator& other) const
+    for (TIndex i = firstIndex; i < firstIndex + numElements; ++i)
     {
-        return _index - other._index;
+        func(i);
     }
+}
 
-    bool operator!=(const RangeIterator& other)
+template<typename Enumerable, typename Func>
+inline void forEachParallel(Enumerable& enumerable, Func func)
+{
+#if defined(CARVE_MULTITHREADING)
+    using iterator_t = decltype(enumerable.begin());
+    if constexpr (std::random_access_iterator<iterator_t>)
     {
-        return _index != other._index;
+        iterator_t begin = enumerable.begin();
+        forEachParallel<size_t>(0, (size_t)(enumerable.end() - begin), 1,
+            [begin, &func](size_t i)
+            {
+                func(begin[i]);
+            }
+        );
     }
-
-    T operator*()
+    else
     {
-        return _index;
+        std::vector<iterator_t> elements;
+        for (iterator_t i = enumerable.begin(); i != enumerable.end(); ++i)
+        {
+            elements.push_back(i);
+        }
+        forEachParallel<size_t>(0, elements.size(), 1,
+            [&elements, &func](size_t i)
+            {
+                func(*elements[i]);
+            }
+        );
     }
-
-private:
-    T _index;
-};
-
-template<typename Enumerable, typename Func>
-inline void forEachParallel(Enumerable& enumerable, Func func)
-{
-#if defined(CARVE_MULTITHREADING) && defined(NDEBUG)
-    std::for_each(std::execution::par_unseq, enumerable.begin(), enumerable.end(), func);
 #else
     for (auto&& element : enumerable)
     {
@@ -160,40 +195,43 @@ inline void forEachParallel(Enumerable& enumerable, Func func)
 #endif
 }
 
-template <typename TIndex, typename Func>
-inline void forEachParallel(TIndex firstIndex, TIndex numElements, TIndex batchSize, Func func)
+/**
+ * \brief Combines map(i) of all the indices with reduce.
+ *
+ * Every batch is reduced on its own, and the results of the batches
+ * are combined in order, so the result does not depend on the number
+ * of threads as long as reduce is associative.
+ */
+template <typename T, typename TIndex, typename Map, typename Reduce>
+inline T reduceParallel(TIndex firstIndex, TIndex numElements, TIndex batchSize, const T& identity, Map map, Reduce reduce)
 {
-#if defined(CARVE_MULTITHREADING) && defined(NDEBUG)
     TIndex numBatches = numElements / batchSize;
     if (numElements % batchSize != 0)
     {
         ++numBatches;
     }
 
-    RangeIterator<TIndex> begin(0);
-    RangeIterator<TIndex> end(numBatches);
-
-    std::for_each(std::execution::par_unseq, begin, end,
-        [batchSize, firstIndex, numElements, func](TIndex batchIndex)
+    std::unique_ptr<T[]> partials(new T[numBatches]);
+    forEachParallel<TIndex>(0, numBatches, 1,
+        [&partials, &identity, &map, &reduce, batchSize, firstIndex, numElements](TIndex batchIndex)
         {
             TIndex iStart = firstIndex + batchIndex * batchSize;
-            TIndex iEnd = iStart + batchSize;
-            if (iEnd > firstIndex + numElements)
-            {
-                iEnd = firstIndex + numElements;
-            }
+            TIndex iEnd = std::min<TIndex>(iStart + batchSize, firstIndex + numElements);
+            T partial = identity;
             for (TIndex i = iStart; i < iEnd; ++i)
             {
-                func(i);
+                partial = reduce(partial, map(i));
             }
+            partials[batchIndex] = partial;
         }
     );
-#else 
-    for (TIndex i = firstIndex; i < firstIndex + numElements; ++i)
+
+    T result = identity;
+    for (TIndex i = 0; i < numBatches; ++i)
     {
-        func(i);
+        result = reduce(result, partials[i]);
     }
-#endif
+    return result;
 }
 
 } // namespace util
@@ -43,7 +43,9 @@
 #include "csg_collector.hpp"
 
 #include <include/timing.hpp>
+#include <include/util.hpp>
 
+#include <limits>
 #include <memory>
 
 
@@ -81,6 +83,43 @@ bool carve::csg::VertexPool::inPool(vertex_t* v) const
     return false;
 }
 
+size_t carve::csg::VertexPool::size() const
+{
+    return pool.empty() ? 0 : (pool.size() - 1) * blocksize + pool.back().size();
+}
+
+void carve::csg::VertexPool::getBlocks(std::vector<std::pair<const vertex_t*, size_t>>& blocks) const
+{
+    size_t first = 0;
+    for (pool_t::const_iterator i = pool.begin(); i != pool.end(); ++i)
+    {
+        blocks.push_back(std::make_pair(i->data(), first));
+        first += i->size();
+    }
+}
+
+carve::csg::VertexIds::VertexIds() : a_base(NULL), a_count(0), b_base(NULL), b_count(0), count(0)
+{
+}
+
+carve::csg::VertexIds::VertexIds(const carve::mesh::MeshSet<3>* a, const carve::mesh::MeshSet<3>* b, const VertexPool& pool)
+    : a_base(a->vertex_storage.data()), a_count(a->vertex_storage.size()), b_base(b->vertex_storage.data()), b_count(b->vertex_storage.size())
+{
+    pool.getBlocks(pool_blocks);
+    std::sort(pool_blocks.begin(), pool_blocks.end());
+    count = a_count + b_count + pool.size();
+}
+
+size_t carve::csg::VertexIds::poolId(const vertex_t* v) const
+{
+    // the last block that starts at or before v.
+    std::vector<std::pair<const vertex_t*, size_t>>::const_iterator i =
+        std::upper_bound(pool_blocks.begin(), pool_blocks.end(), std::make_pair(v, std::numeric_limits<size_t>::max()));
+    CARVE_ASSERT(i != pool_blocks.begin());
+    --i;
+    return a_count + b_count + (*i).second + (size_t)(v - (*i).first);
+}
+
 
 #if defined(CARVE_DEBUG_WRITE_PLY_DATA)
 void writePLY(const std::string& out_file, const carve::point::PointSet* points, bool ascii);
@@ -275,16 +314,10 @@ void dump_intersections(std::ostream& out, carve::csg::Intersections& csg_inters
 {
     std::vector<dump_data> temp;
 
-    for (carve::csg::Intersections::const_iterator i = csg_intersections.begin(), ie = csg_intersections.end(); i != ie; ++i)
+    for (size_t i = 0; i < csg_intersections.size(); ++i)
     {
-        const carve::csg::IObj& i_src = ((*i).first);
-
-        for (carve::csg::Intersections::mapped_type::const_iterator j = (*i).second.begin(), je = (*i).second.end(); j != je; ++j)
-        {
-            const carve::csg::IObj& i_tgt = ((*j).first);
-            carve::mesh::MeshSet<3>::vertex_t* i_pt = ((*j).second);
-            temp.push_back(dump_data(i_pt, i_src, i_tgt));
-        }
+        const carve::csg::Intersections::Record& r = csg_intersections[(carve::csg::Intersections::index_t)i];
+        temp.push_back(dump_data(r.vertex, r.obj, r.other));
     }
 
     std::sort(temp.begin(), temp.end(), dump_sort());
@@ -300,13 +333,9 @@ void dump_intersections(std::ostream& out, carve::csg::Intersections& csg_inters
 #if defined(CARVE_DEBUG_WRITE_PLY_DATA)
     std::vector<carve::geom3d::Vector> vertices;
 
-    for (carve::csg::Intersections::const_iterator i = csg_intersections.begin(), ie = csg_intersections.end(); i != ie; ++i)
+    for (size_t i = 0; i < csg_intersections.size(); ++i)
     {
-        for (carve::csg::Intersections::mapped_type::const_iterator j = (*i).second.begin(), je = (*i).second.end(); j != je; ++j)
-        {
-            carve::mesh::MeshSet<3>::vertex_t* i_pt = ((*j).second);
-            vertices.push_back(i_pt->v);
-        }
+        vertices.push_back(csg_intersections[(carve::csg::Intersections::index_t)i].vertex->v);
     }
 
     carve::point::PointSet points(vertices);
@@ -389,9 +418,52 @@ template <typename face_set_t> void facesForObject(const carve::csg::IObj& obj,
 }
 
 
+/**
+ * \brief Inserts values, gathered in batches, into the sets of a map.
+ *
+ * The keys are added to the map in the order of the batches and of their
+ * entries, as a serial loop would add them. The values are then inserted
+ * in parallel by shards that each own a part of the sets.
+ */
+template <typename map_t, typename value_t>
+void insertIntoSets(map_t& map, const std::vector<std::vector<std::pair<typename map_t::key_type, value_t>>>& batches)
+{
+    typedef std::vector<std::pair<typename map_t::mapped_type*, value_t>> shard_t;
+
+    const size_t shard_count = carve::util::ThreadPool::instance().getThreadCount();
+    std::vector<shard_t> shards(shard_count);
+    for (size_t i = 0; i < batches.size(); ++i)
+    {
+        for (size_t j = 0; j < batches[i].size(); ++j)
+        {
+            typename map_t::mapped_type* set = &map[batches[i][j].first];
+            shards[(reinterpret_cast<uintptr_t>(set) / sizeof(*set)) % shard_count].push_back(std::make_pair(set, batches[i][j].second));
+        }
+    }
+
+    carve::util::forEachParallel<size_t>(0, shard_count, 1, [&](size_t shard) {
+        for (size_t i = 0; i < shards[shard].size(); ++i)
+        {
+            shards[shard][i].first->insert(shards[shard][i].second);
+        }
+    });
+}
+
+
 } // namespace
 
 
+void carve::csg::Stats::reset()
+{
+    std::fill(seconds, seconds + PHASE_MAX, 0.0);
+    face_pairs = 0;
+    intersection_vertices = 0;
+    face_loops = 0;
+    groups = 0;
+    classification_rays = 0;
+    spans.clear();
+}
+
 bool carve::csg::CSG::Hooks::hasHook(unsigned hook_num)
 {
     return hooks[hook_num].size() > 0;
@@ -408,6 +480,8 @@ void carve::csg::CSG::Hooks::intersectionVertex(const meshset_t::vertex_t* verte
 void carve::csg::CSG::Hooks::processOutputFace(carve::small_vector_on_stack<carve::mesh::MeshSet<3>::face_t*, 16>& faces,
                                                const meshset_t::face_t* orig_face, bool flipped)
 {
+    // faces may be processed by several threads at once, whose times add up
+    PhaseTimer timer(stats, Stats::TRIANGULATION);
     for (std::list<Hook*>::iterator j = hooks[PROCESS_OUTPUT_FACE_HOOK].begin(); j != hooks[PROCESS_OUTPUT_FACE_HOOK].end(); ++j)
     {
         (*j)->processOutputFace(faces, orig_face, flipped);
@@ -439,6 +513,30 @@ void carve::csg::CSG::Hooks::edgeDivision(const meshset_t::edge_t* orig_edge, si
     }
 }
 
+void carve::csg::CSG::Hooks::progress(double fraction)
+{
+    if (hooks[PROGRESS_HOOK].empty())
+    {
+        return;
+    }
+
+    // steps that run at the same time report from their own parts of the range
+    std::lock_guard<std::mutex> lock(progress_mutex);
+    if (fraction < progress_reached)
+    {
+        fraction = progress_reached;
+    }
+    progress_reached = fraction;
+
+    for (std::list<Hook*>::iterator j = hooks[PROGRESS_HOOK].begin(); j != hooks[PROGRESS_HOOK].end(); ++j)
+    {
+        if (!(*j)->progress(fraction))
+        {
+            throw operation_cancelled();
+        }
+    }
+}
+
 void carve::csg::CSG::Hooks::registerHook(Hook* hook, unsigned hook_bits)
 {
     for (unsigned i = 0; i < HOOK_MAX; ++i)
@@ -475,7 +573,13 @@ void carve::csg::CSG::Hooks::reset()
     }
 }
 
-carve::csg::CSG::Hooks::Hooks() : hooks()
+void carve::csg::CSG::Hooks::resetProgress()
+{
+    std::lock_guard<std::mutex> lock(progress_mutex);
+    progress_reached = 0.0;
+}
+
+carve::csg::CSG::Hooks::Hooks() : hooks(), stats(NULL), progress_reached(0.0)
 {
     hooks.resize(HOOK_MAX);
 }
@@ -491,17 +595,10 @@ void carve::csg::CSG::makeVertexIntersections()
     static carve::TimingName FUNC_NAME("CSG::makeVertexIntersections()");
     carve::TimingBlock block(FUNC_NAME);
     vertex_intersections.clear();
-    for (Intersections::const_iterator i = intersections.begin(), ie = intersections.end(); i != ie; ++i)
+    const std::vector<Intersections::Record>& records = intersections.all();
+    for (size_t i = 0; i < records.size(); ++i)
     {
-        const IObj& i_src = ((*i).first);
-
-        for (Intersections::mapped_type::const_iterator j = (*i).second.begin(), je = (*i).second.end(); j != je; ++j)
-        {
-            const IObj& i_tgt = ((*j).first);
-            meshset_t::vertex_t* i_pt = ((*j).second);
-
-            vertex_intersections[i_pt].insert(std::make_pair(i_src, i_tgt));
-        }
+        vertex_intersections[records[i].vertex].insert(std::make_pair(records[i].obj, records[i].other));
     }
 }
 
@@ -636,11 +733,10 @@ void carve::csg::CSG::groupIntersections()
 }
 
 
-static void recordEdgeIntersectionInfo(carve::mesh::MeshSet<3>::vertex_t* intersection, carve::mesh::MeshSet<3>::edge_t* edge,
-                                       const carve::csg::detail::VFSMap::mapped_type& intersected_faces, carve::csg::detail::Data& data)
+static void recordEdgeIntersectionInfo(carve::mesh::MeshSet<3>::edge_t* edge, const carve::csg::detail::VFSMap::mapped_type& intersected_faces,
+                                       carve::csg::detail::EdgeIntInfo::mapped_type& eint_info)
 {
     carve::mesh::MeshSet<3>::vertex_t::vector_t edge_dir = edge->v2()->v - edge->v1()->v;
-    carve::csg::detail::EdgeIntInfo::mapped_type& eint_info = data.emap[edge][intersection];
 
     for (carve::csg::detail::VFSMap::mapped_type::const_iterator i = intersected_faces.begin(); i != intersected_faces.end(); ++i)
     {
@@ -655,52 +751,121 @@ void carve::csg::CSG::intersectingFacePairs(detail::Data& data)
     static carve::TimingName FUNC_NAME("CSG::intersectingFacePairs()");
     carve::TimingBlock block(FUNC_NAME);
 
-    // iterate over all intersection points.
+    typedef std::pair<meshset_t::edge_t*, detail::EdgeIntInfo::mapped_type> edge_info_t;
+
+    struct Point
+    {
+        meshset_t::vertex_t* vertex;
+        const VertexIntersections::mapped_type* pairs;
+        detail::VFSMap::mapped_type* face_set;
+    };
+
+    // what the intersection points of a batch record for vertices, edges and faces, in the order of the points.
+    struct Batch
+    {
+        std::vector<std::pair<meshset_t::vertex_t*, meshset_t::vertex_t*>> vertices;
+        std::vector<std::pair<meshset_t::vertex_t*, edge_info_t>> edges;
+        std::vector<std::pair<meshset_t::face_t*, meshset_t::vertex_t*>> faces;
+    };
+
+    // each point owns its face set in fmap_rev, so the sets are added beforehand and filled in parallel.
+    std::vector<Point> points;
+    points.reserve(vertex_intersections.size());
     for (VertexIntersections::const_iterator i = vertex_intersections.begin(), ie = vertex_intersections.end(); i != ie; ++i)
     {
-        meshset_t::vertex_t* i_pt = ((*i).first);
-        detail::VFSMap::mapped_type& face_set = (data.fmap_rev[i_pt]);
+        Point point = { (*i).first, &(*i).second, &data.fmap_rev[(*i).first] };
+        points.push_back(point);
+    }
+
+    const size_t batch_size = 256;
+    const size_t batch_count = (points.size() + batch_size - 1) / batch_size;
+    std::vector<Batch> batches(batch_count);
+    carve::util::forEachParallel<size_t>(0, batch_count, 1, [&](size_t batch_index) {
+        Batch& batch = batches[batch_index];
         detail::VFSMap::mapped_type src_face_set;
         detail::VFSMap::mapped_type tgt_face_set;
-        // for all pairs of intersecting objects at this point
-        for (VertexIntersections::mapped_type::const_iterator j = (*i).second.begin(), je = (*i).second.end(); j != je; ++j)
+        std::vector<edge_info_t> point_edges;
+
+        // iterate over the intersection points of the batch.
+        for (size_t i = batch_index * batch_size, ie = std::min(i + batch_size, points.size()); i < ie; ++i)
         {
-            const IObj& i_src = ((*j).first);
-            const IObj& i_tgt = ((*j).second);
-
-            src_face_set.clear();
-            tgt_face_set.clear();
-            // work out the faces involved.
-            facesForObject(i_src, data.vert_to_edges, src_face_set);
-            facesForObject(i_tgt, data.vert_to_edges, tgt_face_set);
-            // this updates fmap_rev.
-            std::copy(src_face_set.begin(), src_face_set.end(), set_inserter(face_set));
-            std::copy(tgt_face_set.begin(), tgt_face_set.end(), set_inserter(face_set));
-
-            // record the intersection with respect to any involved vertex.
-            if (i_src.obtype == IObj::ObjectType::OBTYPE_VERTEX)
-                data.vmap[i_src.vertex] = i_pt;
-            if (i_tgt.obtype == IObj::ObjectType::OBTYPE_VERTEX)
-                data.vmap[i_tgt.vertex] = i_pt;
-
-            // record the intersection with respect to any involved edge.
-            if (i_src.obtype == IObj::ObjectType::OBTYPE_EDGE)
-                recordEdgeIntersectionInfo(i_pt, i_src.edge, tgt_face_set, data);
-            if (i_tgt.obtype == IObj::ObjectType::OBTYPE_EDGE)
-                recordEdgeIntersectionInfo(i_pt, i_tgt.edge, src_face_set, data);
+            meshset_t::vertex_t* i_pt = points[i].vertex;
+            detail::VFSMap::mapped_type& face_set = *points[i].face_set;
+            point_edges.clear();
+
+            // record the intersection with respect to any involved edge, once for each edge.
+            auto edge_info = [&point_edges](meshset_t::edge_t* edge) -> detail::EdgeIntInfo::mapped_type& {
+                for (size_t k = 0; k < point_edges.size(); ++k)
+                {
+                    if (point_edges[k].first == edge)
+                        return point_edges[k].second;
+                }
+                point_edges.push_back(edge_info_t(edge, detail::EdgeIntInfo::mapped_type()));
+                return point_edges.back().second;
+            };
+
+            // for all pairs of intersecting objects at this point
+            for (VertexIntersections::mapped_type::const_iterator j = points[i].pairs->begin(), je = points[i].pairs->end(); j != je; ++j)
+            {
+                const IObj& i_src = ((*j).first);
+                const IObj& i_tgt = ((*j).second);
+
+                src_face_set.clear();
+                tgt_face_set.clear();
+                // work out the faces involved.
+                facesForObject(i_src, data.vert_to_edges, src_face_set);
+                facesForObject(i_tgt, data.vert_to_edges, tgt_face_set);
+                // this updates fmap_rev.
+                std::copy(src_face_set.begin(), src_face_set.end(), set_inserter(face_set));
+                std::copy(tgt_face_set.begin(), tgt_face_set.end(), set_inserter(face_set));
+
+                // record the intersection with respect to any involved vertex.
+                if (i_src.obtype == IObj::ObjectType::OBTYPE_VERTEX)
+                    batch.vertices.push_back(std::make_pair(i_src.vertex, i_pt));
+                if (i_tgt.obtype == IObj::ObjectType::OBTYPE_VERTEX)
+                    batch.vertices.push_back(std::make_pair(i_tgt.vertex, i_pt));
+
+                if (i_src.obtype == IObj::ObjectType::OBTYPE_EDGE)
+                    recordEdgeIntersectionInfo(i_src.edge, tgt_face_set, edge_info(i_src.edge));
+                if (i_tgt.obtype == IObj::ObjectType::OBTYPE_EDGE)
+                    recordEdgeIntersectionInfo(i_tgt.edge, src_face_set, edge_info(i_tgt.edge));
+            }
+
+            for (size_t k = 0; k < point_edges.size(); ++k)
+            {
+                batch.edges.push_back(std::make_pair(i_pt, edge_info_t()));
+                batch.edges.back().second.first = point_edges[k].first;
+                batch.edges.back().second.second.swap(point_edges[k].second);
+            }
+
+            // record the intersection with respect to each face.
+            for (carve::csg::detail::VFSMap::mapped_type::const_iterator k = face_set.begin(), ke = face_set.end(); k != ke; ++k)
+            {
+                batch.faces.push_back(std::make_pair(*k, i_pt));
+            }
         }
+    });
 
-        // record the intersection with respect to each face.
-        for (carve::csg::detail::VFSMap::mapped_type::const_iterator k = face_set.begin(), ke = face_set.end(); k != ke; ++k)
+    std::vector<std::vector<std::pair<meshset_t::face_t*, meshset_t::vertex_t*>>> face_batches(batch_count);
+    for (size_t i = 0; i < batch_count; ++i)
+    {
+        Batch& batch = batches[i];
+        for (size_t j = 0; j < batch.vertices.size(); ++j)
+        {
+            data.vmap[data.vertex_ids.id(batch.vertices[j].first)] = batch.vertices[j].second;
+        }
+        for (size_t j = 0; j < batch.edges.size(); ++j)
         {
-            meshset_t::face_t* f = (*k);
-            data.fmap[f].insert(i_pt);
+            // an edge meets each point once, so its set for the point is new.
+            data.emap[batch.edges[j].second.first][batch.edges[j].first].swap(batch.edges[j].second.second);
         }
+        face_batches[i].swap(batch.faces);
     }
+    insertIntoSets(data.fmap, face_batches);
 }
 
 
-void carve::csg::CSG::_generateVertexVertexIntersections(meshset_t::vertex_t* va, meshset_t::edge_t* eb)
+void carve::csg::CSG::_generateVertexVertexIntersections(meshset_t::vertex_t* va, meshset_t::edge_t* eb, candidates_t& out) const
 {
     if (intersections.intersects(va, eb->v1()))
     {
@@ -711,25 +876,25 @@ void carve::csg::CSG::_generateVertexVertexIntersections(meshset_t::vertex_t* va
 
     if (d_v1 < carve::EPSILON2)
     {
-        intersections.record(va, eb->v1(), va);
+        out.push_back(IntersectionCandidate(va, eb->v1(), va));
     }
 }
 
 
-void carve::csg::CSG::generateVertexVertexIntersections(meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b)
+void carve::csg::CSG::generateVertexVertexIntersections(meshset_t::face_t* a, face_range_t b_begin, face_range_t b_end, candidates_t& out) const
 {
     meshset_t::edge_t *ea, *eb;
 
     ea = a->edge;
     do
     {
-        for (size_t i = 0; i < b.size(); ++i)
+        for (face_range_t i = b_begin; i != b_end; ++i)
         {
-            meshset_t::face_t* t = b[i];
+            meshset_t::face_t* t = *i;
             eb = t->edge;
             do
             {
-                _generateVertexVertexIntersections(ea->v1(), eb);
+                _generateVertexVertexIntersections(ea->v1(), eb, out);
                 eb = eb->next;
             } while (eb != t->edge);
         }
@@ -738,7 +903,7 @@ void carve::csg::CSG::generateVertexVertexIntersections(meshset_t::face_t* a, co
 }
 
 
-void carve::csg::CSG::_generateVertexEdgeIntersections(meshset_t::vertex_t* va, meshset_t::edge_t* eb)
+void carve::csg::CSG::_generateVertexEdgeIntersections(meshset_t::vertex_t* va, meshset_t::edge_t* eb, candidates_t& out) const
 {
     if (intersections.intersects(va, eb))
     {
@@ -758,27 +923,25 @@ void carve::csg::CSG::_generateVertexEdgeIntersections(meshset_t::vertex_t* va,
     if (a < b * carve::EPSILON2)
     {
         // vertex-edge intersection
-        intersections.record(eb, va, va);
-        if (eb->rev)
-            intersections.record(eb->rev, va, va);
+        out.push_back(IntersectionCandidate(eb, va, va));
     }
 }
 
 
-void carve::csg::CSG::generateVertexEdgeIntersections(meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b)
+void carve::csg::CSG::generateVertexEdgeIntersections(meshset_t::face_t* a, face_range_t b_begin, face_range_t b_end, candidates_t& out) const
 {
     meshset_t::edge_t *ea, *eb;
 
     ea = a->edge;
     do
     {
-        for (size_t i = 0; i < b.size(); ++i)
+        for (face_range_t i = b_begin; i != b_end; ++i)
         {
-            meshset_t::face_t* t = b[i];
+            meshset_t::face_t* t = *i;
             eb = t->edge;
             do
             {
-                _generateVertexEdgeIntersections(ea->v1(), eb);
+                _generateVertexEdgeIntersections(ea->v1(), eb, out);
                 eb = eb->next;
             } while (eb != t->edge);
         }
@@ -787,7 +950,7 @@ void carve::csg::CSG::generateVertexEdgeIntersections(meshset_t::face_t* a, cons
 }
 
 
-void carve::csg::CSG::_generateEdgeEdgeIntersections(meshset_t::edge_t* ea, meshset_t::edge_t* eb)
+void carve::csg::CSG::_generateEdgeEdgeIntersections(meshset_t::edge_t* ea, meshset_t::edge_t* eb, candidates_t& out) const
 {
     if (intersections.intersects(ea, eb))
     {
@@ -813,14 +976,7 @@ void carve::csg::CSG::_generateEdgeEdgeIntersections(meshset_t::edge_t* ea, mesh
         // edges intersect
         if (mu1 >= 0.0 && mu1 <= 1.0 && mu2 >= 0.0 && mu2 <= 1.0)
         {
-            meshset_t::vertex_t* p = vertex_pool.get((p1 + p2) / 2.0);
-            intersections.record(ea, eb, p);
-            if (ea->rev)
-                intersections.record(ea->rev, eb, p);
-            if (eb->rev)
-                intersections.record(ea, eb->rev, p);
-            if (ea->rev && eb->rev)
-                intersections.record(ea->rev, eb->rev, p);
+            out.push_back(IntersectionCandidate(ea, eb, (p1 + p2) / 2.0));
         }
         break;
     }
@@ -843,20 +999,20 @@ void carve::csg::CSG::_generateEdgeEdgeIntersections(meshset_t::edge_t* ea, mesh
 }
 
 
-void carve::csg::CSG::generateEdgeEdgeIntersections(meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b)
+void carve::csg::CSG::generateEdgeEdgeIntersections(meshset_t::face_t* a, face_range_t b_begin, face_range_t b_end, candidates_t& out) const
 {
     meshset_t::edge_t *ea, *eb;
 
     ea = a->edge;
     do
     {
-        for (size_t i = 0; i < b.size(); ++i)
+        for (face_range_t i = b_begin; i != b_end; ++i)
         {
-            meshset_t::face_t* t = b[i];
+            meshset_t::face_t* t = *i;
             eb = t->edge;
             do
             {
-                _generateEdgeEdgeIntersections(ea, eb);
+                _generateEdgeEdgeIntersections(ea, eb, out);
                 eb = eb->next;
             } while (eb != t->edge);
         }
@@ -865,7 +1021,7 @@ void carve::csg::CSG::generateEdgeEdgeIntersections(meshset_t::face_t* a, const
 }
 
 
-void carve::csg::CSG::_generateVertexFaceIntersections(meshset_t::face_t* fa, meshset_t::edge_t* eb)
+void carve::csg::CSG::_generateVertexFaceIntersections(meshset_t::face_t* fa, meshset_t::edge_t* eb, candidates_t& out) const
 {
     if (intersections.intersects(eb->v1(), fa))
     {
@@ -876,29 +1032,29 @@ void carve::csg::CSG::_generateVertexFaceIntersections(meshset_t::face_t* fa, me
 
     if (fabs(d1) < carve::EPSILON && fa->containsPoint(eb->v1()->v))
     {
-        intersections.record(eb->v1(), fa, eb->v1());
+        out.push_back(IntersectionCandidate(eb->v1(), fa, eb->v1()));
     }
 }
 
 
-void carve::csg::CSG::generateVertexFaceIntersections(meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b)
+void carve::csg::CSG::generateVertexFaceIntersections(meshset_t::face_t* a, face_range_t b_begin, face_range_t b_end, candidates_t& out) const
 {
     meshset_t::edge_t* eb;
 
-    for (size_t i = 0; i < b.size(); ++i)
+    for (face_range_t i = b_begin; i != b_end; ++i)
     {
-        meshset_t::face_t* t = b[i];
+        meshset_t::face_t* t = *i;
         eb = t->edge;
         do
         {
-            _generateVertexFaceIntersections(a, eb);
+            _generateVertexFaceIntersections(a, eb, out);
             eb = eb->next;
         } while (eb != t->edge);
     }
 }
 
 
-void carve::csg::CSG::_generateEdgeFaceIntersections(meshset_t::face_t* fa, meshset_t::edge_t* eb)
+void carve::csg::CSG::_generateEdgeFaceIntersections(meshset_t::face_t* fa, meshset_t::edge_t* eb, candidates_t& out) const
 {
     if (intersections.intersects(eb, fa))
     {
@@ -908,33 +1064,156 @@ void carve::csg::CSG::_generateEdgeFaceIntersections(meshset_t::face_t* fa, mesh
     meshset_t::vertex_t::vector_t _p;
     if (fa->simpleLineSegmentIntersection(carve::geom3d::LineSegment(eb->v1()->v, eb->v2()->v), _p))
     {
-        meshset_t::vertex_t* p = vertex_pool.get(_p);
-        intersections.record(eb, fa, p);
-        if (eb->rev)
-            intersections.record(eb->rev, fa, p);
+        out.push_back(IntersectionCandidate(eb, fa, _p));
     }
 }
 
 
-void carve::csg::CSG::generateEdgeFaceIntersections(meshset_t::face_t* a, const std::vector<meshset_t::face_t*>& b)
+void carve::csg::CSG::generateEdgeFaceIntersections(meshset_t::face_t* a, face_range_t b_begin, face_range_t b_end, candidates_t& out) const
 {
     meshset_t::edge_t* eb;
 
-    for (size_t i = 0; i < b.size(); ++i)
+    for (face_range_t i = b_begin; i != b_end; ++i)
     {
-        meshset_t::face_t* t = b[i];
+        meshset_t::face_t* t = *i;
         eb = t->edge;
         do
         {
-            _generateEdgeFaceIntersections(a, eb);
+            _generateEdgeFaceIntersections(a, eb, out);
             eb = eb->next;
         } while (eb != t->edge);
     }
 }
 
 
-void carve::csg::CSG::generateIntersectionCandidates(meshset_t* a, const face_rtree_t* a_node, meshset_t* b, const face_rtree_t* b_node,
-                                                     face_pairs_t& face_pairs, bool descend_a)
+void carve::csg::CSG::recordIntersection(const IntersectionCandidate& candidate)
+{
+    // the same intersection is usually found from several faces; the first one to be visited is recorded
+    const IObj& a = candidate.a;
+    const IObj& b = candidate.b;
+    switch (a.obtype)
+    {
+    case IObj::ObjectType::OBTYPE_VERTEX:
+        if (b.obtype == IObj::ObjectType::OBTYPE_VERTEX)
+        {
+            if (!intersections.intersects(a, b.vertex))
+            {
+                intersections.record(a, b, candidate.vertex);
+            }
+        }
+        else if (!intersections.intersects(a, b.face))
+        {
+            intersections.record(a, b, candidate.vertex);
+        }
+        break;
+
+    case IObj::ObjectType::OBTYPE_EDGE:
+        if (b.obtype == IObj::ObjectType::OBTYPE_VERTEX)
+        {
+            if (!intersections.intersects(b, a.edge))
+            {
+                intersections.record(a, b, candidate.vertex);
+                if (a.edge->rev)
+                    intersections.record(a.edge->rev, b, candidate.vertex);
+            }
+        }
+        else if (b.obtype == IObj::ObjectType::OBTYPE_EDGE)
+        {
+            if (!intersections.intersects(a.edge, b.edge))
+            {
+                meshset_t::vertex_t* p = vertex_pool.get(candidate.point);
+                intersections.record(a, b, p);
+                if (a.edge->rev)
+                    intersections.record(a.edge->rev, b, p);
+                if (b.edge->rev)
+                    intersections.record(a, b.edge->rev, p);
+                if (a.edge->rev && b.edge->rev)
+                    intersections.record(a.edge->rev, b.edge->rev, p);
+            }
+        }
+        else if (!intersections.intersects(a.edge, b.face))
+        {
+            meshset_t::vertex_t* p = vertex_pool.get(candidate.point);
+            intersections.record(a, b, p);
+            if (a.edge->rev)
+                intersections.record(a.edge->rev, b, p);
+        }
+        break;
+
+    default:
+        CARVE_FAIL("unexpected intersection candidate");
+    }
+}
+
+
+void carve::csg::CSG::splitCandidateTasks(std::vector<CandidateTask>& tasks, size_t min_tasks)
+{
+    bool split = true;
+    while (split && tasks.size() < min_tasks)
+    {
+        std::vector<CandidateTask> next;
+        split = false;
+        for (size_t i = 0; i < tasks.size(); ++i)
+        {
+            const CandidateTask& task = tasks[i];
+            if (!task.a_node->bbox.intersects(task.b_node->bbox))
+            {
+                continue;
+            }
+
+            if (task.a_node->child && (task.descend_a || !task.b_node->child))
+            {
+                for (face_rtree_t* node = task.a_node->child; node; node = node->sibling)
+                {
+                    next.push_back(CandidateTask(node, task.b_node, false));
+                }
+                split = true;
+            }
+            else if (task.b_node->child)
+            {
+                for (face_rtree_t* node = task.b_node->child; node; node = node->sibling)
+                {
+                    next.push_back(CandidateTask(task.a_node, node, true));
+                }
+                split = true;
+            }
+            else
+            {
+                next.push_back(task);
+            }
+        }
+        tasks.swap(next);
+    }
+}
+
+
+void carve::csg::CSG::collectIntersectionCandidates(const face_rtree_t* a_rtree, const face_rtree_t* b_rtree,
+                                                    std::vector<std::pair<meshset_t::face_t*, meshset_t::face_t*>>& face_pairs)
+{
+    // enough tasks for the threads to even out the differences in their sizes
+    std::vector<CandidateTask> tasks(1, CandidateTask(a_rtree, b_rtree, true));
+    splitCandidateTasks(tasks, 16 * (size_t)carve::util::ThreadPool::instance().getThreadCount());
+
+    std::vector<std::vector<std::pair<meshset_t::face_t*, meshset_t::face_t*>>> task_pairs(tasks.size());
+    carve::util::forEachParallel<size_t>(0, tasks.size(), 1, [&](size_t i) {
+        generateIntersectionCandidates(tasks[i].a_node, tasks[i].b_node, task_pairs[i], tasks[i].descend_a);
+    });
+
+    size_t count = 0;
+    for (size_t i = 0; i < task_pairs.size(); ++i)
+    {
+        count += task_pairs[i].size();
+    }
+    face_pairs.reserve(face_pairs.size() + count);
+    for (size_t i = 0; i < task_pairs.size(); ++i)
+    {
+        face_pairs.insert(face_pairs.end(), task_pairs[i].begin(), task_pairs[i].end());
+    }
+}
+
+
+void carve::csg::CSG::generateIntersectionCandidates(const face_rtree_t* a_node, const face_rtree_t* b_node,
+                                                     std::vector<std::pair<meshset_t::face_t*, meshset_t::face_t*>>& face_pairs, bool descend_a)
 {
     if (!a_node->bbox.intersects(b_node->bbox))
     {
@@ -945,14 +1224,14 @@ void carve::csg::CSG::generateIntersectionCandidates(meshset_t* a, const face_rt
     {
         for (face_rtree_t* node = a_node->child; node; node = node->sibling)
         {
-            generateIntersectionCandidates(a, node, b, b_node, face_pairs, false);
+            generateIntersectionCandidates(node, b_node, face_pairs, false);
         }
     }
     else if (b_node->child)
     {
         for (face_rtree_t* node = b_node->child; node; node = node->sibling)
         {
-            generateIntersectionCandidates(a, a_node, b, node, face_pairs, true);
+            generateIntersectionCandidates(a_node, node, face_pairs, true);
         }
     }
     else
@@ -983,8 +1262,7 @@ void carve::csg::CSG::generateIntersectionCandidates(meshset_t* a, const face_rt
 
                 if (!facesAreCoplanar(fa, fb))
                 {
-                    face_pairs[fa].push_back(fb);
-                    face_pairs[fb].push_back(fa);
+                    face_pairs.push_back(std::make_pair(fa, fb));
                 }
             }
         }
@@ -992,56 +1270,135 @@ void carve::csg::CSG::generateIntersectionCandidates(meshset_t* a, const face_rt
 }
 
 
-void carve::csg::CSG::generateIntersections(meshset_t* a, const face_rtree_t* a_rtree, meshset_t* b, const face_rtree_t* b_rtree, detail::Data& data)
+void carve::csg::CSG::makeFacePairs(meshset_t* a, const std::vector<std::pair<meshset_t::face_t*, meshset_t::face_t*>>& pairs, FacePairs& face_pairs)
 {
-    face_pairs_t face_pairs;
-    generateIntersectionCandidates(a, a_rtree, b, b_rtree, face_pairs);
-
-    for (face_pairs_t::const_iterator i = face_pairs.begin(); i != face_pairs.end(); ++i)
+    // every pair gives a partner to each of its faces
+    std::vector<std::pair<meshset_t::face_t*, meshset_t::face_t*>> entries;
+    entries.reserve(pairs.size() * 2);
+    for (size_t i = 0; i < pairs.size(); ++i)
     {
-        meshset_t::face_t* f = (*i).first;
-        meshset_t::edge_t* e = f->edge;
-        do
-        {
-            data.vert_to_edges[e->v1()].push_back(e);
-            e = e->next;
-        } while (e != f->edge);
+        entries.push_back(pairs[i]);
     }
-
-    for (face_pairs_t::const_iterator i = face_pairs.begin(); i != face_pairs.end(); ++i)
+    for (size_t i = 0; i < pairs.size(); ++i)
     {
-        generateVertexVertexIntersections((*i).first, (*i).second);
+        entries.push_back(std::make_pair(pairs[i].second, pairs[i].first));
     }
 
-    for (face_pairs_t::const_iterator i = face_pairs.begin(); i != face_pairs.end(); ++i)
-    {
-        generateVertexEdgeIntersections((*i).first, (*i).second);
-    }
+    // the partners of a face stay in the order in which they were found
+    std::stable_sort(entries.begin(), entries.end(), [a](const std::pair<meshset_t::face_t*, meshset_t::face_t*>& x,
+                                                         const std::pair<meshset_t::face_t*, meshset_t::face_t*>& y) {
+        bool x_in_b = x.first->mesh->meshset != a, y_in_b = y.first->mesh->meshset != a;
+        if (x_in_b != y_in_b)
+            return y_in_b;
+        if (x.first->id != y.first->id)
+            return x.first->id < y.first->id;
+        return std::less<meshset_t::face_t*>()(x.first, y.first);
+    });
 
-    for (face_pairs_t::const_iterator i = face_pairs.begin(); i != face_pairs.end(); ++i)
+    face_pairs.faces.clear();
+    face_pairs.offsets.clear();
+    face_pairs.partners.clear();
+    face_pairs.partners.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i)
     {
-        generateEdgeEdgeIntersections((*i).first, (*i).second);
+        if (i == 0 || entries[i].first != entries[i - 1].first)
+        {
+            face_pairs.faces.push_back(entries[i].first);
+            face_pairs.offsets.push_back(i);
+        }
+        face_pairs.partners.push_back(entries[i].second);
     }
+    face_pairs.offsets.push_back(entries.size());
+}
 
-    for (face_pairs_t::const_iterator i = face_pairs.begin(); i != face_pairs.end(); ++i)
-    {
-        generateVertexFaceIntersections((*i).first, (*i).second);
-    }
 
-    for (face_pairs_t::const_iterator i = face_pairs.begin(); i != face_pairs.end(); ++i)
+void carve::csg::CSG::generateIntersections(meshset_t* a, const face_rtree_t* a_rtree, meshset_t* /* b */, const face_rtree_t* b_rtree, detail::Data& data)
+{
+    FacePairs face_pairs;
     {
-        generateEdgeFaceIntersections((*i).first, (*i).second);
+        PhaseTimer timer(hooks.stats, Stats::CANDIDATES);
+        std::vector<std::pair<meshset_t::face_t*, meshset_t::face_t*>> pairs;
+        collectIntersectionCandidates(a_rtree, b_rtree, pairs);
+        makeFacePairs(a, pairs, face_pairs);
+
+        for (size_t i = 0; i < face_pairs.size(); ++i)
+        {
+            meshset_t::face_t* f = face_pairs.faces[i];
+            meshset_t::edge_t* e = f->edge;
+            do
+            {
+                data.vert_to_edges[e->v1()].push_back(e);
+                e = e->next;
+            } while (e != f->edge);
+        }
+        if (hooks.stats != NULL)
+        {
+            hooks.stats->face_pairs += face_pairs.partners.size();
+        }
     }
 
+    PhaseTimer timer(hooks.stats, Stats::INTERSECTIONS);
+
+    // Each pass finds the intersections of batches of faces in parallel, only looking at what the earlier passes recorded,
+    // then records them in the order of the faces, so the result is the same as that of visiting the faces one by one.
+    // Each of the five passes gets an equal share of the progress range.
+    const size_t batch_size = 64;
+    const size_t batch_count = (face_pairs.size() + batch_size - 1) / batch_size;
+    const double pass_progress = (progress::INTERSECTING_FACE_PAIRS - progress::GENERATE_INTERSECTIONS) / 5.0;
+    const bool report_progress = hooks.hasHook(Hooks::PROGRESS_HOOK);
+    std::vector<candidates_t> batch_candidates(batch_count);
+    auto each_face_pair = [&](int pass, auto func) {
+        carve::util::forEachParallel<size_t>(0, batch_count, 1, [&](size_t batch) {
+            if (report_progress)
+            {
+                hooks.progress(progress::GENERATE_INTERSECTIONS + pass_progress * (pass + (double)batch / batch_count));
+            }
+            candidates_t& out = batch_candidates[batch];
+            out.clear();
+            for (size_t i = batch * batch_size, e = std::min(i + batch_size, face_pairs.size()); i < e; ++i)
+            {
+                face_range_t partners = face_pairs.partners.data();
+                func(face_pairs.faces[i], partners + face_pairs.offsets[i], partners + face_pairs.offsets[i + 1], out);
+            }
+        });
+
+        for (size_t batch = 0; batch < batch_count; ++batch)
+        {
+            for (size_t i = 0; i < batch_candidates[batch].size(); ++i)
+            {
+                recordIntersection(batch_candidates[batch][i]);
+            }
+        }
+    };
+
+    each_face_pair(0, [this](meshset_t::face_t* a, face_range_t b_begin, face_range_t b_end, candidates_t& out) {
+        generateVertexVertexIntersections(a, b_begin, b_end, out);
+    });
+    each_face_pair(1, [this](meshset_t::face_t* a, face_range_t b_begin, face_range_t b_end, candidates_t& out) {
+        generateVertexEdgeIntersections(a, b_begin, b_end, out);
+    });
+    each_face_pair(2, [this](meshset_t::face_t* a, face_range_t b_begin, face_range_t b_end, candidates_t& out) {
+        generateEdgeEdgeIntersections(a, b_begin, b_end, out);
+    });
+    each_face_pair(3, [this](meshset_t::face_t* a, face_range_t b_begin, face_range_t b_end, candidates_t& out) {
+        generateVertexFaceIntersections(a, b_begin, b_end, out);
+    });
+    each_face_pair(4, [this](meshset_t::face_t* a, face_range_t b_begin, face_range_t b_end, candidates_t& out) {
+        generateEdgeFaceIntersections(a, b_begin, b_end, out);
+    });
+
 
 #if defined(CARVE_DEBUG)
     std::cerr << "makeVertexIntersections" << std::endl;
 #endif
     makeVertexIntersections();
+    if (hooks.stats != NULL)
+    {
+        hooks.stats->intersection_vertices += vertex_intersections.size();
+    }
 
 #if defined(CARVE_DEBUG)
     std::cerr << "  intersections.size() " << intersections.size() << std::endl;
-    map_histogram(std::cerr, intersections);
     std::cerr << "  vertex_intersections.size() " << vertex_intersections.size() << std::endl;
     map_histogram(std::cerr, vertex_intersections);
 #endif
@@ -1066,10 +1423,7 @@ void carve::csg::CSG::generateIntersections(meshset_t* a, const face_rtree_t* a_
 
     // from here on, only vertex_intersections is used for intersection
     // information.
-
-    // intersections still contains the vertex_to_face map. maybe that
-    // should be moved out into another class.
-    static_cast<Intersections::super>(intersections).clear();
+    intersections.clear();
 }
 
 
@@ -1088,13 +1442,19 @@ void carve::csg::CSG::divideIntersectedEdges(detail::Data& data)
     static carve::TimingName FUNC_NAME("CSG::divideIntersectedEdges()");
     carve::TimingBlock block(FUNC_NAME);
 
+    // the vectors of the edges are added in order, then each edge is ordered on its own.
+    std::vector<std::pair<detail::EIntMap::const_iterator, std::vector<meshset_t::vertex_t*>*>> edges;
+    edges.reserve(data.emap.size());
     for (detail::EIntMap::const_iterator i = data.emap.begin(), ei = data.emap.end(); i != ei; ++i)
     {
-        meshset_t::edge_t* edge = (*i).first;
-        const detail::EIntMap::mapped_type& int_info = (*i).second;
-        std::vector<meshset_t::vertex_t*>& verts = data.divided_edges[edge];
-        orderEdgeIntersectionVertices(int_info.begin(), int_info.end(), edge->v2()->v - edge->v1()->v, edge->v1()->v, verts);
+        edges.push_back(std::make_pair(i, &data.divided_edges[(*i).first]));
     }
+
+    carve::util::forEachParallel<size_t>(0, edges.size(), 64, [&](size_t i) {
+        meshset_t::edge_t* edge = (*edges[i].first).first;
+        const detail::EIntMap::mapped_type& int_info = (*edges[i].first).second;
+        orderEdgeIntersectionVertices(int_info.begin(), int_info.end(), edge->v2()->v - edge->v1()->v, edge->v1()->v, *edges[i].second);
+    });
 }
 
 
@@ -1105,133 +1465,153 @@ carve::csg::CSG::~CSG()
 
 void carve::csg::CSG::makeFaceEdges(carve::csg::EdgeClassification& eclass, detail::Data& data)
 {
-    detail::FSet face_b_set;
+    // the faces are processed in parallel batches, which only read fmap and fmap_rev. the edges that they find are
+    // added to face_split_edges afterwards.
+    std::vector<detail::FVSMap::const_iterator> faces;
+    faces.reserve(data.fmap.size());
     for (detail::FVSMap::const_iterator i = data.fmap.begin(), ie = data.fmap.end(); i != ie; ++i)
     {
-        meshset_t::face_t* face_a = (*i).first;
-        const detail::FVSMap::mapped_type& face_a_intersections = ((*i).second);
-        face_b_set.clear();
+        faces.push_back(i);
+    }
 
-        // work out the set of faces from the opposing polyhedron that intersect face_a.
-        for (detail::FVSMap::mapped_type::const_iterator j = face_a_intersections.begin(), je = face_a_intersections.end(); j != je; ++j)
+    const size_t batch_size = 64;
+    const size_t batch_count = (faces.size() + batch_size - 1) / batch_size;
+    std::vector<std::vector<std::pair<meshset_t::face_t*, V2>>> split_edges(batch_count);
+    carve::util::forEachParallel<size_t>(0, batch_count, 1, [&](size_t batch_index) {
+        std::vector<std::pair<meshset_t::face_t*, V2>>& face_split_edges = split_edges[batch_index];
+        detail::FSet face_b_set;
+        for (size_t i = batch_index * batch_size, ie = std::min(i + batch_size, faces.size()); i < ie; ++i)
         {
-            for (detail::VFSMap::mapped_type::const_iterator k = data.fmap_rev[*j].begin(), ke = data.fmap_rev[*j].end(); k != ke; ++k)
+            meshset_t::face_t* face_a = (*faces[i]).first;
+            const detail::FVSMap::mapped_type& face_a_intersections = ((*faces[i]).second);
+            face_b_set.clear();
+
+            // work out the set of faces from the opposing polyhedron that intersect face_a.
+            for (detail::FVSMap::mapped_type::const_iterator j = face_a_intersections.begin(), je = face_a_intersections.end(); j != je; ++j)
             {
-                meshset_t::face_t* face_b = (*k);
-                if (face_a != face_b && face_b->mesh->meshset != face_a->mesh->meshset)
+                // every intersection point of a face has the face in its set.
+                const detail::VFSMap::mapped_type& face_set = (*data.fmap_rev.find(*j)).second;
+                for (detail::VFSMap::mapped_type::const_iterator k = face_set.begin(), ke = face_set.end(); k != ke; ++k)
                 {
-                    face_b_set.insert(face_b);
+                    meshset_t::face_t* face_b = (*k);
+                    if (face_a != face_b && face_b->mesh->meshset != face_a->mesh->meshset)
+                    {
+                        face_b_set.insert(face_b);
+                    }
                 }
             }
-        }
 
-        // run through each intersecting face.
-        for (detail::FSet::const_iterator j = face_b_set.begin(), je = face_b_set.end(); j != je; ++j)
-        {
-            meshset_t::face_t* face_b = (*j);
-            const detail::FVSMap::mapped_type& face_b_intersections = (data.fmap[face_b]);
+            // run through each intersecting face.
+            for (detail::FSet::const_iterator j = face_b_set.begin(), je = face_b_set.end(); j != je; ++j)
+            {
+                meshset_t::face_t* face_b = (*j);
+                const detail::FVSMap::mapped_type& face_b_intersections = (*data.fmap.find(face_b)).second;
 
-            std::vector<meshset_t::vertex_t*> vertices;
-            vertices.reserve(std::min(face_a_intersections.size(), face_b_intersections.size()));
+                std::vector<meshset_t::vertex_t*> vertices;
+                vertices.reserve(std::min(face_a_intersections.size(), face_b_intersections.size()));
 
-            // record the points of intersection between face_a and face_b
-            std::set_intersection(face_a_intersections.begin(), face_a_intersections.end(), face_b_intersections.begin(), face_b_intersections.end(),
-                                  std::back_inserter(vertices));
+                // record the points of intersection between face_a and face_b
+                std::set_intersection(face_a_intersections.begin(), face_a_intersections.end(), face_b_intersections.begin(), face_b_intersections.end(),
+                                      std::back_inserter(vertices));
 
 #if defined(CARVE_DEBUG)
-            std::cerr << "face pair: " << face_a << ":" << face_b << " N(verts) " << vertices.size() << std::endl;
-            for (std::vector<meshset_t::vertex_t*>::const_iterator i = vertices.begin(), e = vertices.end(); i != e; ++i)
-            {
-                std::cerr << (*i) << " " << (*i)->v << " (" << carve::geom::distance(face_a->plane, (*i)->v) << ","
-                          << carve::geom::distance(face_b->plane, (*i)->v) << ")" << std::endl;
-                // CARVE_ASSERT(carve::geom3d::distance(face_a->plane_eqn, *(*i)) < EPSILON);
-                // CARVE_ASSERT(carve::geom3d::distance(face_b->plane_eqn, *(*i)) < EPSILON);
-            }
+                std::cerr << "face pair: " << face_a << ":" << face_b << " N(verts) " << vertices.size() << std::endl;
+                for (std::vector<meshset_t::vertex_t*>::const_iterator i = vertices.begin(), e = vertices.end(); i != e; ++i)
+                {
+                    std::cerr << (*i) << " " << (*i)->v << " (" << carve::geom::distance(face_a->plane, (*i)->v) << ","
+                              << carve::geom::distance(face_b->plane, (*i)->v) << ")" << std::endl;
+                    // CARVE_ASSERT(carve::geom3d::distance(face_a->plane_eqn, *(*i)) < EPSILON);
+                    // CARVE_ASSERT(carve::geom3d::distance(face_b->plane_eqn, *(*i)) < EPSILON);
+                }
 #endif
 
-            // if there are two points of intersection, then the added edge is simple to determine.
-            if (vertices.size() == 2)
-            {
-                meshset_t::vertex_t* v1 = vertices[0];
-                meshset_t::vertex_t* v2 = vertices[1];
-                carve::geom3d::Vector c = (v1->v + v2->v) / 2;
+                // if there are two points of intersection, then the added edge is simple to determine.
+                if (vertices.size() == 2)
+                {
+                    meshset_t::vertex_t* v1 = vertices[0];
+                    meshset_t::vertex_t* v2 = vertices[1];
+                    carve::geom3d::Vector c = (v1->v + v2->v) / 2;
 
-                // determine whether the midpoint of the implied edge is contained in face_a and face_b
+                    // determine whether the midpoint of the implied edge is contained in face_a and face_b
 
 #if defined(CARVE_DEBUG)
-                std::cerr << "face_a->nVertices() = " << face_a->nVertices()
-                          << " face_a->containsPointInProjection(c) = " << face_a->containsPointInProjection(c) << std::endl;
-                std::cerr << "face_b->nVertices() = " << face_b->nVertices()
-                          << " face_b->containsPointInProjection(c) = " << face_b->containsPointInProjection(c) << std::endl;
+                    std::cerr << "face_a->nVertices() = " << face_a->nVertices()
+                              << " face_a->containsPointInProjection(c) = " << face_a->containsPointInProjection(c) << std::endl;
+                    std::cerr << "face_b->nVertices() = " << face_b->nVertices()
+                              << " face_b->containsPointInProjection(c) = " << face_b->containsPointInProjection(c) << std::endl;
 #endif
 
-                if (face_a->containsPointInProjection(c) && face_b->containsPointInProjection(c))
-                {
+                    if (face_a->containsPointInProjection(c) && face_b->containsPointInProjection(c))
+                    {
 #if defined(CARVE_DEBUG)
-                    std::cerr << "adding edge: " << v1 << "-" << v2 << std::endl;
+                        std::cerr << "adding edge: " << v1 << "-" << v2 << std::endl;
 #if defined(DEBUG_DRAW_FACE_EDGES)
-                    HOOK(drawEdge(v1, v2, 1, 1, 1, 1, 1, 1, 1, 1, 2.0););
+                        HOOK(drawEdge(v1, v2, 1, 1, 1, 1, 1, 1, 1, 1, 2.0););
 #endif
 #endif
-                    // record the edge, with class information.
-                    if (v1 > v2)
-                        std::swap(v1, v2);
-                    // eclass[ordered_edge(v1, v2)] = carve::csg::EC2(carve::csg::EdgeClass::EDGE_ON, carve::csg::EdgeClass::EDGE_ON);
-                    data.face_split_edges[face_a].insert(std::make_pair(v1, v2));
-                    data.face_split_edges[face_b].insert(std::make_pair(v1, v2));
+                        // record the edge, with class information.
+                        if (v1 > v2)
+                            std::swap(v1, v2);
+                        // eclass[ordered_edge(v1, v2)] = carve::csg::EC2(carve::csg::EdgeClass::EDGE_ON, carve::csg::EdgeClass::EDGE_ON);
+                        face_split_edges.push_back(std::make_pair(face_a, std::make_pair(v1, v2)));
+                        face_split_edges.push_back(std::make_pair(face_b, std::make_pair(v1, v2)));
+                    }
+                    continue;
                 }
-                continue;
-            }
 
-            // otherwise, it's more complex.
-            carve::geom3d::Vector base, dir;
-            std::vector<meshset_t::vertex_t*> ordered;
+                // otherwise, it's more complex.
+                carve::geom3d::Vector base, dir;
+                std::vector<meshset_t::vertex_t*> ordered;
 
-            // skip coplanar edges. this simplifies the resulting
-            // mesh. eventually all coplanar face regions of two polyhedra
-            // must reach a point where they are no longer coplanar (or the
-            // polyhedra are identical).
-            if (!facesAreCoplanar(face_a, face_b))
-            {
-                // order the intersection vertices (they must lie along a
-                // vector, as the faces aren't coplanar).
-                selectOrderingProjection(vertices.begin(), vertices.end(), dir, base);
-                orderVertices(vertices.begin(), vertices.end(), dir, base, ordered);
-
-                // for each possible edge in the ordering, test the midpoint,
-                // and record if it's contained in face_a and face_b.
-                for (size_t k = 0, ke = ordered.size() - 1; k < ke; ++k)
+                // skip coplanar edges. this simplifies the resulting
+                // mesh. eventually all coplanar face regions of two polyhedra
+                // must reach a point where they are no longer coplanar (or the
+                // polyhedra are identical).
+                if (!facesAreCoplanar(face_a, face_b))
                 {
-                    meshset_t::vertex_t* v1 = ordered[k];
-                    meshset_t::vertex_t* v2 = ordered[k + 1];
-                    carve::geom3d::Vector c = (v1->v + v2->v) / 2;
+                    // order the intersection vertices (they must lie along a
+                    // vector, as the faces aren't coplanar).
+                    selectOrderingProjection(vertices.begin(), vertices.end(), dir, base);
+                    orderVertices(vertices.begin(), vertices.end(), dir, base, ordered);
+
+                    // for each possible edge in the ordering, test the midpoint,
+                    // and record if it's contained in face_a and face_b.
+                    for (size_t k = 0, ke = ordered.size() - 1; k < ke; ++k)
+                    {
+                        meshset_t::vertex_t* v1 = ordered[k];
+                        meshset_t::vertex_t* v2 = ordered[k + 1];
+                        carve::geom3d::Vector c = (v1->v + v2->v) / 2;
 
 #if defined(CARVE_DEBUG)
-                    std::cerr << "testing edge: " << v1 << "-" << v2 << " at " << c << std::endl;
-                    std::cerr << "a: " << face_a->containsPointInProjection(c) << " b: " << face_b->containsPointInProjection(c) << std::endl;
-                    std::cerr << "face_a->containsPointInProjection(c): " << face_a->containsPointInProjection(c) << std::endl;
-                    std::cerr << "face_b->containsPointInProjection(c): " << face_b->containsPointInProjection(c) << std::endl;
+                        std::cerr << "testing edge: " << v1 << "-" << v2 << " at " << c << std::endl;
+                        std::cerr << "a: " << face_a->containsPointInProjection(c) << " b: " << face_b->containsPointInProjection(c) << std::endl;
+                        std::cerr << "face_a->containsPointInProjection(c): " << face_a->containsPointInProjection(c) << std::endl;
+                        std::cerr << "face_b->containsPointInProjection(c): " << face_b->containsPointInProjection(c) << std::endl;
 #endif
 
-                    if (face_a->containsPointInProjection(c) && face_b->containsPointInProjection(c))
-                    {
+                        if (face_a->containsPointInProjection(c) && face_b->containsPointInProjection(c))
+                        {
 #if defined(CARVE_DEBUG)
-                        std::cerr << "adding edge: " << v1 << "-" << v2 << std::endl;
+                            std::cerr << "adding edge: " << v1 << "-" << v2 << std::endl;
 #if defined(DEBUG_DRAW_FACE_EDGES)
-                        HOOK(drawEdge(v1, v2, .5, .5, .5, 1, .5, .5, .5, 1, 2.0););
+                            HOOK(drawEdge(v1, v2, .5, .5, .5, 1, .5, .5, .5, 1, 2.0););
 #endif
 #endif
-                        // record the edge, with class information.
-                        if (v1 > v2)
-                            std::swap(v1, v2);
-                        // eclass[ordered_edge(v1, v2)] = carve::csg::EC2(carve::csg::EdgeClass::EDGE_ON, carve::csg::EdgeClass::EDGE_ON);
-                        data.face_split_edges[face_a].insert(std::make_pair(v1, v2));
-                        data.face_split_edges[face_b].insert(std::make_pair(v1, v2));
+                            // record the edge, with class information.
+                            if (v1 > v2)
+                                std::swap(v1, v2);
+                            // eclass[ordered_edge(v1, v2)] = carve::csg::EC2(carve::csg::EdgeClass::EDGE_ON, carve::csg::EdgeClass::EDGE_ON);
+                            face_split_edges.push_back(std::make_pair(face_a, std::make_pair(v1, v2)));
+                            face_split_edges.push_back(std::make_pair(face_b, std::make_pair(v1, v2)));
+                        }
                     }
                 }
             }
         }
-    }
+    });
+
+    insertIntoSets(data.face_split_edges, split_edges);
+
 
 
 #if defined(CARVE_DEBUG_WRITE_PLY_DATA)
@@ -1288,7 +1668,7 @@ static void checkFaceLoopIntegrity(carve::csg::FaceLoopList& fll)
     carve::unordered_map<carve::csg::V2, int, carve::hash_pair> counts;
     for (carve::csg::FaceLoop* fl = fll.head; fl; fl = fl->next)
     {
-        std::vector<carve::mesh::MeshSet<3>::vertex_t*>& loop = (fl->vertices);
+        carve::csg::FaceLoop::vertex_list_t& loop = (fl->vertices);
         carve::mesh::MeshSet<3>::vertex_t *v1, *v2;
         v1 = loop[loop.size() - 1];
         for (unsigned i = 0; i < loop.size(); ++i)
@@ -1328,9 +1708,30 @@ static void checkFaceLoopIntegrity(carve::csg::FaceLoopList& fll)
  * @param b_edge_count
  * @param hooks
  */
+void carve::csg::CSG::initVertexClassification(meshset_t* a, meshset_t* b, const detail::Data& data, carve::csg::VertexClassification& vclass)
+{
+#if defined(CARVE_DEBUG)
+    std::cerr << "classify" << std::endl;
+#endif
+    // initialize some classification information.
+    vclass.init(data.vertex_ids);
+    for (std::vector<meshset_t::vertex_t>::iterator i = a->vertex_storage.begin(), e = a->vertex_storage.end(); i != e; ++i)
+    {
+        vclass[map_vertex(data.vmap, data.vertex_ids, &(*i))].cls[0] = PointClass::POINT_ON;
+    }
+    for (std::vector<meshset_t::vertex_t>::iterator i = b->vertex_storage.begin(), e = b->vertex_storage.end(); i != e; ++i)
+    {
+        vclass[map_vertex(data.vmap, data.vertex_ids, &(*i))].cls[1] = PointClass::POINT_ON;
+    }
+    for (VertexIntersections::const_iterator i = vertex_intersections.begin(), e = vertex_intersections.end(); i != e; ++i)
+    {
+        vclass[(*i).first] = PC2(PointClass::POINT_ON, PointClass::POINT_ON);
+    }
+}
+
 void carve::csg::CSG::calc(meshset_t* a, const face_rtree_t* a_rtree, meshset_t* b, const face_rtree_t* b_rtree, carve::csg::VertexClassification& vclass,
-                           carve::csg::EdgeClassification& eclass, carve::csg::FaceLoopList& a_face_loops, carve::csg::FaceLoopList& b_face_loops,
-                           size_t& a_edge_count, size_t& b_edge_count)
+                           carve::csg::EdgeClassification& eclass, carve::MemoryArena& loop_memory, carve::csg::FaceLoopList& a_face_loops,
+                           carve::csg::FaceLoopList& b_face_loops, size_t& a_edge_count, size_t& b_edge_count)
 {
     detail::Data data;
 
@@ -1339,11 +1740,18 @@ void carve::csg::CSG::calc(meshset_t* a, const face_rtree_t* a_rtree, meshset_t*
 #endif
     init();
 
+    hooks.progress(progress::GENERATE_INTERSECTIONS);
     generateIntersections(a, a_rtree, b, b_rtree, data);
 
+    // the vertex pool is complete, so every vertex of the operation has its id from here on.
+    data.vertex_ids = VertexIds(a, b, vertex_pool);
+    data.vmap.assign(data.vertex_ids.size(), NULL);
+
 #if defined(CARVE_DEBUG)
     std::cerr << "intersectingFacePairs" << std::endl;
 #endif
+    hooks.progress(progress::INTERSECTING_FACE_PAIRS);
+    PhaseTimer timer(hooks.stats, Stats::INTERSECTIONS);
     intersectingFacePairs(data);
 
 #if defined(CARVE_DEBUG)
@@ -1366,19 +1774,49 @@ void carve::csg::CSG::calc(meshset_t* a, const face_rtree_t* a_rtree, meshset_t*
 #if defined(CARVE_DEBUG)
     std::cerr << "divideIntersectedEdges" << std::endl;
 #endif
+    hooks.progress(progress::DIVIDE_EDGES);
     divideIntersectedEdges(data);
 
 #if defined(CARVE_DEBUG)
     std::cerr << "makeFaceEdges" << std::endl;
 #endif
     // makeFaceEdges(data.face_split_edges, eclass, data.fmap, data.fmap_rev);
+    hooks.progress(progress::MAKE_FACE_EDGES);
     makeFaceEdges(eclass, data);
+    timer.stop();
 
 #if defined(CARVE_DEBUG)
     std::cerr << "generateFaceLoops" << std::endl;
 #endif
-    a_edge_count = generateFaceLoops(a, data, a_face_loops);
-    b_edge_count = generateFaceLoops(b, data, b_face_loops);
+    {
+        // the face loops of a and b, and the initial classification of the vertices, are independent of each other
+        PhaseTimer timer(hooks.stats, Stats::FACE_LOOPS);
+        const double face_loops_middle = (progress::GENERATE_FACE_LOOPS + progress::GROUP_FACE_LOOPS) / 2.0;
+        std::vector<EdgeDivision> a_edge_divisions, b_edge_divisions;
+        carve::util::TaskGroup group;
+        group.run([&]() {
+            a_edge_count = generateFaceLoops(a, data, loop_memory, a_face_loops, a_edge_divisions, progress::GENERATE_FACE_LOOPS, face_loops_middle);
+        });
+        group.run([&]() {
+            b_edge_count = generateFaceLoops(b, data, loop_memory, b_face_loops, b_edge_divisions, face_loops_middle, progress::GROUP_FACE_LOOPS);
+        });
+        group.run([&]() { initVertexClassification(a, b, data, vclass); });
+        group.wait();
+
+        // the edge division hooks see the edges of a and then those of b, one at a time
+        for (size_t i = 0; i < a_edge_divisions.size(); ++i)
+        {
+            hooks.edgeDivision(a_edge_divisions[i].orig_edge, a_edge_divisions[i].orig_edge_idx, a_edge_divisions[i].v1, a_edge_divisions[i].v2);
+        }
+        for (size_t i = 0; i < b_edge_divisions.size(); ++i)
+        {
+            hooks.edgeDivision(b_edge_divisions[i].orig_edge, b_edge_divisions[i].orig_edge_idx, b_edge_divisions[i].v1, b_edge_divisions[i].v2);
+        }
+    }
+    if (hooks.stats != NULL)
+    {
+        hooks.stats->face_loops += a_face_loops.size() + b_face_loops.size();
+    }
 
 #if defined(CARVE_DEBUG)
     std::cerr << "generated " << a_edge_count << " edges for poly a" << std::endl;
@@ -1399,23 +1837,6 @@ void carve::csg::CSG::calc(meshset_t* a, const face_rtree_t* a_rtree, meshset_t*
     // checkFaceLoopIntegrity(a_face_loops);
     // checkFaceLoopIntegrity(b_face_loops);
 
-#if defined(CARVE_DEBUG)
-    std::cerr << "classify" << std::endl;
-#endif
-    // initialize some classification information.
-    for (std::vector<meshset_t::vertex_t>::iterator i = a->vertex_storage.begin(), e = a->vertex_storage.end(); i != e; ++i)
-    {
-        vclass[map_vertex(data.vmap, &(*i))].cls[0] = PointClass::POINT_ON;
-    }
-    for (std::vector<meshset_t::vertex_t>::iterator i = b->vertex_storage.begin(), e = b->vertex_storage.end(); i != e; ++i)
-    {
-        vclass[map_vertex(data.vmap, &(*i))].cls[1] = PointClass::POINT_ON;
-    }
-    for (VertexIntersections::const_iterator i = vertex_intersections.begin(), e = vertex_intersections.end(); i != e; ++i)
-    {
-        vclass[(*i).first] = PC2(PointClass::POINT_ON, PointClass::POINT_ON);
-    }
-
 #if defined(CARVE_DEBUG)
     std::cerr << data.divided_edges.size() << " edges are split" << std::endl;
     std::cerr << data.face_split_edges.size() << " faces are split" << std::endl;
@@ -1478,10 +1899,66 @@ void returnSharedEdges(carve::csg::V2Set& shared_edges, std::list<carve::mesh::M
  */
 carve::mesh::MeshSet<3>* carve::csg::CSG::compute(meshset_t* a, meshset_t* b, carve::csg::CSG::Collector& collector, carve::csg::V2Set* shared_edges_ptr,
                                                   CLASSIFY_TYPE classify_type)
+{
+    return compute(a, NULL, b, NULL, collector, shared_edges_ptr, classify_type);
+}
+
+
+// Adds the spans of the steps of a computation to the statistics, and to every phase the time from the start of its first
+// step to the end of its last one, so that steps of a phase that overlap count once.
+static void recordSpans(carve::csg::Stats* stats, const carve::util::TaskGraph& graph,
+                        const std::vector<std::pair<carve::util::TaskGraph::node_t, carve::csg::Stats::Phase>>& node_phases)
+{
+    if (stats == NULL)
+    {
+        return;
+    }
+
+    const std::vector<carve::util::TaskGraph::Span>& spans = graph.getSpans();
+    stats->spans.insert(stats->spans.end(), spans.begin(), spans.end());
+
+    for (int phase = 0; phase < carve::csg::Stats::PHASE_MAX; ++phase)
+    {
+        double begin = std::numeric_limits<double>::max(), end = 0.0;
+        for (size_t i = 0; i < node_phases.size(); ++i)
+        {
+            const carve::util::TaskGraph::Span& span = spans[node_phases[i].first];
+            if (node_phases[i].second == phase && span.begin >= 0.0)
+            {
+                begin = std::min(begin, span.begin);
+                end = std::max(end, span.begin + span.seconds);
+            }
+        }
+        if (begin < end)
+        {
+            stats->seconds[phase] += end - begin;
+        }
+    }
+}
+
+
+/**
+ *
+ *
+ * @param a
+ * @param a_prepared_rtree
+ * @param b
+ * @param b_prepared_rtree
+ * @param collector
+ * @param shared_edges_ptr
+ * @param classify_type
+ *
+ * @return
+ */
+carve::mesh::MeshSet<3>* carve::csg::CSG::compute(meshset_t* a, const face_rtree_t* a_prepared_rtree, meshset_t* b, const face_rtree_t* b_prepared_rtree,
+                                                  carve::csg::CSG::Collector& collector, carve::csg::V2Set* shared_edges_ptr, CLASSIFY_TYPE classify_type)
 {
     static carve::TimingName FUNC_NAME("CSG::compute");
     carve::TimingBlock block(FUNC_NAME);
 
+    // the face loops of this call, released in one step when it returns
+    carve::MemoryArena loop_memory;
+
     VertexClassification vclass;
     EdgeClassification eclass; // unused
 
@@ -1494,104 +1971,146 @@ carve::mesh::MeshSet<3>* carve::csg::CSG::compute(meshset_t* a, meshset_t* b, ca
     size_t a_edge_count;
     size_t b_edge_count;
 
-    vclass.reserve((size_t)((a->vertex_storage.size() + b->vertex_storage.size()) * 1.5));
 
-    std::shared_ptr<face_rtree_t> a_rtree(face_rtree_t::construct_STR(a->faceBegin(), a->faceEnd(), 4, 4));
-    std::shared_ptr<face_rtree_t> b_rtree(face_rtree_t::construct_STR(b->faceBegin(), b->faceEnd(), 4, 4));
+    hooks.resetProgress();
+    hooks.progress(progress::GENERATE_INTERSECTIONS);
 
+    // The steps run as a graph, so that the steps for a and b that do not depend on each other overlap.
+    carve::util::TaskGraph graph;
+    std::vector<std::pair<carve::util::TaskGraph::node_t, Stats::Phase>> node_phases;
+
+    // R-trees that were not supplied by the caller are owned by this call.
+    std::unique_ptr<face_rtree_t> a_rtree_owned, b_rtree_owned;
+    const face_rtree_t* a_rtree = a_prepared_rtree;
+    const face_rtree_t* b_rtree = b_prepared_rtree;
+    std::vector<carve::util::TaskGraph::node_t> rtree_nodes;
+    if (a_rtree == NULL)
     {
+        rtree_nodes.push_back(graph.add("a R-tree", [&]() {
+            a_rtree_owned.reset(face_rtree_t::construct_STR(a->faceBegin(), a->faceEnd(), 4, 4));
+            a_rtree = a_rtree_owned.get();
+            hooks.progress(progress::GENERATE_INTERSECTIONS);
+        }));
+        node_phases.push_back(std::make_pair(rtree_nodes.back(), Stats::RTREE_BUILD));
+    }
+    if (b_rtree == NULL)
+    {
+        rtree_nodes.push_back(graph.add("b R-tree", [&]() {
+            b_rtree_owned.reset(face_rtree_t::construct_STR(b->faceBegin(), b->faceEnd(), 4, 4));
+            b_rtree = b_rtree_owned.get();
+            hooks.progress(progress::GENERATE_INTERSECTIONS);
+        }));
+        node_phases.push_back(std::make_pair(rtree_nodes.back(), Stats::RTREE_BUILD));
+    }
+
+    carve::util::TaskGraph::node_t calc_node = graph.add("calc", [&]() {
         static carve::TimingName FUNC_NAME("CSG::compute - calc()");
         carve::TimingBlock block(FUNC_NAME);
-        calc(a, a_rtree.get(), b, b_rtree.get(), vclass, eclass, a_face_loops, b_face_loops, a_edge_count, b_edge_count);
-    }
+        calc(a, a_rtree, b, b_rtree, vclass, eclass, loop_memory, a_face_loops, b_face_loops, a_edge_count, b_edge_count);
+        hooks.progress(progress::GROUP_FACE_LOOPS);
+    }, rtree_nodes);
 
     detail::LoopEdges a_edge_map;
     detail::LoopEdges b_edge_map;
 
-    auto calc_num_edges = [](meshset_t* meshset) {
-        size_t count = 0;
+    auto make_edge_map = [this](meshset_t* meshset, FaceLoopList& face_loops, const size_t& edge_count, detail::LoopEdges& edge_map) {
+        size_t num_edges = 0;
         for (meshset_t::mesh_t* mesh : meshset->meshes)
         {
-            count += mesh->open_edges.size() + mesh->closed_edges.size();
+            num_edges += mesh->open_edges.size() + mesh->closed_edges.size();
         }
-        return count;
-    };
-
-    a_edge_map.reserve(calc_num_edges(a) * 3);
-    b_edge_map.reserve(calc_num_edges(b) * 3);
+        edge_map.reserve(num_edges * 3);
 
-    {
         static carve::TimingName FUNC_NAME("CSG::compute - makeEdgeMap()");
         carve::TimingBlock block(FUNC_NAME);
-        makeEdgeMap(a_face_loops, a_edge_count, a_edge_map);
-        makeEdgeMap(b_face_loops, b_edge_count, b_edge_map);
-    }
+        makeEdgeMap(face_loops, edge_count, edge_map);
+        edge_map.sortFaceLoopLists();
+    };
 
-    {
-        static carve::TimingName FUNC_NAME("CSG::compute - sortFaceLoopLists()");
-        carve::TimingBlock block(FUNC_NAME);
-        a_edge_map.sortFaceLoopLists();
-        b_edge_map.sortFaceLoopLists();
-    }
+    carve::util::TaskGraph::node_t a_edge_map_node = graph.add("a edge map", [&]() { make_edge_map(a, a_face_loops, a_edge_count, a_edge_map); }, { calc_node });
+    carve::util::TaskGraph::node_t b_edge_map_node = graph.add("b edge map", [&]() { make_edge_map(b, b_face_loops, b_edge_count, b_edge_map); }, { calc_node });
 
     V2Set shared_edges;
 
-    {
+    carve::util::TaskGraph::node_t shared_edges_node = graph.add("shared edges", [&]() {
         static carve::TimingName FUNC_NAME("CSG::compute - findSharedEdges()");
         carve::TimingBlock block(FUNC_NAME);
         findSharedEdges(a_edge_map, b_edge_map, shared_edges);
-    }
+    }, { a_edge_map_node, b_edge_map_node });
 
-    {
+    carve::util::TaskGraph::node_t a_groups_node = graph.add("a groups", [&]() {
         static carve::TimingName FUNC_NAME("CSG::compute - groupFaceLoops()");
         carve::TimingBlock block(FUNC_NAME);
         groupFaceLoops(a, a_face_loops, a_edge_map, shared_edges, a_loops_grouped);
+    }, { shared_edges_node });
+    carve::util::TaskGraph::node_t b_groups_node = graph.add("b groups", [&]() {
+        static carve::TimingName FUNC_NAME("CSG::compute - groupFaceLoops()");
+        carve::TimingBlock block(FUNC_NAME);
         groupFaceLoops(b, b_face_loops, b_edge_map, shared_edges, b_loops_grouped);
+    }, { shared_edges_node });
+
+    node_phases.push_back(std::make_pair(a_edge_map_node, Stats::GROUPING));
+    node_phases.push_back(std::make_pair(b_edge_map_node, Stats::GROUPING));
+    node_phases.push_back(std::make_pair(shared_edges_node, Stats::GROUPING));
+    node_phases.push_back(std::make_pair(a_groups_node, Stats::GROUPING));
+    node_phases.push_back(std::make_pair(b_groups_node, Stats::GROUPING));
+
+    carve::util::TaskGraph::node_t classify_node = graph.add("classify", [&]() {
 #if defined(CARVE_DEBUG)
         std::cerr << "*** a_loops_grouped.size(): " << a_loops_grouped.size() << std::endl;
         std::cerr << "*** b_loops_grouped.size(): " << b_loops_grouped.size() << std::endl;
 #endif
-    }
-
 #if defined(CARVE_DEBUG) && defined(DEBUG_DRAW_GROUPS)
-    {
-        float n = 1.0 / (a_loops_grouped.size() + b_loops_grouped.size() + 1);
-        float H = 0.0, S = 1.0, V = 1.0;
-        float r, g, b;
-        for (FLGroupList::const_iterator i = a_loops_grouped.begin(); i != a_loops_grouped.end(); ++i)
         {
-            carve::colour::HSV2RGB(H, S, V, r, g, b);
-            H += n;
-            drawFaceLoopList((*i).face_loops, r, g, b, 1.0, r * .5, g * .5, b * .5, 1.0, true);
+            float n = 1.0 / (a_loops_grouped.size() + b_loops_grouped.size() + 1);
+            float H = 0.0, S = 1.0, V = 1.0;
+            float r, g, b;
+            for (FLGroupList::const_iterator i = a_loops_grouped.begin(); i != a_loops_grouped.end(); ++i)
+            {
+                carve::colour::HSV2RGB(H, S, V, r, g, b);
+                H += n;
+                drawFaceLoopList((*i).face_loops, r, g, b, 1.0, r * .5, g * .5, b * .5, 1.0, true);
+            }
+            for (FLGroupList::const_iterator i = b_loops_grouped.begin(); i != b_loops_grouped.end(); ++i)
+            {
+                carve::colour::HSV2RGB(H, S, V, r, g, b);
+                H += n;
+                drawFaceLoopList((*i).face_loops, r, g, b, 1.0, r * .5, g * .5, b * .5, 1.0, true);
+            }
+
+            for (FLGroupList::const_iterator i = a_loops_grouped.begin(); i != a_loops_grouped.end(); ++i)
+            {
+                drawFaceLoopListWireframe((*i).face_loops);
+            }
+            for (FLGroupList::const_iterator i = b_loops_grouped.begin(); i != b_loops_grouped.end(); ++i)
+            {
+                drawFaceLoopListWireframe((*i).face_loops);
+            }
         }
-        for (FLGroupList::const_iterator i = b_loops_grouped.begin(); i != b_loops_grouped.end(); ++i)
+#endif
+        if (hooks.stats != NULL)
         {
-            carve::colour::HSV2RGB(H, S, V, r, g, b);
-            H += n;
-            drawFaceLoopList((*i).face_loops, r, g, b, 1.0, r * .5, g * .5, b * .5, 1.0, true);
+            hooks.stats->groups += a_loops_grouped.size() + b_loops_grouped.size();
         }
 
-        for (FLGroupList::const_iterator i = a_loops_grouped.begin(); i != a_loops_grouped.end(); ++i)
+        hooks.progress(progress::CLASSIFY);
+        switch (classify_type)
         {
-            drawFaceLoopListWireframe((*i).face_loops);
+        case CLASSIFY_TYPE::CLASSIFY_EDGE:
+            classifyFaceGroupsEdge(shared_edges, vclass, a, a_rtree, a_loops_grouped, a_edge_map, b, b_rtree, b_loops_grouped, b_edge_map, collector);
+            break;
+        case CLASSIFY_TYPE::CLASSIFY_NORMAL:
+            classifyFaceGroups(shared_edges, vclass, a, a_rtree, a_loops_grouped, a_edge_map, b, b_rtree, b_loops_grouped, b_edge_map, collector);
+            break;
         }
-        for (FLGroupList::const_iterator i = b_loops_grouped.begin(); i != b_loops_grouped.end(); ++i)
-        {
-            drawFaceLoopListWireframe((*i).face_loops);
-        }
-    }
-#endif
+    }, { a_groups_node, b_groups_node });
+    node_phases.push_back(std::make_pair(classify_node, Stats::CLASSIFICATION));
 
-    switch (classify_type)
-    {
-    case CLASSIFY_TYPE::CLASSIFY_EDGE:
-        classifyFaceGroupsEdge(shared_edges, vclass, a, a_rtree.get(), a_loops_grouped, a_edge_map, b, b_rtree.get(), b_loops_grouped, b_edge_map, collector);
-        break;
-    case CLASSIFY_TYPE::CLASSIFY_NORMAL:
-        classifyFaceGroups(shared_edges, vclass, a, a_rtree.get(), a_loops_grouped, a_edge_map, b, b_rtree.get(), b_loops_grouped, b_edge_map, collector);
-        break;
-    }
+    graph.run();
+    recordSpans(hooks.stats, graph, node_phases);
 
+    hooks.progress(progress::COLLECT);
+    PhaseTimer collection_timer(hooks.stats, Stats::COLLECTION);
     meshset_t* result = collector.done(hooks);
     if (result != NULL && shared_edges_ptr != NULL)
     {
@@ -1647,6 +2166,8 @@ bool carve::csg::CSG::sliceAndClassify(meshset_t* closed, meshset_t* open, std::
 {
     if (!closed->isClosed())
         return false;
+    carve::MemoryArena loop_memory;
+
     carve::csg::VertexClassification vclass;
     carve::csg::EdgeClassification eclass;
 
@@ -1662,7 +2183,7 @@ bool carve::csg::CSG::sliceAndClassify(meshset_t* closed, meshset_t* open, std::
     std::shared_ptr<face_rtree_t> closed_rtree(face_rtree_t::construct_STR(closed->faceBegin(), closed->faceEnd(), 4, 4));
     std::shared_ptr<face_rtree_t> open_rtree(face_rtree_t::construct_STR(open->faceBegin(), open->faceEnd(), 4, 4));
 
-    calc(closed, closed_rtree.get(), open, open_rtree.get(), vclass, eclass, a_face_loops, b_face_loops, a_edge_count, b_edge_count);
+    calc(closed, closed_rtree.get(), open, open_rtree.get(), vclass, eclass, loop_memory, a_face_loops, b_face_loops, a_edge_count, b_edge_count);
 
     detail::LoopEdges a_edge_map;
     detail::LoopEdges b_edge_map;
@@ -1705,6 +2226,8 @@ bool carve::csg::CSG::sliceAndClassify(meshset_t* closed, meshset_t* open, std::
  */
 void carve::csg::CSG::slice(meshset_t* a, meshset_t* b, std::list<meshset_t*>& a_sliced, std::list<meshset_t*>& b_sliced, carve::csg::V2Set* shared_edges_ptr)
 {
+    carve::MemoryArena loop_memory;
+
     carve::csg::VertexClassification vclass;
     carve::csg::EdgeClassification eclass;
 
@@ -1720,7 +2243,7 @@ void carve::csg::CSG::slice(meshset_t* a, meshset_t* b, std::list<meshset_t*>& a
     std::shared_ptr<face_rtree_t> a_rtree(face_rtree_t::construct_STR(a->faceBegin(), a->faceEnd(), 4, 4));
     std::shared_ptr<face_rtree_t> b_rtree(face_rtree_t::construct_STR(b->faceBegin(), b->faceEnd(), 4, 4));
 
-    calc(a, a_rtree.get(), b, b_rtree.get(), vclass, eclass, a_face_loops, b_face_loops, a_edge_count, b_edge_count);
+    calc(a, a_rtree.get(), b, b_rtree.get(), vclass, eclass, loop_memory, a_face_loops, b_face_loops, a_edge_count, b_edge_count);
 
     detail::LoopEdges a_edge_map;
     detail::LoopEdges b_edge_map;
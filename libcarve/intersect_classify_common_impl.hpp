@@ -137,186 +137,264 @@ static void performClassifySimpleOnFaceGroups(FLGroupList& a_groups, FLGroupList
     }
 }
 
-template <typename CLASSIFIER>
-static void performClassifyEasyFaceGroups(FLGroupList& group, carve::mesh::MeshSet<3>* poly_a,
-                                          const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* poly_a_rtree, VertexClassification& vclass,
-                                          const CLASSIFIER& classifier, CSG::Collector& collector, CSG::Hooks& hooks)
+// Visits the groups of a list in parallel, with the index of each group in the list.
+template <typename FUNC> static void forEachFaceGroup(const FLGroupList& group, FUNC func)
 {
-
-    for (FLGroupList::iterator i = group.begin(); i != group.end();)
+    std::vector<const FaceLoopGroup*> groups;
+    groups.reserve(group.size());
+    for (FLGroupList::const_iterator i = group.begin(); i != group.end(); ++i)
     {
+        groups.push_back(&*i);
+    }
+
+    carve::util::forEachParallel<size_t>(0, groups.size(), 1, [&](size_t n) { func(*groups[n], n); });
+}
+
+
+// Decides the class of a group that has a vertex that is not on the other polyhedron, FACE_UNCLASSIFIED otherwise.
+template <typename CLASSIFIER>
+static FaceClass classifyEasyFaceGroup(const FaceLoopGroup& group, carve::mesh::MeshSet<3>* poly_a,
+                                       const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* poly_a_rtree, const VertexClassification& vclass,
+                                       const CLASSIFIER& classifier, CSG::Hooks& hooks)
+{
 #if defined(CARVE_DEBUG)
-        std::cerr << "............group " << &(*i) << std::endl;
+    std::cerr << "............group " << &group << std::endl;
 #endif
-        FaceLoopGroup& grp = (*i);
-        FaceLoopList& curr = (grp.face_loops);
-        FaceClass fc;
+    const FaceLoopList& curr = (group.face_loops);
 
-        for (FaceLoop* f = curr.head; f; f = f->next)
+    for (FaceLoop* f = curr.head; f; f = f->next)
+    {
+        for (size_t j = 0; j < f->vertices.size(); ++j)
         {
-            for (size_t j = 0; j < f->vertices.size(); ++j)
+            if (!classifier.pointOn(vclass, f, j))
             {
-                if (!classifier.pointOn(vclass, f, j))
+                PointClass pc = carve::mesh::classifyPoint(poly_a, poly_a_rtree, f->vertices[j]->v,
+                    false, NULL, NULL, hooks.rayCounter());
+                if (pc == PointClass::POINT_IN || pc == PointClass::POINT_OUT)
                 {
-                    PointClass pc = carve::mesh::classifyPoint(poly_a, poly_a_rtree, f->vertices[j]->v);
-                    if (pc == PointClass::POINT_IN || pc == PointClass::POINT_OUT)
-                    {
-                        classifier.explain(f, j, pc);
-                    }
-                    if (pc == PointClass::POINT_IN)
-                    {
-                        fc = FaceClass::FACE_IN;
-                        goto accept;
-                    }
-                    if (pc == PointClass::POINT_OUT)
-                    {
-                        fc = FaceClass::FACE_OUT;
-                        goto accept;
-                    }
+                    classifier.explain(f, j, pc);
+                }
+                if (pc == PointClass::POINT_IN)
+                {
+                    return FaceClass::FACE_IN;
+                }
+                if (pc == PointClass::POINT_OUT)
+                {
+                    return FaceClass::FACE_OUT;
                 }
             }
         }
-        ++i;
-        continue;
-    accept:
-    {
-        grp.classification.push_back(ClassificationInfo(NULL, fc));
-        collector.collect(&grp, hooks);
-        i = group.erase(i);
-    }
     }
+    return FaceClass::FACE_UNCLASSIFIED;
 }
 
 
+// Decides the classes of the groups that have a vertex that is not on the other polyhedron, FACE_UNCLASSIFIED for the
+// others. Only reads the groups, so that the groups of both polyhedra can be classified at the same time. The groups
+// are classified in parallel.
 template <typename CLASSIFIER>
-static void performClassifyHardFaceGroups(FLGroupList& group, carve::mesh::MeshSet<3>* poly_a,
-                                          const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* poly_a_rtree, const CLASSIFIER& /* classifier */,
-                                          CSG::Collector& collector, CSG::Hooks& hooks)
+static void classifyEasyFaceGroups(const FLGroupList& group, carve::mesh::MeshSet<3>* poly_a,
+                                   const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* poly_a_rtree, const VertexClassification& vclass,
+                                   const CLASSIFIER& classifier, CSG::Hooks& hooks, std::vector<FaceClass>& classes)
 {
-    for (FLGroupList::iterator i = group.begin(); i != group.end();)
-    {
-        int n_in = 0, n_out = 0, n_on = 0;
-        FaceLoopGroup& grp = (*i);
-        FaceLoopList& curr = (grp.face_loops);
-        V2Set& perim = ((*i).perimeter);
-        FaceClass fc = FaceClass::FACE_UNCLASSIFIED;
+    classes.assign(group.size(), FaceClass::FACE_UNCLASSIFIED);
+    forEachFaceGroup(group, [&](const FaceLoopGroup& grp, size_t n) {
+        hooks.progress(progress::CLASSIFY);
+        classes[n] = classifyEasyFaceGroup(grp, poly_a, poly_a_rtree, vclass, classifier, hooks);
+    });
+}
 
-        for (FaceLoop* f = curr.head; f; f = f->next)
+
+// Decides the class of a group from the midpoints of its edges that are not on the perimeter, FACE_UNCLASSIFIED if all
+// of them are on the other polyhedron.
+static FaceClass classifyHardFaceGroup(const FaceLoopGroup& group, carve::mesh::MeshSet<3>* poly_a,
+                                       const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* poly_a_rtree, CSG::Hooks& hooks)
+{
+    int n_in = 0, n_out = 0, n_on = 0;
+    const FaceLoopList& curr = (group.face_loops);
+    const V2Set& perim = (group.perimeter);
+    FaceClass fc = FaceClass::FACE_UNCLASSIFIED;
+
+    for (FaceLoop* f = curr.head; f; f = f->next)
+    {
+        carve::mesh::MeshSet<3>::vertex_t *v1, *v2;
+        v1 = f->vertices.back();
+        for (size_t j = 0; j < f->vertices.size(); ++j)
         {
-            carve::mesh::MeshSet<3>::vertex_t *v1, *v2;
-            v1 = f->vertices.back();
-            for (size_t j = 0; j < f->vertices.size(); ++j)
+            v2 = f->vertices[j];
+            if (v1 < v2 && perim.find(std::make_pair(v1, v2)) == perim.end())
             {
-                v2 = f->vertices[j];
-                if (v1 < v2 && perim.find(std::make_pair(v1, v2)) == perim.end())
+                carve::geom3d::Vector c = (v1->v + v2->v) / 2.0;
+
+                PointClass pc = carve::mesh::classifyPoint(poly_a, poly_a_rtree, c,
+                    false, NULL, NULL, hooks.rayCounter());
+
+                switch (pc)
                 {
-                    carve::geom3d::Vector c = (v1->v + v2->v) / 2.0;
-
-                    PointClass pc = carve::mesh::classifyPoint(poly_a, poly_a_rtree, c);
-
-                    switch (pc)
-                    {
-                    case PointClass::POINT_IN:
-                        n_in++;
-                        break;
-                    case PointClass::POINT_OUT:
-                        n_out++;
-                        break;
-                    case PointClass::POINT_ON:
-                        n_on++;
-                        break;
-                    default:
-                        break; // does not happen.
-                    }
+                case PointClass::POINT_IN:
+                    n_in++;
+                    break;
+                case PointClass::POINT_OUT:
+                    n_out++;
+                    break;
+                case PointClass::POINT_ON:
+                    n_on++;
+                    break;
+                default:
+                    break; // does not happen.
                 }
-                v1 = v2;
             }
+            v1 = v2;
         }
+    }
 
 #if defined(CARVE_DEBUG)
-        std::cerr << ">>> n_in: " << n_in << " n_on: " << n_on << " n_out: " << n_out << std::endl;
+    std::cerr << ">>> n_in: " << n_in << " n_on: " << n_on << " n_out: " << n_out << std::endl;
 #endif
 
-        if (!n_in && !n_out)
+    if (n_in)
+        fc = FaceClass::FACE_IN;
+    if (n_out)
+        fc = FaceClass::FACE_OUT;
+    return fc;
+}
+
+
+// Decides the classes of the groups with classifyHardFaceGroup. Only reads the groups, like classifyEasyFaceGroups.
+static void classifyHardFaceGroups(const FLGroupList& group, carve::mesh::MeshSet<3>* poly_a,
+                                   const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* poly_a_rtree, CSG::Hooks& hooks,
+                                   std::vector<FaceClass>& classes)
+{
+    classes.assign(group.size(), FaceClass::FACE_UNCLASSIFIED);
+    forEachFaceGroup(group, [&](const FaceLoopGroup& grp, size_t n) {
+        hooks.progress(progress::CLASSIFY);
+        classes[n] = classifyHardFaceGroup(grp, poly_a, poly_a_rtree, hooks);
+    });
+}
+
+
+// Collects the groups that classes decides, in order, and removes them from the list.
+static void collectClassifiedFaceGroups(FLGroupList& group, const std::vector<FaceClass>& classes, CSG::Collector& collector, CSG::Hooks& hooks)
+{
+    size_t n = 0;
+    for (FLGroupList::iterator i = group.begin(); i != group.end(); ++n)
+    {
+        if (classes[n] == FaceClass::FACE_UNCLASSIFIED)
         {
             ++i;
             continue;
         }
 
-        if (n_in)
-            fc = FaceClass::FACE_IN;
-        if (n_out)
-            fc = FaceClass::FACE_OUT;
-
-        grp.classification.push_back(ClassificationInfo(NULL, fc));
-        collector.collect(&grp, hooks);
+        (*i).classification.push_back(ClassificationInfo(NULL, classes[n]));
+        collector.collect(&*i, hooks);
         i = group.erase(i);
     }
 }
 
+
 template <typename CLASSIFIER>
-void performFaceLoopWork(carve::mesh::MeshSet<3>* poly_a, const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* poly_a_rtree, FLGroupList& b_loops_grouped,
-                         const CLASSIFIER& classifier, CSG::Collector& collector, CSG::Hooks& hooks)
+static void performClassifyEasyFaceGroups(FLGroupList& group, carve::mesh::MeshSet<3>* poly_a,
+                                          const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* poly_a_rtree, const VertexClassification& vclass,
+                                          const CLASSIFIER& classifier, CSG::Collector& collector, CSG::Hooks& hooks)
 {
-    for (FLGroupList::iterator i = b_loops_grouped.begin(), e = b_loops_grouped.end(); i != e;)
-    {
-        FaceClass fc;
+    std::vector<FaceClass> classes;
+    classifyEasyFaceGroups(group, poly_a, poly_a_rtree, vclass, classifier, hooks, classes);
+    collectClassifiedFaceGroups(group, classes, collector, hooks);
+}
 
-        if (classifier.faceLoopSanityChecker(*i))
-        {
-            std::cerr << "UNEXPECTED face loop with size != 1." << std::endl;
-            ++i;
-            continue;
-        }
-        CARVE_ASSERT((*i).face_loops.size() == 1);
 
-        FaceLoop* fla = (*i).face_loops.head;
+template <typename CLASSIFIER>
+static void performClassifyHardFaceGroups(FLGroupList& group, carve::mesh::MeshSet<3>* poly_a,
+                                          const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* poly_a_rtree, const CLASSIFIER& /* classifier */,
+                                          CSG::Collector& collector, CSG::Hooks& hooks)
+{
+    std::vector<FaceClass> classes;
+    classifyHardFaceGroups(group, poly_a, poly_a_rtree, hooks, classes);
+    collectClassifiedFaceGroups(group, classes, collector, hooks);
+}
 
-        const carve::mesh::MeshSet<3>::face_t* f = (fla->orig_face);
-        std::vector<carve::mesh::MeshSet<3>::vertex_t*>& loop = (fla->vertices);
-        std::vector<carve::geom2d::P2> proj;
-        proj.reserve(loop.size());
-        for (unsigned j = 0; j < loop.size(); ++j)
-        {
-            proj.push_back(f->project(loop[j]->v));
-        }
-        carve::geom2d::P2 pv;
-        if (!carve::geom2d::pickContainedPoint(proj, pv))
-        {
-            CARVE_FAIL("Failed");
-        }
-        carve::geom3d::Vector v = f->unproject(pv, f->plane);
+// Decides the class of a group of a single face loop from a point inside of the loop.
+static FaceClass classifyFaceLoopGroup(const FaceLoopGroup& group, carve::mesh::MeshSet<3>* poly_a,
+                                       const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* poly_a_rtree, CSG::Hooks& hooks)
+{
+    FaceClass fc;
 
-        const carve::mesh::MeshSet<3>::face_t* hit_face;
-        PointClass pc = carve::mesh::classifyPoint(poly_a, poly_a_rtree, v, false, NULL, &hit_face);
-        switch (pc)
-        {
-        case PointClass::POINT_IN:
-            fc = FaceClass::FACE_IN;
-            break;
-        case PointClass::POINT_OUT:
-            fc = FaceClass::FACE_OUT;
-            break;
-        case PointClass::POINT_ON:
-        {
-            double d = carve::geom::distance(hit_face->plane, v);
+    CARVE_ASSERT(group.face_loops.size() == 1);
+
+    FaceLoop* fla = (group.face_loops.head);
+
+    const carve::mesh::MeshSet<3>::face_t* f = (fla->orig_face);
+    const FaceLoop::vertex_list_t& loop = (fla->vertices);
+    std::vector<carve::geom2d::P2> proj;
+    proj.reserve(loop.size());
+    for (unsigned j = 0; j < loop.size(); ++j)
+    {
+        proj.push_back(f->project(loop[j]->v));
+    }
+    carve::geom2d::P2 pv;
+    if (!carve::geom2d::pickContainedPoint(proj, pv))
+    {
+        CARVE_FAIL("Failed");
+    }
+    carve::geom3d::Vector v = f->unproject(pv, f->plane);
+
+    const carve::mesh::MeshSet<3>::face_t* hit_face;
+    PointClass pc = carve::mesh::classifyPoint(poly_a, poly_a_rtree, v,
+        false, NULL, &hit_face, hooks.rayCounter());
+    switch (pc)
+    {
+    case PointClass::POINT_IN:
+        fc = FaceClass::FACE_IN;
+        break;
+    case PointClass::POINT_OUT:
+        fc = FaceClass::FACE_OUT;
+        break;
+    case PointClass::POINT_ON:
+    {
+        double d = carve::geom::distance(hit_face->plane, v);
 #if defined(CARVE_DEBUG)
-            std::cerr << "d = " << d << std::endl;
+        std::cerr << "d = " << d << std::endl;
 #endif
-            fc = d < 0 ? FaceClass::FACE_IN : FaceClass::FACE_OUT;
-            break;
-        }
-        default:
-            CARVE_FAIL("unhandled switch case -- should not happen");
-        }
+        fc = d < 0 ? FaceClass::FACE_IN : FaceClass::FACE_OUT;
+        break;
+    }
+    default:
+        CARVE_FAIL("unhandled switch case -- should not happen");
+    }
 #if defined(CARVE_DEBUG)
-        std::cerr << "CLASS: " << (fc == FACE_IN ? "FACE_IN" : "FACE_OUT") << std::endl;
+    std::cerr << "CLASS: " << (fc == FACE_IN ? "FACE_IN" : "FACE_OUT") << std::endl;
 #endif
+    return fc;
+}
 
-        (*i).classification.push_back(ClassificationInfo(NULL, fc));
-        collector.collect(&*i, hooks);
-        i = b_loops_grouped.erase(i);
-    }
+
+// Decides the classes of the remaining groups, which consist of a single face loop, FACE_UNCLASSIFIED for the groups
+// that the classifier rejects. Only reads the groups, like classifyEasyFaceGroups.
+template <typename CLASSIFIER>
+static void classifyFaceLoopGroups(const FLGroupList& group, carve::mesh::MeshSet<3>* poly_a,
+                                   const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* poly_a_rtree, const CLASSIFIER& classifier,
+                                   CSG::Hooks& hooks, std::vector<FaceClass>& classes)
+{
+    classes.assign(group.size(), FaceClass::FACE_UNCLASSIFIED);
+    forEachFaceGroup(group, [&](const FaceLoopGroup& grp, size_t n) {
+        hooks.progress(progress::CLASSIFY);
+
+        if (classifier.faceLoopSanityChecker(grp))
+        {
+            std::cerr << "UNEXPECTED face loop with size != 1." << std::endl;
+            return;
+        }
+        classes[n] = classifyFaceLoopGroup(grp, poly_a, poly_a_rtree, hooks);
+    });
+}
+
+template <typename CLASSIFIER>
+void performFaceLoopWork(carve::mesh::MeshSet<3>* poly_a, const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* poly_a_rtree, FLGroupList& b_loops_grouped,
+                         const CLASSIFIER& classifier, CSG::Collector& collector, CSG::Hooks& hooks)
+{
+    std::vector<FaceClass> classes;
+    classifyFaceLoopGroups(b_loops_grouped, poly_a, poly_a_rtree, classifier, hooks, classes);
+    collectClassifiedFaceGroups(b_loops_grouped, classes, collector, hooks);
 }
 
 template <typename CLASSIFIER>
@@ -348,6 +426,8 @@ void performClassifyFaceGroups(FLGroupList& a_loops_grouped, FLGroupList& b_loop
 
         for (i = b_loops_grouped.begin(); i != b_loops_grouped.end();)
         {
+            hooks.progress(progress::CLASSIFY);
+
             GroupLookup::iterator a = a_map.end();
 
             V2Set::iterator it_end = (*i).perimeter.end();
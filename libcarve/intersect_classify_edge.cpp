@@ -206,7 +206,7 @@ static void walkGraphSegment(carve::csg::detail::VVSMap& shared_edge_graph, cons
     std::cerr << "intersection segment: " << out.size() << " edges." << std::endl;
 #if defined(DEBUG_DRAW_INTERSECTION_LINE)
     {
-        static float H = 0.0, S = 1.0, V = 1.0;
+        static thread_local float H = 0.0, S = 1.0, V = 1.0;
         float r, g, b;
 
         H = fmod((H + .37), 1.0);
@@ -864,7 +864,8 @@ void CSG::classifyFaceGroupsEdge(const V2Set& shared_edges, VertexClassification
                 {
                     if (vclass[fl->vertices[fli]].cls[1] == PointClass::POINT_UNK)
                     {
-                        vclass[fl->vertices[fli]].cls[1] = carve::mesh::classifyPoint(poly_b, poly_b_rtree, fl->vertices[fli]->v);
+                        vclass[fl->vertices[fli]].cls[1] = carve::mesh::classifyPoint(poly_b, poly_b_rtree, fl->vertices[fli]->v,
+                            false, NULL, NULL, hooks.rayCounter());
                     }
                     switch (vclass[fl->vertices[fli]].cls[1])
                     {
@@ -902,7 +903,8 @@ void CSG::classifyFaceGroupsEdge(const V2Set& shared_edges, VertexClassification
                 {
                     if (vclass[fl->vertices[fli]].cls[0] == PointClass::POINT_UNK)
                     {
-                        vclass[fl->vertices[fli]].cls[0] = carve::mesh::classifyPoint(poly_a, poly_a_rtree, fl->vertices[fli]->v);
+                        vclass[fl->vertices[fli]].cls[0] = carve::mesh::classifyPoint(poly_a, poly_a_rtree, fl->vertices[fli]->v,
+                            false, NULL, NULL, hooks.rayCounter());
                     }
                     switch (vclass[fl->vertices[fli]].cls[0])
                     {
@@ -25,6 +25,7 @@
 
 #include <include/csg.hpp>
 #include <include/debug_hooks.hpp>
+#include <include/util.hpp>
 
 #include <iostream>
 #include <list>
@@ -58,7 +59,7 @@ public:
     FaceMaker0(CSG::Collector& c, CSG::Hooks& h) : collector(c), hooks(h)
     {
     }
-    bool pointOn(VertexClassification& vclass, FaceLoop* f, size_t index) const
+    bool pointOn(const VertexClassification& vclass, FaceLoop* f, size_t index) const
     {
         return vclass[f->vertices[index]].cls[1] == POINT_ON;
     }
@@ -79,7 +80,7 @@ public:
     FaceMaker1(CSG::Collector& c, CSG::Hooks& h) : collector(c), hooks(h)
     {
     }
-    bool pointOn(VertexClassification& vclass, FaceLoop* f, size_t index) const
+    bool pointOn(const VertexClassification& vclass, FaceLoop* f, size_t index) const
     {
         return vclass[f->vertices[index]].cls[0] == POINT_ON;
     }
@@ -104,7 +105,7 @@ public:
     {
     }
 
-    bool pointOn(VertexClassification& vclass, FaceLoop* f, size_t index) const
+    bool pointOn(const VertexClassification& vclass, FaceLoop* f, size_t index) const
     {
         return vclass[f->vertices[index]].cls[1 - poly_num] == PointClass::POINT_ON;
     }
@@ -153,8 +154,14 @@ public:
                       const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* poly_a_rtree, carve::mesh::MeshSet<3>* poly_b,
                       const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* poly_b_rtree) const
     {
-        performClassifyEasyFaceGroups(a_loops_grouped, poly_b, poly_b_rtree, vclass, FaceMaker0(collector, hooks), collector, hooks);
-        performClassifyEasyFaceGroups(b_loops_grouped, poly_a, poly_a_rtree, vclass, FaceMaker1(collector, hooks), collector, hooks);
+        // the groups of each polyhedron are classified against the other one at the same time, and collected in order afterwards
+        std::vector<FaceClass> a_classes, b_classes;
+        carve::util::TaskGroup group;
+        group.run([&]() { classifyEasyFaceGroups(a_loops_grouped, poly_b, poly_b_rtree, vclass, FaceMaker0(collector, hooks), hooks, a_classes); });
+        group.run([&]() { classifyEasyFaceGroups(b_loops_grouped, poly_a, poly_a_rtree, vclass, FaceMaker1(collector, hooks), hooks, b_classes); });
+        group.wait();
+        collectClassifiedFaceGroups(a_loops_grouped, a_classes, collector, hooks);
+        collectClassifiedFaceGroups(b_loops_grouped, b_classes, collector, hooks);
 #if defined(CARVE_DEBUG)
         std::cerr << "after removal of easy groups: " << a_loops_grouped.size() << " a groups" << std::endl;
         std::cerr << "after removal of easy groups: " << b_loops_grouped.size() << " b groups" << std::endl;
@@ -165,8 +172,13 @@ public:
                       const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* poly_a_rtree, carve::mesh::MeshSet<3>* poly_b,
                       const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* poly_b_rtree) const
     {
-        performClassifyHardFaceGroups(a_loops_grouped, poly_b, poly_b_rtree, FaceMaker0(collector, hooks), collector, hooks);
-        performClassifyHardFaceGroups(b_loops_grouped, poly_a, poly_a_rtree, FaceMaker1(collector, hooks), collector, hooks);
+        std::vector<FaceClass> a_classes, b_classes;
+        carve::util::TaskGroup group;
+        group.run([&]() { classifyHardFaceGroups(a_loops_grouped, poly_b, poly_b_rtree, hooks, a_classes); });
+        group.run([&]() { classifyHardFaceGroups(b_loops_grouped, poly_a, poly_a_rtree, hooks, b_classes); });
+        group.wait();
+        collectClassifiedFaceGroups(a_loops_grouped, a_classes, collector, hooks);
+        collectClassifiedFaceGroups(b_loops_grouped, b_classes, collector, hooks);
 #if defined(CARVE_DEBUG)
         std::cerr << "after removal of hard groups: " << a_loops_grouped.size() << " a groups" << std::endl;
         std::cerr << "after removal of hard groups: " << b_loops_grouped.size() << " b groups" << std::endl;
@@ -177,8 +189,13 @@ public:
                       const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* poly_a_rtree, carve::mesh::MeshSet<3>* poly_b,
                       const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* poly_b_rtree) const
     {
-        performFaceLoopWork(poly_b, poly_b_rtree, a_loops_grouped, *this, collector, hooks);
-        performFaceLoopWork(poly_a, poly_a_rtree, b_loops_grouped, *this, collector, hooks);
+        std::vector<FaceClass> a_classes, b_classes;
+        carve::util::TaskGroup group;
+        group.run([&]() { classifyFaceLoopGroups(a_loops_grouped, poly_b, poly_b_rtree, *this, hooks, a_classes); });
+        group.run([&]() { classifyFaceLoopGroups(b_loops_grouped, poly_a, poly_a_rtree, *this, hooks, b_classes); });
+        group.wait();
+        collectClassifiedFaceGroups(a_loops_grouped, a_classes, collector, hooks);
+        collectClassifiedFaceGroups(b_loops_grouped, b_classes, collector, hooks);
     }
 
     void postRemovalCheck(FLGroupList& a_loops_grouped, FLGroupList& b_loops_grouped) const
@@ -189,7 +206,7 @@ public:
 #endif
     }
 
-    bool faceLoopSanityChecker(FaceLoopGroup& i) const
+    bool faceLoopSanityChecker(const FaceLoopGroup& i) const
     {
         return i.face_loops.size() != 1;
     }
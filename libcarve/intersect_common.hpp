@@ -25,6 +25,9 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+
 
 static inline bool facesAreCoplanar(const carve::mesh::MeshSet<3>::face_t* a, const carve::mesh::MeshSet<3>::face_t* b)
 {
@@ -45,12 +48,68 @@ namespace carve
 namespace csg
 {
 
-static inline carve::mesh::MeshSet<3>::vertex_t* map_vertex(const VVMap& vmap, carve::mesh::MeshSet<3>::vertex_t* v)
+// Estimated fraction of a CSG computation that is done when each phase
+// starts, as reported to progress hooks.
+namespace progress
+{
+static const double GENERATE_INTERSECTIONS = 0.0;
+static const double INTERSECTING_FACE_PAIRS = 0.30;
+static const double DIVIDE_EDGES = 0.35;
+static const double MAKE_FACE_EDGES = 0.40;
+static const double GENERATE_FACE_LOOPS = 0.45;
+static const double GROUP_FACE_LOOPS = 0.75;
+static const double CLASSIFY = 0.85;
+static const double COLLECT = 0.95;
+
+// Progress hooks are called once per this many iterations of a long loop.
+static const size_t INTERVAL = 1024;
+} // namespace progress
+
+// Adds the wall time of its scope to a phase of the statistics, if there
+// are any. Safe to use from several threads at once.
+class PhaseTimer
+{
+public:
+    PhaseTimer(carve::csg::Stats* _stats, carve::csg::Stats::Phase _phase) : stats(_stats), phase(_phase)
+    {
+        if (stats != NULL)
+        {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~PhaseTimer()
+    {
+        stop();
+    }
+
+    // Ends the phase before the end of the scope.
+    void stop()
+    {
+        if (stats != NULL)
+        {
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            std::atomic_ref<double>(stats->seconds[phase]).fetch_add(elapsed.count());
+            stats = NULL;
+        }
+    }
+
+private:
+    PhaseTimer(const PhaseTimer&);
+    PhaseTimer& operator=(const PhaseTimer&);
+
+    carve::csg::Stats* stats;
+    carve::csg::Stats::Phase phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+static inline carve::mesh::MeshSet<3>::vertex_t* map_vertex(const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& vmap, const carve::csg::VertexIds& ids,
+                                                            carve::mesh::MeshSet<3>::vertex_t* v)
 {
-    VVMap::const_iterator i = vmap.find(v);
-    if (i == vmap.end())
+    carve::mesh::MeshSet<3>::vertex_t* mapped = vmap[ids.id(v)];
+    if (mapped == NULL)
         return v;
-    return (*i).second;
+    return mapped;
 }
 
 #if defined(CARVE_DEBUG)
@@ -72,7 +131,7 @@ static inline void drawFaceLoopList(const FaceLoopList& ll, float rF, float gF,
     for (FaceLoop* flb = ll.head; flb; flb = flb->next)
     {
         const carve::mesh::MeshSet<3>::face_t* f = (flb->orig_face);
-        std::vector<carve::mesh::MeshSet<3>::vertex_t*>& loop = flb->vertices;
+        std::vector<carve::mesh::MeshSet<3>::vertex_t*> loop(flb->vertices.begin(), flb->vertices.end());
         HOOK(drawFaceLoop2(loop, f->plane.N, rF, gF, bF, aF, rB, gB, bB, aB, true, lit););
         HOOK(drawFaceLoopWireframe(loop, f->plane.N, 1, 1, 1, 0.1f););
     }
@@ -83,7 +142,7 @@ static inline void drawFaceLoopListWireframe(const FaceLoopList& ll)
     for (FaceLoop* flb = ll.head; flb; flb = flb->next)
     {
         const carve::mesh::MeshSet<3>::face_t* f = (flb->orig_face);
-        std::vector<carve::mesh::MeshSet<3>::vertex_t*>& loop = flb->vertices;
+        std::vector<carve::mesh::MeshSet<3>::vertex_t*> loop(flb->vertices.begin(), flb->vertices.end());
         HOOK(drawFaceLoopWireframe(loop, f->plane.N, 1, 1, 1, 0.1f););
     }
 }
@@ -28,6 +28,7 @@
 #include <include/polyline.hpp>
 #include <include/timing.hpp>
 #include <include/triangulator.hpp>
+#include <include/util.hpp>
 
 #include <iostream>
 #include <list>
@@ -880,7 +881,8 @@ static void mergeFacesAndHoles(carve::mesh::MeshSet<3>::face_t* face, std::list<
  * @param[out] base_loop A vector of the vertices of the base loop.
  */
 static bool assembleBaseLoop(carve::mesh::MeshSet<3>::face_t* face, const carve::csg::detail::Data& data,
-                             std::vector<carve::mesh::MeshSet<3>::vertex_t*>& base_loop, carve::csg::CSG::Hooks& hooks)
+                             std::vector<carve::mesh::MeshSet<3>::vertex_t*>& base_loop,
+                             std::vector<carve::csg::CSG::EdgeDivision>* edge_divisions = NULL)
 {
     base_loop.clear();
 
@@ -891,7 +893,7 @@ static bool assembleBaseLoop(carve::mesh::MeshSet<3>::face_t* face, const carve:
     bool face_edge_intersected = false;
     do
     {
-        base_loop.push_back(carve::csg::map_vertex(data.vmap, e->vert));
+        base_loop.push_back(carve::csg::map_vertex(data.vmap, data.vertex_ids, e->vert));
 
         carve::csg::detail::EVVMap::const_iterator ev = data.divided_edges.find(e);
 
@@ -904,18 +906,18 @@ static bool assembleBaseLoop(carve::mesh::MeshSet<3>::face_t* face, const carve:
                 base_loop.push_back(ev_vec[k++]);
             }
 
-            if (ev_vec.size() && hooks.hasHook(carve::csg::CSG::Hooks::EDGE_DIVISION_HOOK))
+            if (ev_vec.size() && edge_divisions != NULL)
             {
                 carve::mesh::MeshSet<3>::vertex_t* v1 = e->vert;
                 carve::mesh::MeshSet<3>::vertex_t* v2;
                 for (size_t k = 0, ke = ev_vec.size(); k < ke;)
                 {
                     v2 = ev_vec[k++];
-                    hooks.edgeDivision(e, e_idx, v1, v2);
+                    edge_divisions->push_back(carve::csg::CSG::EdgeDivision(e, e_idx, v1, v2));
                     v1 = v2;
                 }
                 v2 = e->v2();
-                hooks.edgeDivision(e, e_idx, v1, v2);
+                edge_divisions->push_back(carve::csg::CSG::EdgeDivision(e, e_idx, v1, v2));
             }
 
             face_edge_intersected = true;
@@ -1608,7 +1610,7 @@ void dumpAsGraph(carve::mesh::MeshSet<3>::face_t* face, const std::vector<carve:
 
 void generateOneFaceLoop(carve::mesh::MeshSet<3>::face_t* face, const carve::csg::detail::Data& data,
                          const carve::csg::VertexIntersections& vertex_intersections, carve::csg::CSG::Hooks& hooks,
-                         std::list<std::vector<carve::mesh::MeshSet<3>::vertex_t*>>& face_loops)
+                         std::vector<carve::csg::CSG::EdgeDivision>* edge_divisions, std::list<std::vector<carve::mesh::MeshSet<3>::vertex_t*>>& face_loops)
 {
     using namespace carve::csg;
 
@@ -1618,7 +1620,7 @@ void generateOneFaceLoop(carve::mesh::MeshSet<3>::face_t* face, const carve::csg
     base_loop.reserve(4);
 
     /*bool face_edge_intersected = */
-    assembleBaseLoop(face, data, base_loop, hooks);
+    assembleBaseLoop(face, data, base_loop, edge_divisions);
 
     detail::FV2SMap::const_iterator fse_iter = data.face_split_edges.find(face);
 
@@ -1826,121 +1828,163 @@ void generateOneFaceLoop(carve::mesh::MeshSet<3>::face_t* face, const carve::csg
 /**
  * \brief Build a set of face loops for all (split) faces of a Polyhedron.
  *
+ * The faces are divided in parallel batches, whose loops are appended to
+ * \a face_loops_out in face order.
+ *
  * @param[in] poly The polyhedron to process
  * @param[in] data Internal intersection data
  * @param[out] face_loops_out The resulting face loops
+ * @param[out] edge_divisions The divisions of the edges of \a poly, in face
+ *             order, to be passed to the edge division hooks. Only filled
+ *             if there are such hooks.
  *
  * @return The number of edges generated.
  */
-size_t carve::csg::CSG::generateFaceLoops(carve::mesh::MeshSet<3>* poly, const detail::Data& data, FaceLoopList& face_loops_out)
+size_t carve::csg::CSG::generateFaceLoops(carve::mesh::MeshSet<3>* poly, const detail::Data& data, carve::MemoryArena& loop_memory,
+                                          FaceLoopList& face_loops_out, std::vector<EdgeDivision>& edge_divisions, double progress_begin,
+                                          double progress_end)
 {
     static carve::TimingName FUNC_NAME("CSG::generateFaceLoops()");
     carve::TimingBlock block(FUNC_NAME);
-    size_t generated_edges = 0;
-    std::vector<carve::mesh::MeshSet<3>::vertex_t*> base_loop;
-    std::list<std::vector<carve::mesh::MeshSet<3>::vertex_t*>> face_loops;
 
-    for (carve::mesh::MeshSet<3>::face_iter i = poly->faceBegin(); i != poly->faceEnd(); ++i)
+    std::vector<carve::mesh::MeshSet<3>::face_t*> faces;
+    for (size_t i = 0; i < poly->meshes.size(); ++i)
     {
-        carve::mesh::MeshSet<3>::face_t* face = (*i);
+        faces.insert(faces.end(), poly->meshes[i]->faces.begin(), poly->meshes[i]->faces.end());
+    }
 
-#if defined(CARVE_DEBUG)
-        double in_area = 0.0, out_area = 0.0;
+    struct Batch
+    {
+        FaceLoopList face_loops;
+        std::vector<EdgeDivision> edge_divisions;
+        size_t generated_edges = 0;
+    };
+
+    const size_t batch_size = 64;
+    const size_t batch_count = (faces.size() + batch_size - 1) / batch_size;
+    const bool report_progress = hooks.hasHook(Hooks::PROGRESS_HOOK);
+    const bool record_divisions = hooks.hasHook(Hooks::EDGE_DIVISION_HOOK);
+    std::vector<Batch> batches(batch_count);
 
+    carve::util::forEachParallel<size_t>(0, batch_count, 1, [&](size_t batch_index) {
+        if (report_progress)
         {
-            std::vector<carve::mesh::MeshSet<3>::vertex_t*> base_loop;
-            assembleBaseLoop(face, data, base_loop);
+            hooks.progress(progress_begin + (progress_end - progress_begin) * batch_index / batch_count);
+        }
+
+        Batch& batch = batches[batch_index];
+        std::pmr::polymorphic_allocator<> batch_memory(loop_memory.newResource(batch_size * 128));
+        std::list<std::vector<carve::mesh::MeshSet<3>::vertex_t*>> face_loops;
+        for (size_t i = batch_index * batch_size, ie = std::min(i + batch_size, faces.size()); i < ie; ++i)
+        {
+            carve::mesh::MeshSet<3>::face_t* face = faces[i];
+
+#if defined(CARVE_DEBUG)
+            double in_area = 0.0, out_area = 0.0;
 
             {
-                std::vector<carve::geom2d::P2> projected;
-                projected.reserve(base_loop.size());
-                for (size_t n = 0; n < base_loop.size(); ++n)
+                std::vector<carve::mesh::MeshSet<3>::vertex_t*> base_loop;
+                assembleBaseLoop(face, data, base_loop);
+
                 {
-                    projected.push_back(face->project(base_loop[n]->v));
-                }
+                    std::vector<carve::geom2d::P2> projected;
+                    projected.reserve(base_loop.size());
+                    for (size_t n = 0; n < base_loop.size(); ++n)
+                    {
+                        projected.push_back(face->project(base_loop[n]->v));
+                    }
 
-                in_area = carve::geom2d::signedArea(projected);
-                std::cerr << "### in_area=" << in_area << std::endl;
+                    in_area = carve::geom2d::signedArea(projected);
+                    std::cerr << "### in_area=" << in_area << std::endl;
+                }
             }
-        }
 #endif
 
-        generateOneFaceLoop(face, data, vertex_intersections, hooks, face_loops);
+            generateOneFaceLoop(face, data, vertex_intersections, hooks, record_divisions ? &batch.edge_divisions : NULL, face_loops);
 
 #if defined(CARVE_DEBUG)
-        {
-            V2Set face_edges;
-
-            std::vector<carve::mesh::MeshSet<3>::vertex_t*> base_loop;
-            assembleBaseLoop(face, data, base_loop);
-
-            for (size_t j = 0, je = base_loop.size() - 1; j < je; ++j)
-            {
-                face_edges.insert(std::make_pair(base_loop[j + 1], base_loop[j]));
-            }
-            face_edges.insert(std::make_pair(base_loop[0], base_loop.back()));
-            for (std::list<std::vector<carve::mesh::MeshSet<3>::vertex_t*>>::const_iterator fli = face_loops.begin(); fli != face_loops.end(); ++fli)
             {
+                V2Set face_edges;
+
+                std::vector<carve::mesh::MeshSet<3>::vertex_t*> base_loop;
+                assembleBaseLoop(face, data, base_loop);
 
+                for (size_t j = 0, je = base_loop.size() - 1; j < je; ++j)
                 {
-                    std::vector<carve::geom2d::P2> projected;
-                    projected.reserve((*fli).size());
-                    for (size_t n = 0; n < (*fli).size(); ++n)
+                    face_edges.insert(std::make_pair(base_loop[j + 1], base_loop[j]));
+                }
+                face_edges.insert(std::make_pair(base_loop[0], base_loop.back()));
+                for (std::list<std::vector<carve::mesh::MeshSet<3>::vertex_t*>>::const_iterator fli = face_loops.begin(); fli != face_loops.end(); ++fli)
+                {
+
                     {
-                        projected.push_back(face->project((*fli)[n]->v));
+                        std::vector<carve::geom2d::P2> projected;
+                        projected.reserve((*fli).size());
+                        for (size_t n = 0; n < (*fli).size(); ++n)
+                        {
+                            projected.push_back(face->project((*fli)[n]->v));
+                        }
+
+                        double area = carve::geom2d::signedArea(projected);
+                        std::cerr << "### loop_area["
+                                  << std::distance((std::list<std::vector<carve::mesh::MeshSet<3>::vertex_t*>>::const_iterator)face_loops.begin(), fli)
+                                  << "]=" << area << std::endl;
+                        out_area += area;
                     }
 
-                    double area = carve::geom2d::signedArea(projected);
-                    std::cerr << "### loop_area["
-                              << std::distance((std::list<std::vector<carve::mesh::MeshSet<3>::vertex_t*>>::const_iterator)face_loops.begin(), fli)
-                              << "]=" << area << std::endl;
-                    out_area += area;
+                    const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& fl = *fli;
+                    for (size_t j = 0, je = fl.size() - 1; j < je; ++j)
+                    {
+                        face_edges.insert(std::make_pair(fl[j], fl[j + 1]));
+                    }
+                    face_edges.insert(std::make_pair(fl.back(), fl[0]));
                 }
-
-                const std::vector<carve::mesh::MeshSet<3>::vertex_t*>& fl = *fli;
-                for (size_t j = 0, je = fl.size() - 1; j < je; ++j)
+                for (V2Set::const_iterator j = face_edges.begin(); j != face_edges.end(); ++j)
                 {
-                    face_edges.insert(std::make_pair(fl[j], fl[j + 1]));
+                    if (face_edges.find(std::make_pair((*j).second, (*j).first)) == face_edges.end())
+                    {
+                        std::cerr << "### error: unmatched edge [" << (*j).first << "-" << (*j).second << "]" << std::endl;
+                    }
                 }
-                face_edges.insert(std::make_pair(fl.back(), fl[0]));
-            }
-            for (V2Set::const_iterator j = face_edges.begin(); j != face_edges.end(); ++j)
-            {
-                if (face_edges.find(std::make_pair((*j).second, (*j).first)) == face_edges.end())
+                std::cerr << "### out_area=" << out_area << std::endl;
+                if (out_area != in_area)
                 {
-                    std::cerr << "### error: unmatched edge [" << (*j).first << "-" << (*j).second << "]" << std::endl;
+                    std::cerr << "### error: area does not match. delta = " << (out_area - in_area) << std::endl;
+                    // CARVE_ASSERT(fabs(out_area - in_area) < 1e-5);
                 }
             }
-            std::cerr << "### out_area=" << out_area << std::endl;
-            if (out_area != in_area)
-            {
-                std::cerr << "### error: area does not match. delta = " << (out_area - in_area) << std::endl;
-                // CARVE_ASSERT(fabs(out_area - in_area) < 1e-5);
-            }
-        }
 #endif
 
-        // now record all the resulting face loops.
+            // now record all the resulting face loops.
 #if defined(CARVE_DEBUG)
-        std::cerr << "### ======" << std::endl;
+            std::cerr << "### ======" << std::endl;
 #endif
-        for (std::list<std::vector<carve::mesh::MeshSet<3>::vertex_t*>>::const_iterator f = face_loops.begin(), fe = face_loops.end(); f != fe; ++f)
-        {
-#if defined(CARVE_DEBUG)
-            std::cerr << "### loop:";
-            for (size_t i = 0; i < (*f).size(); ++i)
+            for (std::list<std::vector<carve::mesh::MeshSet<3>::vertex_t*>>::const_iterator f = face_loops.begin(), fe = face_loops.end(); f != fe; ++f)
             {
-                std::cerr << " " << (*f)[i];
-            }
-            std::cerr << std::endl;
+#if defined(CARVE_DEBUG)
+                std::cerr << "### loop:";
+                for (size_t i = 0; i < (*f).size(); ++i)
+                {
+                    std::cerr << " " << (*f)[i];
+                }
+                std::cerr << std::endl;
 #endif
 
-            face_loops_out.append(new FaceLoop(face, *f));
-            generated_edges += (*f).size();
-        }
+                batch.face_loops.append(batch_memory.new_object<FaceLoop>(face, *f, batch_memory.resource()));
+                batch.generated_edges += (*f).size();
+            }
 #if defined(CARVE_DEBUG)
-        std::cerr << "### ======" << std::endl;
+            std::cerr << "### ======" << std::endl;
 #endif
+        }
+    });
+
+    size_t generated_edges = 0;
+    for (size_t i = 0; i < batches.size(); ++i)
+    {
+        face_loops_out.splice(batches[i].face_loops);
+        edge_divisions.insert(edge_divisions.end(), batches[i].edge_divisions.begin(), batches[i].edge_divisions.end());
+        generated_edges += batches[i].generated_edges;
     }
     return generated_edges;
 }
@@ -166,8 +166,8 @@ void carve::csg::CSG::groupFaceLoops(carve::mesh::MeshSet<3>* src, carve::csg::F
     // that are not part of no_cross.
     // this could potentially be done with a disjoint set data-structure.
 #if defined(CARVE_DEBUG_WRITE_PLY_DATA)
-    static int call_num = 0;
-    call_num++;
+    static std::atomic<int> call_count(0);
+    int call_num = ++call_count;
 #endif
 
     static carve::TimingName GROUP_FACE_LOOPS("groupFaceLoops()");
@@ -177,6 +177,8 @@ void carve::csg::CSG::groupFaceLoops(carve::mesh::MeshSet<3>* src, carve::csg::F
     int tag_num = 0;
     while (face_loops.size())
     {
+        hooks.progress(progress::GROUP_FACE_LOOPS);
+
         out_loops.push_back(FaceLoopGroup(src));
         carve::csg::FaceLoopGroup& group = (out_loops.back());
         carve::csg::FaceLoopList& curr = (group.face_loops);
@@ -188,9 +190,15 @@ void carve::csg::CSG::groupFaceLoops(carve::mesh::MeshSet<3>* src, carve::csg::F
         face_loops.remove(expand);
         curr.append(expand);
 
+        size_t n = 0;
         while (expand)
         {
-            std::vector<carve::mesh::MeshSet<3>::vertex_t*>& loop = (expand->vertices);
+            if (++n % progress::INTERVAL == 0)
+            {
+                hooks.progress(progress::GROUP_FACE_LOOPS);
+            }
+
+            FaceLoop::vertex_list_t& loop = (expand->vertices);
             carve::mesh::MeshSet<3>::vertex_t *v1, *v2;
 
             v1 = loop.back();
@@ -25,6 +25,7 @@
 
 #include <include/csg.hpp>
 #include <include/debug_hooks.hpp>
+#include <include/util.hpp>
 
 #include <iostream>
 #include <list>
@@ -90,7 +91,7 @@ struct GroupPoly : public CSG::Collector
 class FaceMaker
 {
 public:
-    bool pointOn(VertexClassification& vclass, FaceLoop* f, size_t index) const
+    bool pointOn(const VertexClassification& vclass, FaceLoop* f, size_t index) const
     {
         return vclass[f->vertices[index]].cls[0] == PointClass::POINT_ON;
     }
@@ -162,7 +163,7 @@ public:
 #endif
     }
 
-    bool faceLoopSanityChecker(FaceLoopGroup& i) const
+    bool faceLoopSanityChecker(const FaceLoopGroup& i) const
     {
         return false;
         return i.face_loops.size() != 1;
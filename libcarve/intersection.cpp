@@ -31,33 +31,123 @@
 #include <include/timing.hpp>
 
 
+carve::csg::Intersections::Intersections() : records(), slots(), n_objs(0), shift(64)
+{
+}
+
+
+void carve::csg::Intersections::rehash(size_t n_slots)
+{
+    std::vector<Slot> old_slots;
+    old_slots.swap(slots);
+
+    Slot empty_slot;
+    empty_slot.head = NONE;
+    slots.assign(n_slots, empty_slot);
+    shift = 64;
+    while (((size_t)1 << (64 - shift)) < n_slots)
+    {
+        --shift;
+    }
+
+    for (size_t i = 0; i < old_slots.size(); ++i)
+    {
+        if (old_slots[i].obj.obtype != IObj::ObjectType::OBTYPE_NONE)
+        {
+            slots[findSlot(old_slots[i].obj)] = old_slots[i];
+        }
+    }
+}
+
+
+void carve::csg::Intersections::reserve(size_t n)
+{
+    // at most two objects and two records for each intersection.
+    records.reserve(n * 2);
+    size_t n_slots = 16;
+    while (n_slots < n * 4)
+    {
+        n_slots *= 2;
+    }
+    if (n_slots > slots.size())
+    {
+        rehash(n_slots);
+    }
+}
+
+
+void carve::csg::Intersections::set(const IObj& a, const IObj& b, vertex_t* p)
+{
+    // keep the load factor at most one half.
+    if ((n_objs + 1) * 2 > slots.size())
+    {
+        rehash(std::max<size_t>(16, slots.size() * 2));
+    }
+
+    Slot& slot = slots[findSlot(a)];
+    if (slot.obj.obtype == IObj::ObjectType::OBTYPE_NONE)
+    {
+        slot.obj = a;
+        ++n_objs;
+    }
+    else
+    {
+        for (index_t i = slot.head; i != NONE; i = records[i].next)
+        {
+            if (records[i].other == b)
+            {
+                records[i].vertex = p;
+                return;
+            }
+        }
+    }
+
+    if (records.size() >= NONE)
+    {
+        throw carve::exception("too many intersections");
+    }
+    Record r;
+    r.obj = a;
+    r.other = b;
+    r.vertex = p;
+    r.next = slot.head;
+    slot.head = (index_t)records.size();
+    records.push_back(r);
+}
+
+
+void carve::csg::Intersections::clear()
+{
+    records.clear();
+    slots.clear();
+    n_objs = 0;
+    shift = 64;
+}
+
+
 void carve::csg::Intersections::collect(const IObj& obj, std::vector<carve::mesh::MeshSet<3>::vertex_t*>* collect_v,
                                         std::vector<carve::mesh::MeshSet<3>::edge_t*>* collect_e,
                                         std::vector<carve::mesh::MeshSet<3>::face_t*>* collect_f) const
 {
-    carve::csg::Intersections::const_iterator i = find(obj);
-    if (i != end())
+    for (index_t i = first(obj); i != NONE; i = records[i].next)
     {
-        Intersections::mapped_type::const_iterator a, b;
-        for (a = (*i).second.begin(), b = (*i).second.end(); a != b; ++a)
+        const IObj& other = records[i].other;
+        switch (other.obtype)
         {
-            switch ((*a).first.obtype)
-            {
-            case carve::csg::IObj::ObjectType::OBTYPE_VERTEX:
-                if (collect_v)
-                    collect_v->push_back((*a).first.vertex);
-                break;
-            case carve::csg::IObj::ObjectType::OBTYPE_EDGE:
-                if (collect_e)
-                    collect_e->push_back((*a).first.edge);
-                break;
-            case carve::csg::IObj::ObjectType::OBTYPE_FACE:
-                if (collect_f)
-                    collect_f->push_back((*a).first.face);
-                break;
-            default:
-                throw carve::exception("should not happen " __FILE__ ":" XSTR(__LINE__));
-            }
+        case carve::csg::IObj::ObjectType::OBTYPE_VERTEX:
+            if (collect_v)
+                collect_v->push_back(other.vertex);
+            break;
+        case carve::csg::IObj::ObjectType::OBTYPE_EDGE:
+            if (collect_e)
+                collect_e->push_back(other.edge);
+            break;
+        case carve::csg::IObj::ObjectType::OBTYPE_FACE:
+            if (collect_f)
+                collect_f->push_back(other.face);
+            break;
+        default:
+            throw carve::exception("should not happen " __FILE__ ":" XSTR(__LINE__));
         }
     }
 }
@@ -65,46 +155,41 @@ void carve::csg::Intersections::collect(const IObj& obj, std::vector<carve::mesh
 
 bool carve::csg::Intersections::intersectsFace(carve::mesh::MeshSet<3>::vertex_t* v, carve::mesh::MeshSet<3>::face_t* f) const
 {
-    const_iterator i = find(v);
-    if (i != end())
+    for (index_t i = first(v); i != NONE; i = records[i].next)
     {
-        mapped_type::const_iterator a, b;
-
-        for (a = (*i).second.begin(), b = (*i).second.end(); a != b; ++a)
+        const IObj& other = records[i].other;
+        switch (other.obtype)
         {
-            switch ((*a).first.obtype)
-            {
-            case carve::csg::IObj::ObjectType::OBTYPE_VERTEX:
-            {
-                const carve::mesh::MeshSet<3>::edge_t* edge = f->edge;
-                do
-                {
-                    if (edge->vert == (*a).first.vertex)
-                        return true;
-                    edge = edge->next;
-                } while (edge != f->edge);
-                break;
-            }
-            case carve::csg::IObj::ObjectType::OBTYPE_EDGE:
+        case carve::csg::IObj::ObjectType::OBTYPE_VERTEX:
+        {
+            const carve::mesh::MeshSet<3>::edge_t* edge = f->edge;
+            do
             {
-                const carve::mesh::MeshSet<3>::edge_t* edge = f->edge;
-                do
-                {
-                    if (edge == (*a).first.edge)
-                        return true;
-                    edge = edge->next;
-                } while (edge != f->edge);
-                break;
-            }
-            case carve::csg::IObj::ObjectType::OBTYPE_FACE:
+                if (edge->vert == other.vertex)
+                    return true;
+                edge = edge->next;
+            } while (edge != f->edge);
+            break;
+        }
+        case carve::csg::IObj::ObjectType::OBTYPE_EDGE:
+        {
+            const carve::mesh::MeshSet<3>::edge_t* edge = f->edge;
+            do
             {
-                if ((*a).first.face == f)
+                if (edge == other.edge)
                     return true;
-                break;
-            }
-            default:
-                throw carve::exception("should not happen " __FILE__ ":" XSTR(__LINE__));
-            }
+                edge = edge->next;
+            } while (edge != f->edge);
+            break;
+        }
+        case carve::csg::IObj::ObjectType::OBTYPE_FACE:
+        {
+            if (other.face == f)
+                return true;
+            break;
+        }
+        default:
+            throw carve::exception("should not happen " __FILE__ ":" XSTR(__LINE__));
         }
     }
     return false;
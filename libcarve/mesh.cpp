@@ -27,6 +27,7 @@
 #include <include/mesh_impl.hpp>
 #include <include/rtree.hpp>
 
+#include <atomic>
 #include <functional>
 #include <include/poly.hpp>
 
@@ -1155,7 +1156,7 @@ template class carve::mesh::MeshSet<3>;
 
 carve::PointClass carve::mesh::classifyPoint(const carve::mesh::MeshSet<3>* meshset, const carve::geom::RTreeNode<3, carve::mesh::Face<3>*>* face_rtree,
                                              const carve::geom::vector<3>& v, bool even_odd, const carve::mesh::Mesh<3>* mesh,
-                                             const carve::mesh::Face<3>** hit_face)
+                                             const carve::mesh::Face<3>** hit_face, size_t* ray_count)
 {
 
     if (hit_face)
@@ -1227,6 +1228,10 @@ carve::PointClass carve::mesh::classifyPoint(const carve::mesh::MeshSet<3>* mesh
 #endif
 
         carve::geom::vector<3> v2 = v + ray_dir * ray_len;
+        if (ray_count != NULL)
+        {
+            std::atomic_ref<size_t>(*ray_count).fetch_add(1, std::memory_order_relaxed);
+        }
 
         bool failed = false;
         carve::geom::linesegment<3> line(v, v2);
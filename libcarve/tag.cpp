@@ -25,4 +25,5 @@
 
 #include <include/tag.hpp>
 
-int carve::tagable::s_count = 0;
+std::atomic<int> carve::tagable::s_next(0);
+thread_local int carve::tagable::s_count = 0;
@@ -0,0 +1,431 @@
+// Copyright 2006-2015 Tobias Sargeant (tobias.sargeant@gmail.com).
+//
+// This file is part of the Carve CSG Library (http://carve-csg.com/)
+//
+// Permission is hereby granted, free of charge, to any person
+// obtaining a copy of this software and associated documentation
+// files (the "Software"), to deal in the Software without
+// restriction, including without limitation the rights to use, copy,
+// modify, merge, publish, distribute, sublicense, and/or sell copies
+// of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be
+// included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+// NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+// BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+// ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <include/thread_pool.hpp>
+
+#include <include/tag.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace
+{
+// The queue of the worker that runs on this thread, SIZE_MAX on other threads.
+thread_local size_t current_worker = SIZE_MAX;
+
+#if defined(__linux__)
+// The CPU quota of the cgroup of the process rounded up, or 0 if there is none.
+unsigned cgroupCpuQuota()
+{
+    double quota = 0.0, period = 0.0;
+
+    // cgroup v2 holds "<quota> <period>", with a quota of "max" if there is none
+    std::ifstream cpu_max("/sys/fs/cgroup/cpu.max");
+    if (cpu_max)
+    {
+        std::string quota_text;
+        if (!(cpu_max >> quota_text >> period) || quota_text == "max")
+        {
+            return 0;
+        }
+        quota = std::strtod(quota_text.c_str(), NULL);
+    }
+    else
+    {
+        // cgroup v1, a quota of -1 means there is none
+        std::ifstream quota_file("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+        std::ifstream period_file("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+        if (!(quota_file >> quota) || !(period_file >> period))
+        {
+            return 0;
+        }
+    }
+
+    if (quota <= 0.0 || period <= 0.0)
+    {
+        return 0;
+    }
+    return (unsigned)std::ceil(quota / period);
+}
+#endif
+} // namespace
+
+carve::util::ThreadPool& carve::util::ThreadPool::instance()
+{
+    // never destroyed, so that threads the library does not join (such as those of a host that exits while an operation
+    // is still running) can keep using it during static destruction.
+    static ThreadPool* pool = new ThreadPool();
+    return *pool;
+}
+
+carve::util::ThreadPool::ThreadPool() : thread_count(0), queued_tasks(0), next_queue(0), stopping(false)
+{
+}
+
+carve::util::ThreadPool::~ThreadPool()
+{
+    stop();
+}
+
+unsigned carve::util::ThreadPool::defaultThreadCount()
+{
+    unsigned count = std::thread::hardware_concurrency();
+#if defined(__linux__)
+    cpu_set_t cpus;
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0)
+    {
+        count = (unsigned)CPU_COUNT(&cpus);
+    }
+    unsigned quota = cgroupCpuQuota();
+    if (quota != 0)
+    {
+        count = std::min(count, quota);
+    }
+#endif
+    return std::max(count, 1u);
+}
+
+unsigned carve::util::ThreadPool::getThreadCount()
+{
+    unsigned count = thread_count.load();
+    if (count == 0)
+    {
+        std::lock_guard<std::mutex> lock(config_mutex);
+        if (thread_count.load() == 0)
+        {
+            start(defaultThreadCount());
+        }
+        count = thread_count.load();
+    }
+    return count;
+}
+
+void carve::util::ThreadPool::setThreadCount(unsigned count)
+{
+    std::lock_guard<std::mutex> lock(config_mutex);
+    stop();
+    start(count == 0 ? defaultThreadCount() : count);
+}
+
+void carve::util::ThreadPool::start(unsigned count)
+{
+    count = std::max(count, 1u);
+
+    // the thread that waits for the tasks is the last one
+    queues.resize(count - 1);
+    for (std::unique_ptr<Queue>& queue : queues)
+    {
+        queue.reset(new Queue());
+    }
+    workers.reserve(count - 1);
+    for (size_t i = 0; i + 1 < count; ++i)
+    {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+    thread_count.store(count);
+}
+
+void carve::util::ThreadPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    workers.clear();
+    queues.clear();
+    queued_tasks.store(0);
+    thread_count.store(0);
+    stopping = false;
+}
+
+void carve::util::ThreadPool::submit(task_t task, const TaskGroup* group)
+{
+    size_t index = current_worker;
+    if (index >= queues.size())
+    {
+        index = next_queue.fetch_add(1) % queues.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        QueuedTask queued = { std::move(task), group };
+        queues[index]->tasks.push_back(std::move(queued));
+    }
+    queued_tasks.fetch_add(1);
+
+    // a worker that is about to sleep has either seen the task or is woken up
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    wake.notify_one();
+}
+
+bool carve::util::ThreadPool::takeTask(task_t& task, const TaskGroup* group)
+{
+    size_t count = queues.size();
+    if (count == 0 || queued_tasks.load() == 0)
+    {
+        return false;
+    }
+
+    // the newest task of the own queue is the one most likely to still be in the cache
+    size_t own = current_worker;
+    if (own < count)
+    {
+        Queue& queue = *queues[own];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        for (std::deque<QueuedTask>::reverse_iterator i = queue.tasks.rbegin(); i != queue.tasks.rend(); ++i)
+        {
+            if (group == NULL || i->group == group)
+            {
+                task = std::move(i->task);
+                queue.tasks.erase(std::next(i).base());
+                queued_tasks.fetch_sub(1);
+                return true;
+            }
+        }
+    }
+
+    // steal the oldest task of another queue, which tends to be the largest piece of work left
+    size_t first = own < count ? own + 1 : 0;
+    for (size_t q = 0; q < count; ++q)
+    {
+        Queue& queue = *queues[(first + q) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        for (std::deque<QueuedTask>::iterator i = queue.tasks.begin(); i != queue.tasks.end(); ++i)
+        {
+            if (group == NULL || i->group == group)
+            {
+                task = std::move(i->task);
+                queue.tasks.erase(i);
+                queued_tasks.fetch_sub(1);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool carve::util::ThreadPool::runQueuedTask(const TaskGroup* group)
+{
+    task_t task;
+    if (!takeTask(task, group))
+    {
+        return false;
+    }
+
+    // the caller may be in the middle of a traversal, which the task must not end
+    int traversal = carve::tagable::tag_current();
+    task();
+    carve::tagable::tag_resume(traversal);
+    return true;
+}
+
+void carve::util::ThreadPool::workerLoop(size_t index)
+{
+    current_worker = index;
+    for (;;)
+    {
+        task_t task;
+        if (takeTask(task, NULL))
+        {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake.wait(lock, [this]() { return stopping || queued_tasks.load() != 0; });
+        if (stopping)
+        {
+            return;
+        }
+    }
+}
+
+carve::util::TaskGroup::TaskGroup(ThreadPool& _pool) : pool(_pool), pending(0), error()
+{
+}
+
+carve::util::TaskGroup::~TaskGroup()
+{
+    try
+    {
+        wait();
+    }
+    catch (...)
+    {
+    }
+}
+
+void carve::util::TaskGroup::run(std::function<void()> task)
+{
+    if (pool.getThreadCount() <= 1)
+    {
+        try
+        {
+            task();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+        return;
+    }
+
+    pending.fetch_add(1);
+    pool.submit(
+        [this, task]()
+        {
+            std::exception_ptr task_error;
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+                task_error = std::current_exception();
+            }
+            finished(task_error);
+        },
+        this
+    );
+}
+
+void carve::util::TaskGroup::finished(std::exception_ptr task_error)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (task_error && !error)
+    {
+        error = task_error;
+    }
+    if (pending.fetch_sub(1) == 1)
+    {
+        done.notify_all();
+    }
+}
+
+void carve::util::TaskGroup::wait()
+{
+    while (pending.load() != 0)
+    {
+        // only the own tasks: a task of another group may run for as long as that group has work, with this one waiting below it
+        if (pool.runQueuedTask(this))
+        {
+            continue;
+        }
+
+        // the tasks left are running on other threads
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait_for(lock, std::chrono::milliseconds(1), [this]() { return pending.load() == 0; });
+    }
+
+    std::exception_ptr first_error;
+    {
+        // the last task may not have released the lock yet
+        std::lock_guard<std::mutex> lock(mutex);
+        std::swap(first_error, error);
+    }
+    if (first_error)
+    {
+        std::rethrow_exception(first_error);
+    }
+}
+
+carve::util::TaskGraph::TaskGraph(ThreadPool& _pool) : pool(_pool)
+{
+}
+
+carve::util::TaskGraph::node_t carve::util::TaskGraph::add(const char* name, std::function<void()> task, const std::vector<node_t>& dependencies)
+{
+    node_t node = nodes.size();
+    nodes.push_back(Node());
+    nodes.back().task = std::move(task);
+    nodes.back().dependencies = dependencies.size();
+    for (node_t dependency : dependencies)
+    {
+        nodes[dependency].dependents.push_back(node);
+    }
+
+    Span span = { name, -1.0, 0.0 };
+    spans.push_back(span);
+    return node;
+}
+
+void carve::util::TaskGraph::execute(node_t node, TaskGroup& group, std::atomic<size_t>* remaining, std::chrono::steady_clock::time_point start)
+{
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    nodes[node].task();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    spans[node].begin = std::chrono::duration<double>(begin - start).count();
+    spans[node].seconds = std::chrono::duration<double>(end - begin).count();
+
+    for (node_t dependent : nodes[node].dependents)
+    {
+        if (remaining[dependent].fetch_sub(1) == 1)
+        {
+            group.run([this, dependent, &group, remaining, start]() { execute(dependent, group, remaining, start); });
+        }
+    }
+}
+
+void carve::util::TaskGraph::run()
+{
+    std::unique_ptr<std::atomic<size_t>[]> remaining(new std::atomic<size_t>[nodes.size()]);
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        remaining[i].store(nodes[i].dependencies);
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    TaskGroup group(pool);
+    for (node_t node = 0; node < nodes.size(); ++node)
+    {
+        if (nodes[node].dependencies == 0)
+        {
+            std::atomic<size_t>* counts = remaining.get();
+            group.run([this, node, &group, counts, start]() { execute(node, group, counts, start); });
+        }
+    }
+    group.wait();
+}
@@ -396,7 +396,7 @@ bool findDiagonal(vertex_info* begin, vertex_info*& v1, vertex_info*& v2)
 #if defined(CARVE_DEBUG_WRITE_PLY_DATA)
 void dumpPoly(const std::vector<carve::geom2d::P2>& points, const std::vector<carve::triangulate::tri_idx>& result)
 {
-    static int step = 0;
+    static std::atomic<int> step(0);
     std::ostringstream filename;
     filename << "poly_" << step++ << ".svg";
     std::cerr << "dumping to " << filename.str() << std::endl;